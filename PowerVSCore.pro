@@ -5,7 +5,7 @@ TARGET = PowerVSCore
 CONFIG += debug_and_release
 
 # Add the headers to the include path
-INCLUDEPATH += decklink_sdk/ include include/decklink include/licensing include/player include/recorder include/videoport log4cxx/include
+INCLUDEPATH += decklink_sdk/ include include/decklink include/licensing include/output include/player include/recorder include/videoport log4cxx/include
 
 # Required for some C99 defines
 DEFINES += __STDC_CONSTANT_MACROS
@@ -37,11 +37,25 @@ SOURCES += \
     src/decklink/decklinkinput.cpp \
     src/decklink/decklinkoutput.cpp \
     src/decklink/decklinkcontrol.cpp \
-    src/player/audiosamplearray.cpp \
+    src/output/devicecontrol.cpp \
+    src/output/outputdevice.cpp \
+    src/output/virtualoutput.cpp \
+    src/player/audiopacketizer.cpp \
     src/player/audiothread.cpp \
     src/player/avdecodedframe.cpp \
+    src/player/codecbufferpool.cpp \
+    src/player/decoderscheduler.cpp \
+    src/player/decoderstage.cpp \
     src/player/ffdecoder.cpp \
+    src/player/framebus.cpp \
+    src/player/framecache.cpp \
+    src/player/frameindex.cpp \
+    src/player/framepool.cpp \
+    src/player/monointerleaver.cpp \
+    src/player/pixelkernels.cpp \
+    src/player/playoutclock.cpp \
     src/player/player.cpp \
+    src/player/slicescaler.cpp \
     src/player/videothread.cpp \
     src/recorder/videoencoder.cpp \
     src/recorder/recorder.cpp \
@@ -57,11 +71,27 @@ HEADERS += \
     include/decklink/decklinkinput.h \
     include/decklink/decklinkoutput.h \
     include/decklink/decklinkcontrol.h \
-    include/player/audiosamplearray.h \
+    include/output/devicecontrol.h \
+    include/output/inputdevice.h \
+    include/output/outputdevice.h \
+    include/output/virtualoutput.h \
+    include/player/audiopacketizer.h \
     include/player/audiothread.h \
     include/player/avdecodedframe.h \
+    include/player/codecbufferpool.h \
+    include/player/decoderscheduler.h \
+    include/player/decoderstage.h \
     include/player/ffdecoder.h \
+    include/player/framebus.h \
+    include/player/framecache.h \
+    include/player/frameindex.h \
+    include/player/framepool.h \
+    include/player/monointerleaver.h \
+    include/player/pixelkernels.h \
+    include/player/playoutclock.h \
     include/player/player.h \
+    include/player/ringqueue.h \
+    include/player/slicescaler.h \
     include/player/videothread.h \
     include/recorder/videoencoder.h \
     include/recorder/recorder.h \
@@ -22,6 +22,11 @@ class Core
         const int getVideoPortCount() const;
         const int activatePlayout(const int port) const;
         const int deactivatePlayout(const int port) const;
+        const int setBufferDepth(const int port, const int depth) const;
+        const int setLowLatency(const int port, const bool enabled) const;
+        const int setCacheSize(const int port, const int megabytes) const;
+        // Returns the new port count
+        const int addVirtualPorts(const int count, const QString& dumpPath, const bool realtime);
 
     private:
         VideoPort* getVideoPort(const int port) const;
@@ -32,6 +37,8 @@ class Core
         const int changeFormat(const int port, const QString& format) const;
         const int64_t getCurrentPlayTime(const int port) const;
         const int64_t getCurrentTimeCode(const int port) const;
+        const int getAudioBufferLevel(const int port) const;
+        const int getAudioUnderruns(const int port) const;
 
         const int recue(const int port, const bool loop) const;
         const int take(const int port) const;
@@ -44,6 +51,11 @@ class Core
         const double forward(const int port) const;
         const double reverse(const int port) const;
 
+    // Diagnostics functions
+    public:
+        // Logs the pixel conversion kernels timings against swscale
+        void benchmarkConversions(const int width, const int height, const int iterations) const;
+
     private:
         QCoreApplication* app;
         static QTextStream* stream;
@@ -2,13 +2,11 @@
 #define DECKLINKINPUT_H
 
 #include "DeckLinkAPI_h.h"
+#include "inputdevice.h"
 
-#include <QObject>
 #include <QMutex>
 
-class IOBridge;
-
-class DeckLinkInput : public QObject, public IDeckLinkInputCallback
+class DeckLinkInput : public InputDevice, public IDeckLinkInputCallback
 {
     Q_OBJECT
 
@@ -54,10 +52,6 @@ class DeckLinkInput : public QObject, public IDeckLinkInputCallback
         virtual HRESULT STDMETHODCALLTYPE QueryInterface (REFIID, LPVOID*) { return E_NOINTERFACE; }
         virtual ULONG STDMETHODCALLTYPE AddRef () { return 1; }
         virtual ULONG STDMETHODCALLTYPE Release () { return 1; }
-
-    signals:
-        void signalError();
-        void timecodeReceived(QString timecode);
 };
 
 #endif // DECKLINKINPUT_H
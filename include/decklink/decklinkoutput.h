@@ -2,14 +2,12 @@
 #define DECKLINKOUTPUT_H
 
 #include "DeckLinkAPI_h.h"
+#include "outputdevice.h"
 
-#include <stdint.h>
-#include <QObject>
-#include <QString>
+#include <QList>
+#include <QMutex>
 
-class Player;
-
-class DeckLinkOutput : public QObject, public IDeckLinkVideoOutputCallback, public IDeckLinkAudioOutputCallback
+class DeckLinkOutput : public OutputDevice, public IDeckLinkVideoOutputCallback, public IDeckLinkAudioOutputCallback
 {
     Q_OBJECT
 
@@ -19,58 +17,45 @@ class DeckLinkOutput : public QObject, public IDeckLinkVideoOutputCallback, publ
 
     public:
         bool isInitialized();
-
-        bool enableCard();
-        void loadBars();
-        void disableCard();
-        const QString getDeviceName() const;
-        const bool changeFormat(const QString& format);
-        void setRate(const double rate);
-        void setStartFrame(const int64_t start_frame);
-        void adjustFPS(const double adjust);
-
-    public:
-        void startPlayback(Player* player);
-        void stopPlayback(const bool immediate);
-        void outputVideo(const uint8_t* videoBuffer, const int size, const bool preview, const int64_t timecode);
-        void outputAudio(const uint8_t* audioBuffer, const int size);
+        const int64_t getReferenceTime();
+
+    protected:
+        bool enableOutput(const QString& format);
+        void disableOutput();
+        void setCallbacks(const bool enabled);
+        bool displayFrame(const uint8_t* frame, const int64_t timecode);
+        bool scheduleFrame(const uint8_t* frame, const int64_t timecode, const int64_t displayTime, const int64_t duration);
+        const int scheduleAudio(const uint8_t* samples, const int count, const int64_t streamTime);
+        const uint32_t getBufferedAudioSamples();
+        void beginAudioPreroll();
+        void endAudioPreroll();
+        const bool isPlaybackRunning();
+        void startScheduledPlayback();
+        void stopScheduledPlayback(const bool immediate, const int64_t stopTime);
+        const bool isReferenceLocked();
+        void bufferDepthChanged();
 
     private:
         void print_output_modes(IDeckLink* deckLink);
+        void allocateFrames();
+        void resizeFrames();
+        void releaseFrames();
+        IDeckLinkMutableVideoFrame* fillFrame(const uint8_t* frame, const int64_t timecode);
+        void recycleFrame(IDeckLinkVideoFrame* frame);
 
     private:
-        Player* player;
-
-        QString deviceName;
         IDeckLinkOutput* outputCard;
         BMDDisplayMode setDisplayMode;
-        QString filename;
 
-        int width;
-        int height;
-        int frameSize;
-        int rowBytes;
-        int vancRows;
-        int videoOffset;
-        bool canPreview;
-        int64_t startFrame;
-        double ratio;
-        int64_t totalFrames;
-        int64_t totalAudioSamples;
-        int prerollCount;
-        int64_t endFrame;
-        bool playing;
-
-        BMDAudioSampleRate sampleRate;
         BMDAudioSampleType sampleType;
-        int channelCount;
         BMDAudioOutputStreamType streamType;
-
         BMDPixelFormat pixelFormat;
-        BMDTimeValue originalFrameDuration;
-        BMDTimeValue frameDisplayTime;
-        BMDTimeValue frameDuration;
-        BMDTimeScale frameTimescale;
+        bool callbacks;
+
+        // Card frames of the current format, reused once the card reported them back
+        QMutex frameMutex;
+        QList<IDeckLinkMutableVideoFrame*> outputFrames;
+        QList<IDeckLinkMutableVideoFrame*> freeFrames;
 
     public:
         virtual HRESULT STDMETHODCALLTYPE ScheduledFrameCompleted(IDeckLinkVideoFrame* completed_frame, BMDOutputFrameCompletionResult result);
@@ -81,9 +66,6 @@ class DeckLinkOutput : public QObject, public IDeckLinkVideoOutputCallback, publ
         virtual HRESULT STDMETHODCALLTYPE QueryInterface (REFIID, LPVOID*) { return E_NOINTERFACE; }
         virtual ULONG STDMETHODCALLTYPE AddRef () { return 1; }
         virtual ULONG STDMETHODCALLTYPE Release () { return 1; }
-
-    signals:
-        void genlockError();
 };
 
 #endif // DECKLINKOUTPUT_H
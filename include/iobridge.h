@@ -1,9 +1,7 @@
 #ifndef IOBRIDGE_H
 #define IOBRIDGE_H
 
-#ifdef DECKLINK
-#include "decklinkcontrol.h"
-#endif
+#include "devicecontrol.h"
 #ifdef GUI
 #include "previewerrgb.h"
 #endif
@@ -42,10 +40,8 @@ class IOBridge : public QObject
 #ifdef GUI
         PreviewerRGB* preview;
 #endif
-#ifdef DECKLINK
-        DeckLinkOutput* deckLinkOutput;
-        DeckLinkInput* deckLinkInput;
-#endif
+        OutputDevice* outputDevice;
+        InputDevice* inputDevice;
         Recorder* recorder;
         IOBridge* ioBridge;
 
@@ -81,12 +77,10 @@ class IOBridge : public QObject
 #ifdef GUI
         void togglePreviewVideo(PreviewerRGB* previewer);
 #endif
-#ifdef DECKLINK
-        const QString setDeckLinkInput(QString inter);
-        const DeckLinkInput* getDecklinkInput() const;
-        const QString setDeckLinkOutput(QString inter);
-        const DeckLinkOutput* getDecklinkOutput() const;
-#endif
+        const QString setInputDevice(QString inter);
+        const InputDevice* getInputDevice() const;
+        const QString setOutputDevice(QString inter);
+        const OutputDevice* getOutputDevice() const;
         const void setIOBridge(IOBridge* ioBridge);
         const void rebootInterface();
         const Recorder* getRecorder() const;
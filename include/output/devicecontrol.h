@@ -0,0 +1,31 @@
+#ifndef DEVICECONTROL_H
+#define DEVICECONTROL_H
+
+#include "inputdevice.h"
+#include "outputdevice.h"
+
+#include <QList>
+#include <QStringList>
+
+// Devices the ports can be attached to, the cards found at startup followed by the virtual outputs
+class DeviceControl
+{
+    public:
+        static bool init();
+        static void destroy();
+
+    public:
+        static const QStringList getInputList();
+        static const QStringList getOutputList();
+        static InputDevice* getInput(const int pos);
+        static OutputDevice* getOutput(const int pos);
+        // Returns the position of the new output
+        static const int addVirtualOutput(const QString& name, const QString& dumpPath, const bool realtime);
+
+    private:
+        static QList<InputDevice*> inputList;
+        static QList<OutputDevice*> outputList;
+        static QList<OutputDevice*> virtualOutputList;
+};
+
+#endif // DEVICECONTROL_H
@@ -0,0 +1,38 @@
+#ifndef INPUTDEVICE_H
+#define INPUTDEVICE_H
+
+#include <QObject>
+#include <QString>
+
+class IOBridge;
+
+// Capture device pushing every arrived frame and its audio to the attached bridge
+class InputDevice : public QObject
+{
+    Q_OBJECT
+
+    public:
+        explicit InputDevice(QObject* parent = 0) : QObject(parent) {}
+        virtual ~InputDevice() {}
+
+    public:
+        virtual bool isInitialized() = 0;
+
+        virtual bool enableCard() = 0;
+        virtual void disableCard() = 0;
+        virtual void flushCard() = 0;
+        virtual QString getDeviceName() = 0;
+        virtual bool changeFormat(QString format) = 0;
+        virtual void setIOBridge(IOBridge* ioBridge) = 0;
+
+        virtual void startStreams() = 0;
+        virtual void pauseStreams() = 0;
+        virtual void flushStreams() = 0;
+        virtual void stopStreams() = 0;
+
+    signals:
+        void signalError();
+        void timecodeReceived(QString timecode);
+};
+
+#endif // INPUTDEVICE_H
@@ -0,0 +1,157 @@
+#ifndef OUTPUTDEVICE_H
+#define OUTPUTDEVICE_H
+
+#include <stdint.h>
+#include <QAtomicInt>
+#include <QMutex>
+#include <QObject>
+#include <QString>
+
+class AVDecodedFrame;
+class Player;
+
+// Frames kept scheduled ahead on the device, trading latency for resilience against late decoding
+#define DEFAULT_BUFFER_DEPTH 10
+#define LOW_LATENCY_BUFFER_DEPTH 4
+#define MIN_BUFFER_DEPTH 2
+#define MAX_BUFFER_DEPTH 32
+// Audio kept scheduled on the device, in frames of video per frame of the buffer depth
+#define AUDIO_WATER_LEVEL_FRAMES 2
+// Decoded audio waiting for the device, in seconds
+#define AUDIO_RING_SECONDS 4
+// Scheduled frames between two reference lock checks
+#define REFERENCE_CHECK_INTERVAL 25
+
+// What became of a scheduled frame, reported by the device once the frame left the output
+enum FrameCompletion
+{
+    FRAME_COMPLETED,
+    FRAME_DISPLAYED_LATE,
+    FRAME_DROPPED,
+    FRAME_FLUSHED
+};
+
+// Playout device pulling frames from a player. Frames are scheduled ahead on the device timeline, the device
+// reports every frame back once it left the output, which schedules the next one, and asks for audio whenever
+// its buffer needs refilling, which also recovers from an underrun. Devices implement the primitives, times are in units of the frame timescale
+class OutputDevice : public QObject
+{
+    Q_OBJECT
+
+    public:
+        explicit OutputDevice(QObject* parent = 0);
+        virtual ~OutputDevice();
+
+    public:
+        virtual bool isInitialized() = 0;
+
+        bool enableCard();
+        void loadBars();
+        void disableCard();
+        const QString getDeviceName() const;
+        const bool changeFormat(const QString& format);
+        void setRate(const double rate);
+        void setStartFrame(const int64_t start_frame);
+        void adjustFPS(const double adjust);
+        void setBufferDepth(const int depth);
+        const int getBufferDepth() const;
+        // Microseconds on the clock the device plays out on, the system clock unless it has its own
+        virtual const int64_t getReferenceTime();
+
+        // Audio buffered on the device in milliseconds, at the last fill and the lowest since playback started
+        const int getAudioBufferLevel() const;
+        const int getAudioUnderruns() const;
+        const QString getAudioStatistics() const;
+
+    public:
+        void startPlayback(Player* player);
+        void stopPlayback(const bool immediate);
+        void outputVideo(const uint8_t* videoBuffer, const int size, const bool preview, const int64_t timecode);
+        void outputAudio(const uint8_t* audioBuffer, const int size);
+
+    // Pull model, called from the device callbacks
+    protected:
+        void frameCompleted(const FrameCompletion result);
+        void renderAudio(const bool preroll);
+        void playbackStopped();
+
+    private:
+        void scheduleFrames();
+        void fillAudio(const bool preroll);
+        void resetAudio();
+
+    // Device primitives
+    protected:
+        // Sets the size and frame rate of the format, false if the device does not support it
+        virtual bool enableOutput(const QString& format) = 0;
+        virtual void disableOutput() = 0;
+        virtual void setCallbacks(const bool enabled) = 0;
+        virtual bool displayFrame(const uint8_t* frame, const int64_t timecode) = 0;
+        virtual bool scheduleFrame(const uint8_t* frame, const int64_t timecode, const int64_t displayTime, const int64_t duration) = 0;
+        // Returns the samples the device took, -1 on error
+        virtual const int scheduleAudio(const uint8_t* samples, const int count, const int64_t streamTime) = 0;
+        virtual const uint32_t getBufferedAudioSamples() = 0;
+        virtual void beginAudioPreroll() = 0;
+        virtual void endAudioPreroll() = 0;
+        virtual const bool isPlaybackRunning() = 0;
+        virtual void startScheduledPlayback() = 0;
+        // Stops once the frame at stopTime was shown, immediate stops and flushes what is scheduled
+        virtual void stopScheduledPlayback(const bool immediate, const int64_t stopTime) = 0;
+        virtual const bool isReferenceLocked() = 0;
+        // Devices keeping resources per scheduled frame resize them here, nothing by default
+        virtual void bufferDepthChanged();
+
+    protected:
+        Player* player;
+
+        QString deviceName;
+        QString format;
+        QString filename;
+
+        int width;
+        int height;
+        int frameSize;
+        int rowBytes;
+        int vancRows;
+        int videoOffset;
+        bool canPreview;
+        int64_t startFrame;
+        double ratio;
+        int64_t totalFrames;
+        int64_t totalAudioSamples;
+        int prerollCount;
+        int64_t endFrame;
+        bool playing;
+        int referenceCheck;
+
+        // Frames handed to the device and not reported back yet, topped up to the buffer depth
+        int bufferDepth;
+        QAtomicInt scheduledFrames;
+        QMutex scheduleMutex;
+        bool endOfStream;
+
+        // Contiguous PCM ring between the player and the device, drained in as few spans as possible
+        QMutex audioMutex;
+        uint8_t* audioRing;
+        int audioRingSize;
+        int audioRead;
+        int audioFill;
+        AVDecodedFrame* pendingAudio;
+        uint32_t audioLevel;
+        int64_t audioLowest;
+        int audioUnderruns;
+        bool audioStarved;
+
+        int sampleRate;
+        int channelCount;
+
+        int64_t originalFrameDuration;
+        int64_t frameDisplayTime;
+        int64_t frameDuration;
+        int64_t frameTimescale;
+
+    signals:
+        void genlockError();
+};
+
+#endif // OUTPUTDEVICE_H
@@ -0,0 +1,104 @@
+#ifndef VIRTUALOUTPUT_H
+#define VIRTUALOUTPUT_H
+
+#include "outputdevice.h"
+
+#include <QByteArray>
+#include <QFile>
+#include <QList>
+#include <QMutex>
+#include <QThread>
+
+// Output device without a card, used to soak test and benchmark ports on machines without one.
+// A clock thread plays the scheduled frames out on the timeline of the format, either in real time or as fast
+// as the player delivers them, and reports them back like a card: frames shown after their display time are
+// late, frames overtaken by a later one are dropped. Pictures and audio are appended to raw UYVY and PCM files
+// in the dump directory, or discarded when there is none
+class VirtualOutput : public OutputDevice
+{
+    Q_OBJECT
+
+    public:
+        explicit VirtualOutput(const QString& name, const QString& dumpPath, const bool realtime);
+        ~VirtualOutput();
+
+    public:
+        bool isInitialized();
+        const QString getStatistics();
+
+    protected:
+        bool enableOutput(const QString& format);
+        void disableOutput();
+        void setCallbacks(const bool enabled);
+        bool displayFrame(const uint8_t* frame, const int64_t timecode);
+        bool scheduleFrame(const uint8_t* frame, const int64_t timecode, const int64_t displayTime, const int64_t duration);
+        const int scheduleAudio(const uint8_t* samples, const int count, const int64_t streamTime);
+        const uint32_t getBufferedAudioSamples();
+        void beginAudioPreroll();
+        void endAudioPreroll();
+        const bool isPlaybackRunning();
+        void startScheduledPlayback();
+        void stopScheduledPlayback(const bool immediate, const int64_t stopTime);
+        const bool isReferenceLocked();
+
+    private:
+        class Clock : public QThread
+        {
+            public:
+                explicit Clock(VirtualOutput* output) : output(output) {}
+
+            protected:
+                void run() { output->run(); }
+
+            private:
+                VirtualOutput* output;
+        };
+
+        struct ScheduledFrame
+        {
+            QByteArray picture;
+            int64_t displayTime;
+            int64_t duration;
+        };
+
+    private:
+        void run();
+        const bool tick();
+        void flushFrames();
+        void openDumps();
+        void closeDumps();
+
+    private:
+        Clock* clock;
+        QMutex mutex;
+        QString dumpPath;
+        bool realtime;
+        bool quit;
+
+        bool enabled;
+        bool callbacks;
+        bool preroll;
+        bool running;
+        bool stopping;
+        int64_t stopTime;
+
+        // Timeline of the format, one tick per frame
+        int64_t modeDuration;
+        int64_t deviceTime;
+        int64_t audioConsumed;
+
+        QList<ScheduledFrame> frames;
+        QList<QByteArray> freeFrames;
+        QByteArray audio;
+        QFile videoDump;
+        QFile audioDump;
+
+        int64_t framesShown;
+        int64_t framesLate;
+        int64_t framesDropped;
+        int64_t videoUnderruns;
+        // Ticks that played at least part of their audio as silence, the player side gaps are the audio underruns
+        int64_t silentTicks;
+};
+
+#endif // VIRTUALOUTPUT_H
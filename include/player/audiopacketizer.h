@@ -0,0 +1,49 @@
+#ifndef AUDIOPACKETIZER_H
+#define AUDIOPACKETIZER_H
+
+#include <stdint.h>
+
+extern "C"
+{
+    #include <libavutil/rational.h>
+}
+
+// Re-chunks interleaved output audio into blocks of exactly one video frame.
+// The samples of frame n are the difference of the rounded down totals after frames n+1 and n, which gives
+// 1920 at 25 fps, 960 at 50 fps, 1601/1602 at 29.97 and 800/801 at 59.94. The cadence restarts on reset.
+class AudioPacketizer
+{
+    public:
+        explicit AudioPacketizer(const int bytesPerSample, const int sampleRate, const AVRational frameRate);
+        ~AudioPacketizer();
+
+    public:
+        void append(const uint8_t* data, const int size);
+
+        // Block of the current frame, NULL until enough samples were appended
+        const uint8_t* getBlock() const;
+        const int getBlockSize() const;
+        void next();
+
+        // Pads the samples left with silence up to a full block, used at the end of the clip
+        void flush();
+        void reset();
+
+    private:
+        const int getBlockSamples(const int64_t frame) const;
+        void reserve(const int size);
+
+    private:
+        int bytesPerSample;
+        int sampleRate;
+        AVRational frameRate;
+
+        uint8_t* buffer;
+        int capacity;
+        int start;
+        int end;
+        int64_t frame;
+        int blockSize;
+};
+
+#endif // AUDIOPACKETIZER_H
@@ -1,7 +1,8 @@
 #ifndef AUDIOTHREAD_H
 #define AUDIOTHREAD_H
 
-#include "avdecodedframe.h"
+#include "playoutclock.h"
+#include "ringqueue.h"
 
 #include <QMutex>
 #include <QThread>
@@ -15,7 +16,7 @@ class AudioThread : public QThread
     Q_OBJECT
 
     public:
-        explicit AudioThread(bool preview, QObject* parent = 0);
+        explicit AudioThread(bool preview, PlayoutClock* clock, QObject* parent = 0);
         ~AudioThread();
 
     public:
@@ -23,14 +24,15 @@ class AudioThread : public QThread
         void startPlaying();
         void stopPlaying();
         void cleanup();
-        const bool pushAudioFrame(AVDecodedFrame* a);
+        FrameQueue* getQueue();
 
     private:
         bool playing;
         bool loop;
         bool preview;
+        PlayoutClock* clock;
         QMutex audioMutex;
-        QList<AVDecodedFrame*> audioSamplesList;
+        FrameQueue audioSamples;
     private:
         void run();
 #ifdef PORTAUDIO
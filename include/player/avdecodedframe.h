@@ -1,30 +1,55 @@
 #ifndef AVDECODEDFRAME_H
 #define AVDECODEDFRAME_H
 
+#include <QAtomicInt>
 #include <QByteArray>
+#include <QList>
 
 extern "C"
 {
     #include <libavformat/avformat.h>
 }
 
+class FramePool;
+
 class AVDecodedFrame
 {
-    public:
-        AVDecodedFrame(AVMediaType type, uint8_t* data, const int size, const int64_t pts, const int64_t clockPts);
+    friend class FramePool;
+
+    private:
+        AVDecodedFrame(FramePool* pool, uint8_t* buffer, const int capacity);
         ~AVDecodedFrame();
 
+    public:
+        // Frames are taken from the FramePool and handed back to it when the last reference is released
+        static AVDecodedFrame* create(AVMediaType type, const uint8_t* data, const int size, const int64_t pts, const int64_t clockPts);
+        static AVDecodedFrame* allocate(AVMediaType type, const int size, const int64_t pts, const int64_t clockPts);
+        // Shares the first plane of an already converted frame instead of copying it, the reference is dropped on release
+        static AVDecodedFrame* wrap(AVMediaType type, AVFrame* frame, const int size, const int64_t pts, const int64_t clockPts);
+
+        void ref();
+        void release();
+
+        static void releaseFrame(AVDecodedFrame* frame);
+        // Releases every frame of the list (NULL end of stream markers are skipped) and clears it
+        static void releaseAll(QList<AVDecodedFrame*>& frames);
+
     private:
+        FramePool* pool;
+        AVFrame* source;
+        QAtomicInt refCount;
         AVMediaType type;
         int64_t pts;
         int64_t clockPts;
         uint8_t* buffer;
+        int bufferCapacity;
         int frameSize;
 
     public:
         const int64_t getPTS();
         const int64_t getClockPTS();
         const uint8_t* getBuffer();
+        uint8_t* getWritableBuffer();
         const int getSize();
 };
 
@@ -0,0 +1,59 @@
+#ifndef CODECBUFFERPOOL_H
+#define CODECBUFFERPOOL_H
+
+#include <QAtomicInt>
+#include <QMutex>
+#include <QString>
+
+extern "C"
+{
+    #include <libavcodec/avcodec.h>
+}
+
+// Picture buffers handed to a video decoder through get_buffer2.
+// Planes come from one AVBufferPool per plane size, 64 byte aligned and backed by large pages when the process
+// is allowed to lock memory, so decoded frames can stay referenced through the pipeline without being copied.
+// Callbacks may come from the frame threads of the decoder at the same time.
+class CodecBufferPool
+{
+    public:
+        CodecBufferPool();
+        ~CodecBufferPool();
+
+    public:
+        void attach(AVCodecContext* codecContext);
+
+        const int getRequestCount() const;
+        const int getAllocationCount() const;
+        const int getLargePageCount() const;
+        const QString getStatistics() const;
+
+        static const bool enableLargePages();
+
+    private:
+        static int getBuffer(AVCodecContext* codecContext, AVFrame* frame, int flags);
+        const int fillFrame(AVCodecContext* codecContext, AVFrame* frame);
+        void resetPools();
+
+        static AVBufferRef* allocateBuffer(void* opaque, int size);
+        static void freeAligned(void* opaque, uint8_t* data);
+        static void freeLargePage(void* opaque, uint8_t* data);
+
+    private:
+        static QMutex largePageMutex;
+        static int largePageState;
+        static size_t largePageSize;
+
+        QMutex mutex;
+        AVBufferPool* pools[AV_NUM_DATA_POINTERS];
+        int poolSizes[AV_NUM_DATA_POINTERS];
+        int poolWidth;
+        int poolHeight;
+        int poolFormat;
+
+        QAtomicInt requests;
+        QAtomicInt allocations;
+        QAtomicInt largePages;
+};
+
+#endif // CODECBUFFERPOOL_H
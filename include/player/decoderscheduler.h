@@ -0,0 +1,53 @@
+#ifndef DECODERSCHEDULER_H
+#define DECODERSCHEDULER_H
+
+#include <QElapsedTimer>
+#include <QMap>
+#include <QMutex>
+#include <QString>
+
+extern "C"
+{
+    #include <libavcodec/avcodec.h>
+}
+
+class FFDecoder;
+
+// Shares one thread budget between the decoders of every port.
+// Each video decoder is weighted by codec and raster, its share sets the codec threads when it is opened
+// and the conversion slices of the decoder. Shares are recomputed whenever a port loads or drops media,
+// codec threads of decoders already open only follow on their next load.
+class DecoderScheduler
+{
+    public:
+        // Sets the threading of a video codec context before it is opened
+        static void attach(FFDecoder* decoder, const QString& name, AVCodecContext* codecContext, const double fps);
+        static void detach(FFDecoder* decoder);
+        static void addBusyTime(FFDecoder* decoder, const qint64 nsecs);
+
+        static void setThreadBudget(const int threads);
+        static const int getThreadBudget();
+        static const QString getStatistics();
+
+    private:
+        struct DecoderEntry
+        {
+            QString name;
+            double weight;
+            int threads;
+            bool frameThreads;
+            qint64 busyTime;
+            QElapsedTimer attached;
+        };
+
+        static void rebalance();
+        static const double getWeight(const AVCodecContext* codecContext, const double fps);
+        static const QString formatStatistics();
+
+    private:
+        static QMutex mutex;
+        static QMap<FFDecoder*, DecoderEntry> decoders;
+        static int threadBudget;
+};
+
+#endif // DECODERSCHEDULER_H
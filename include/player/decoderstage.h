@@ -0,0 +1,85 @@
+#ifndef DECODERSTAGE_H
+#define DECODERSTAGE_H
+
+#include "ringqueue.h"
+
+#include <QList>
+#include <QMutex>
+#include <QThread>
+
+extern "C"
+{
+    #include <libavformat/avformat.h>
+}
+
+class FFDecoder;
+
+// Packets and frames kept for reuse between the stages, above this they are freed
+#define STAGE_FREE_LIST_SIZE 256
+
+enum StageType
+{
+    VIDEO_DECODE_STAGE,
+    VIDEO_CONVERT_STAGE,
+    VIDEO_REVERSE_STAGE,
+    AUDIO_DECODE_STAGE
+};
+
+// Unit of work passed between the demux, decode and convert stages
+struct StageItem
+{
+    AVPacket* packet;
+    AVFrame* frame;
+    double pts;
+    int64_t diff;
+    bool endOfStream;
+    bool endOfSpan; // Set on markers closing a reverse span, the codec is drained
+    int64_t spanStart; // Presentation range kept from a reverse span in stream time base, empty when decoding forwards
+    int64_t spanEnd;
+    int generation; // Seek the item was demuxed after, stages drop items of earlier seeks
+
+    // Released packets and frames are unreferenced and kept on free lists, the steady state allocates none
+    static void release(StageItem& item);
+    static AVPacket* allocatePacket();
+    static AVFrame* allocateFrame();
+    static void recyclePacket(AVPacket*& packet);
+    static void recycleFrame(AVFrame*& frame);
+    static void destroy();
+
+    static QMutex freeMutex;
+    static QList<AVPacket*> freePackets;
+    static QList<AVFrame*> freeFrames;
+};
+
+typedef RingQueue<StageItem> StageQueue;
+
+// Converted frames of one reverse span in presentation order, they are published last to first
+struct FrameSpan
+{
+    QList<AVDecodedFrame*> frames;
+    bool endOfStream;
+    bool cue;
+    int generation;
+
+    static void release(FrameSpan* span);
+};
+
+typedef RingQueue<FrameSpan*> SpanQueue;
+
+class DecoderStage : public QThread
+{
+    Q_OBJECT
+
+    public:
+        explicit DecoderStage(FFDecoder* decoder, StageType type);
+        ~DecoderStage();
+
+    private:
+        FFDecoder* decoder;
+        StageType type;
+
+    private:
+        void run();
+};
+
+#endif // DECODERSTAGE_H
@@ -1,9 +1,19 @@
 #ifndef FFDECODER_H
 #define FFDECODER_H
 
-#include "audiosamplearray.h"
-
+#include "audiopacketizer.h"
+#include "codecbufferpool.h"
+#include "decoderstage.h"
+#include "devicecontrol.h"
+#include "monointerleaver.h"
+#include "slicescaler.h"
+
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QList>
+#include <QMutex>
 #include <QThread>
+#include <QWaitCondition>
 
 extern "C"
 {
@@ -13,12 +23,34 @@ extern "C"
     #include <libavfilter/avfiltergraph.h>
 }
 
-#ifdef DECKLINK
-#include "decklinkcontrol.h"
-#endif
-
+class FrameIndex;
+class FramePool;
 class Player;
 
+// Shuttle rates above this only decode reference frames or keyframes
+#define TRICK_PLAY_RATE 2.0
+
+enum DecoderCommandType
+{
+    SEEK_COMMAND,
+    FILTER_COMMAND,
+    FORMAT_COMMAND
+};
+
+// Request handed to the decoder threads. Seeks go to the demuxer and start a new generation of frames,
+// filter and format changes go to the convert stage and are applied before the first frame of a later generation
+struct DecoderCommand
+{
+    DecoderCommandType type;
+    int64_t pos;
+    int seekFlag;
+    int64_t cacheFrom; // Frames from here up to pos only go to the frame cache, AV_NOPTS_VALUE for none
+    bool cue; // The first frame at pos is shown on the output while paused
+    int generation;
+    QString cg; // Empty removes the filter
+    QString format;
+};
+
 class FFDecoder : public QThread
 {
     Q_OBJECT
@@ -28,31 +60,65 @@ class FFDecoder : public QThread
         ~FFDecoder();
 
     public:
-#ifdef DECKLINK
-        const int64_t init(const QString& path, const QString& format, DeckLinkOutput* deckLinkOutput);
-#else
-        const int64_t init(const QString& path, const QString& format);
-#endif
+        const int64_t init(const QString& path, const QString& format, OutputDevice* outputDevice);
         void startDecoding();
+        void runStage(const StageType type);
         void decodeVideo(AVPacket* packet);
+        void convertVideo(AVFrame* frame, const double pts, const int64_t diff, const bool publish);
         void decodeAudio(AVPacket* packet);
         void stopDecoding();
-        void seek(const int64_t pos, const int seek_flag);
+        const int seek(const int64_t pos, const int seek_flag, const int64_t cacheFrom = AV_NOPTS_VALUE, const bool cue = true, const int generation = 0);
+        const int getGeneration() const;
+        static const int reserveGeneration();
+        const int64_t getStartMillisecond() const;
+        const bool hasAudio() const;
         void setRate(const double rate);
         void toggleLoop(const bool loop, const bool active);
         void changeFormat(const QString& format);
-        const bool initFilters(const QString& cg, const QString& format);
-        void cleanupFilters();
+        void setFilter(const QString& cg, const QString& format);
+        void setThreadShare(const int threads);
+        static const bool isTrickPlay(const double rate);
 
     private:
         void run();
-        int convertOutput(SwrContext* swrContext, const uint8_t** inputSamples, const int& input_nb_samples, int nb_channels, uint8_t*** outputBuffer);
+        void runVideoDecode();
+        void runVideoConvert();
+        void runVideoReverse();
+        void runAudioDecode();
+        void startStages();
+        void stopStages();
+        void processCommands();
+        void applySeek(const DecoderCommand& command);
+        void queueStageCommand(DecoderCommand& command);
+        void applyStageCommands(const int generation);
+        void applyFormat(const QString& format);
+        void applyFilter(const QString& cg, const QString& format);
+        const bool initFilters(const QString& cg, const QString& format);
+        void cleanupFilters();
+        void demuxReverse();
+        void startReverseSpan();
+        void pushReverseSpan(const bool endOfStream);
+        void appendReverseFrame(AVDecodedFrame* v);
+        const int64_t getFrameDuration() const;
+        const int64_t getStreamStart(const AVStream* stream) const;
+        const int64_t toStreamTime(const int64_t ms, const AVStream* stream) const;
+        static const AVDiscard getSkipFrame(const double rate);
+        void publishVideoFrame(AVDecodedFrame* v, const int generation, int64_t& outputClock);
+        void seekStream(const int64_t pos, const int seek_flag);
+        void discardAudio(const bool discard);
+        const bool isBeforeSeekTarget(const AVFrame* frame, const AVStream* stream, const int64_t target) const;
+        int convertOutput(SwrContext* swrContext, const uint8_t** inputSamples, const int& input_nb_samples, int nb_channels, uint8_t**& outputBuffer, int& capacity);
+        static void freeSamples(uint8_t**& samples, int& capacity);
 #ifdef PORTAUDIO
         void pushAudioFrame(const double& sr, const int& data_size, uint8_t** outputBuffer, const int& data_size_preview, uint8_t** previewBuffer);
 #else
 		void pushAudioFrame(const double& sr, const int& data_size, uint8_t** outputBuffer);
 #endif
         void createFrames(const QString& format);
+        void createOutputFrame(const QString& format);
+        void interleaveMono(const int track);
+        void pushAudioBlocks();
+        void resetAudioSamples();
         void cleanup();
 
     // Decoder variables
@@ -66,23 +132,81 @@ class FFDecoder : public QThread
 
         AVStream* videoStream;
         AVStream* audioStream;
+        bool audioDiscarded;
 
         AVFrame* tmpFrame;
         AVFrame* frameUYVY;
-        SwsContext* swsContext;
-
-#ifdef GUI
-        AVFrame* framePreview;
-        SwsContext* swsContextPreview;
-#endif
+        SliceScaler* scaler;
+        FramePool* videoPool;
+        CodecBufferPool* bufferPool;
+        int threadShare;
 
         AVFrame* frameAudio;
         SwrContext* swrContext;
 
+        // Conversion buffers kept across frames, grown to the largest frame converted so far
+        uint8_t** outputSamples;
+        int outputSamplesCapacity;
+
 #ifdef PORTAUDIO
         SwrContext* swrContextPreview;
+        uint8_t** previewSamples;
+        int previewSamplesCapacity;
 #endif
 
+        // Pipeline stages, demuxing runs in this thread
+        StageQueue videoPackets;
+        StageQueue audioPackets;
+        StageQueue videoFrames;
+        DecoderStage* videoDecodeStage;
+        DecoderStage* videoConvertStage;
+        DecoderStage* audioDecodeStage;
+
+        // Reverse playback decodes spans of at least one GOP forwards, the reverse stage publishes a span
+        // backwards while the previous one is decoded
+        SpanQueue reverseSpans;
+        DecoderStage* videoReverseStage;
+        bool reversePlayback;
+        bool reverseSpanPending;
+        int64_t reverseStart;
+        int64_t reverseEnd;
+        int64_t videoSpanStart;
+        int64_t videoSpanEnd;
+        bool reverseConvert;
+        FrameSpan* reverseSpan;
+
+        // Media time in microseconds the output reached in trick play, per publishing stage
+        int64_t convertOutputClock;
+
+        // Seek commands, coalesced while the demuxer has not picked them up
+        QMutex commandMutex;
+        QWaitCondition commandCondition;
+        QList<DecoderCommand> commands;
+        // Filter and format changes waiting for the convert stage
+        QList<DecoderCommand> stageCommands;
+        int coalescedSeeks;
+        bool endOfFile;
+
+        // Generation of the last requested seek, and the one each stage is working on
+        static QAtomicInt generationCounter;
+        QAtomicInt generation;
+        int demuxGeneration;
+        int videoDecodeGeneration;
+        int videoConvertGeneration;
+        int audioDecodeGeneration;
+
+        // Seek targets in milliseconds, the stages drop frames before them
+        FrameIndex* frameIndex;
+        int64_t seekTarget;
+        int64_t cacheTarget;
+        bool seekCue;
+        int64_t videoSeekTarget;
+        int64_t videoPublishTarget;
+        int64_t audioSeekTarget;
+        QElapsedTimer seekTimer;
+        int seekDiscarded;
+        bool seekPending;
+
         // Filtergraph variables
         AVFrame* filterFrame;
         AVFilterGraph* filterGraph;
@@ -91,6 +215,7 @@ class FFDecoder : public QThread
 
         bool decoding;
         bool loop;
+        int64_t startMillisecond;
         double fps;
         double rate;
 
@@ -103,14 +228,8 @@ class FFDecoder : public QThread
         double sr;
         int bytes_per_sample;
 
-        uint8_t** inputSamples;
-        int input_linesize;
-        int input_nb_samples;
-        SwrContext* swrContextMono;
-
-        int last_audio_index;
-        int index;
-        QList<AudioSampleArray*> audioSamplesList;
+        MonoInterleaver* monoInterleaver;
+        AudioPacketizer* audioPacketizer;
 
     private:
         // Video output variables
@@ -118,15 +237,7 @@ class FFDecoder : public QThread
         int outputHeight;
         int outputFrameSize;
         AVPixelFormat outputFormat;
-
-#ifdef GUI
-        // Preview variables
-        int previewWidth;
-        int previewHeight;
-        int previewOffset;
-        int previewFrameSize;
-        AVPixelFormat previewFormat;
-#endif
+        bool passThrough;
 
         // Audio output variables
         int outputChannelCount;
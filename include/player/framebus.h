@@ -0,0 +1,33 @@
+#ifndef FRAMEBUS_H
+#define FRAMEBUS_H
+
+#include "ringqueue.h"
+
+#include <QList>
+#include <QMutex>
+
+// Publishes one decoded frame to every attached consumer queue, each consumer holds its own reference.
+// Frames are tagged with the decoder seek generation, a flush drops every queued frame and every later
+// publish of an earlier generation.
+class FrameBus
+{
+    public:
+        FrameBus();
+        ~FrameBus();
+
+    public:
+        void attach(FrameQueue* queue);
+        void detach(FrameQueue* queue);
+        const bool hasConsumers();
+        const bool publish(AVDecodedFrame* frame, const int generation);
+        void flush(const int generation);
+        void setGeneration(const int generation);
+
+    private:
+        QMutex mutex;
+        QMutex publishMutex;
+        QList<FrameQueue*> queues;
+        int generation;
+};
+
+#endif // FRAMEBUS_H
@@ -0,0 +1,52 @@
+#ifndef FRAMECACHE_H
+#define FRAMECACHE_H
+
+#include "avdecodedframe.h"
+
+#include <QMap>
+#include <QMutex>
+#include <QString>
+
+// Memory kept for frame stepping on each port in megabytes, 0 disables the cache
+#define DEFAULT_FRAME_CACHE_SIZE 256
+#define MAX_FRAME_CACHE_SIZE 4096
+
+// Window of output frames around the playhead, keyed by clock in milliseconds.
+// Frames are shared with the output queues, the cache holds its own reference. When the memory limit
+// is reached the frame farthest from the playhead is dropped.
+class FrameCache
+{
+    public:
+        explicit FrameCache(const qint64 limit);
+        ~FrameCache();
+
+    public:
+        void insert(AVDecodedFrame* frame);
+        // Frame closest to pos within tolerance milliseconds with a reference for the caller, NULL if none
+        AVDecodedFrame* find(const int64_t pos, const int64_t tolerance);
+        void clear();
+        void setLimit(const qint64 limit);
+
+        void setPlayhead(const int64_t pos);
+        const int countBefore(const int64_t pos);
+        const int countAfter(const int64_t pos);
+        const int getCapacity();
+        const QString getStatistics();
+
+    private:
+        void evict();
+
+    private:
+        QMutex mutex;
+        QMap<int64_t, AVDecodedFrame*> frames;
+        qint64 limit;
+        qint64 size;
+        int frameSize;
+        int64_t playhead;
+
+        int hits;
+        int misses;
+        int evictions;
+};
+
+#endif // FRAMECACHE_H
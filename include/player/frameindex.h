@@ -0,0 +1,72 @@
+#ifndef FRAMEINDEX_H
+#define FRAMEINDEX_H
+
+#include <QAtomicInt>
+#include <QMutex>
+#include <QString>
+#include <QThread>
+#include <QVector>
+
+extern "C"
+{
+    #include <libavformat/avformat.h>
+}
+
+// One video packet, timestamps are in the video stream time base
+struct FrameIndexEntry
+{
+    int64_t pts;
+    int64_t dts;
+    int64_t pos;
+    int32_t flags;
+    int32_t size;
+};
+
+// Packet positions, keyframes and timestamps of the video stream of a file.
+// The index is read from a sidecar cache keyed by path and modification time, or built by demuxing the
+// file in this thread at low priority. Lookups work on the part indexed so far.
+class FrameIndex : public QThread
+{
+    Q_OBJECT
+
+    public:
+        explicit FrameIndex(const QString& path, const int streamIndex);
+        ~FrameIndex();
+
+    public:
+        // Loads the cached index or starts building it
+        void open();
+        void abort();
+
+        // Last keyframe presenting at or before timestamp, false if the index does not reach it yet
+        const bool findKeyframe(const int64_t timestamp, FrameIndexEntry& entry) const;
+
+        const bool isComplete() const;
+        const int getEntryCount() const;
+        const int getKeyframeCount() const;
+
+    private:
+        void run();
+        void append(const FrameIndexEntry& entry);
+
+        const bool load();
+        const bool save() const;
+        const QString getCachePath() const;
+
+        static int interruptCallback(void* opaque);
+
+    private:
+        QString path;
+        int streamIndex;
+        qint64 modified;
+        qint64 fileSize;
+
+        mutable QMutex mutex;
+        QVector<FrameIndexEntry> entries;
+        QVector<int> keyframes; // Entry positions ordered by pts
+
+        QAtomicInt aborted;
+        QAtomicInt complete;
+};
+
+#endif // FRAMEINDEX_H
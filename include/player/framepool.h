@@ -0,0 +1,59 @@
+#ifndef FRAMEPOOL_H
+#define FRAMEPOOL_H
+
+#include "avdecodedframe.h"
+
+#include <QList>
+#include <QMap>
+#include <QMutex>
+#include <QString>
+
+class FramePool
+{
+    public:
+        static FramePool* getPool(const int size);
+        // Frames sharing the planes of a decoded AVFrame, they hold no buffer of their own
+        static FramePool* getWrapperPool();
+        static void destroy();
+        static const QString getStatistics();
+        static const int getTotalAllocationCount();
+
+    public:
+        AVDecodedFrame* acquire(AVMediaType type, const int size, const int64_t pts, const int64_t clockPts);
+        AVDecodedFrame* acquireWrapper(AVMediaType type, AVFrame* source, const int size, const int64_t pts, const int64_t clockPts);
+        void recycle(AVDecodedFrame* frame);
+        void preallocate(const int count);
+
+        const int getBufferSize() const;
+        const int getAllocationCount() const;
+        const int getReuseCount() const;
+        const int getOutstandingCount() const;
+
+    private:
+        explicit FramePool(const int bufferSize);
+        ~FramePool();
+
+        AVDecodedFrame* allocateFrame();
+        static void freeFrame(AVDecodedFrame* frame);
+        static void release(FramePool* pool);
+        static uint8_t* allocateBuffer(const int size);
+        static void freeBuffer(uint8_t* buffer);
+
+    private:
+        static QMutex poolsMutex;
+        static QMap<int, FramePool*> pools;
+        static FramePool* wrapperPool;
+        static QAtomicInt totalAllocations;
+
+        QMutex mutex;
+        QList<AVDecodedFrame*> freeFrames;
+        int bufferSize;
+
+        QAtomicInt allocations;
+        QAtomicInt reuses;
+        QAtomicInt outstanding;
+        // Set by destroy while frames are still held, the pool is freed with its last frame
+        bool destroyed;
+};
+
+#endif // FRAMEPOOL_H
@@ -0,0 +1,58 @@
+#ifndef MONOINTERLEAVER_H
+#define MONOINTERLEAVER_H
+
+#include <QString>
+
+extern "C"
+{
+    #include <libavutil/frame.h>
+    #include <libavutil/samplefmt.h>
+}
+
+// XDCAM and IMX MXF carry up to 8 mono PCM or AES tracks
+#define MONO_INTERLEAVER_CHANNELS 8
+
+// Gathers the decoded frames of the mono tracks of a clip into fixed planes and interleaves them to 8 channel S16.
+// Tracks are kept as S16P or S32P, packets of the tracks may arrive in any order. Planes and the interleaved
+// buffer are allocated once, nothing is allocated per packet. Channels past the last track are silent.
+class MonoInterleaver
+{
+    public:
+        explicit MonoInterleaver(const int tracks, const AVSampleFormat sampleFormat, const int capacity);
+        ~MonoInterleaver();
+
+    public:
+        // Format the planes are kept in, the preview resampler reads them directly
+        static const AVSampleFormat getPlaneFormat(const AVSampleFormat sampleFormat);
+
+        // Copies a decoded mono frame at the end of its track, samples past the capacity are dropped
+        void append(const int track, const AVFrame* frame);
+
+        // Samples present on every track, once a track is full the others are padded with silence
+        const int getAvailable() const;
+        const uint8_t** getPlanes() const;
+
+        // Interleaves the first count samples of the planes, count is at most getAvailable()
+        uint8_t* interleave(const int count);
+        void consume(const int count);
+        void reset();
+
+        const QString getInstructionSet() const;
+
+    private:
+        typedef void (*InterleaveKernel)(const uint8_t* const planes[], int16_t* dst, const int count);
+
+        int tracks;
+        int capacity;
+        AVSampleFormat planeFormat;
+        int bytesPerSample;
+
+        uint8_t* planes[MONO_INTERLEAVER_CHANNELS];
+        int written[MONO_INTERLEAVER_CHANNELS];
+        int16_t* output;
+
+        InterleaveKernel kernel;
+        QString instructionSet;
+};
+
+#endif // MONOINTERLEAVER_H
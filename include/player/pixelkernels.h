@@ -0,0 +1,56 @@
+#ifndef PIXELKERNELS_H
+#define PIXELKERNELS_H
+
+#include <QMutex>
+#include <QString>
+
+extern "C"
+{
+    #include <libavutil/pixfmt.h>
+}
+
+// Same size planar <-> UYVY conversion, the only arguments used for packed formats are the first plane and stride
+typedef void (*PixelKernel)(const uint8_t* const src[], const int srcStride[], uint8_t* const dst[], const int dstStride[],
+                            const int width, const int height);
+
+// Hand-written SSE2/AVX2 conversions for the formats the playout and the recorder deal with most,
+// yuv422p/yuv420p -> uyvy422 and uyvy422 -> yuv422p at the same size.
+// The instruction set is picked at runtime, every other conversion is left to swscale.
+class PixelKernels
+{
+    public:
+        // Returns NULL when there is no kernel for the conversion.
+        // Interlaced 4:2:0 sources take their chroma lines from the same field
+        static PixelKernel getKernel(const AVPixelFormat srcFormat, const AVPixelFormat dstFormat, const bool interlaced);
+        static const QString getInstructionSet();
+
+        // Times every kernel against swscale on a synthetic frame and logs the results
+        static const QString benchmark(const int width, const int height, const int iterations);
+
+    private:
+        static void init();
+
+        static void yuv422pToUYVY(const uint8_t* const src[], const int srcStride[], uint8_t* const dst[], const int dstStride[],
+                                  const int width, const int height);
+        static void yuv420pToUYVY(const uint8_t* const src[], const int srcStride[], uint8_t* const dst[], const int dstStride[],
+                                  const int width, const int height);
+        static void yuv420pToUYVYInterlaced(const uint8_t* const src[], const int srcStride[], uint8_t* const dst[], const int dstStride[],
+                                            const int width, const int height);
+        static void uyvyToYUV422p(const uint8_t* const src[], const int srcStride[], uint8_t* const dst[], const int dstStride[],
+                                  const int width, const int height);
+
+        static const double benchmarkConversion(const AVPixelFormat srcFormat, const AVPixelFormat dstFormat, const int width, const int height,
+                                                const int iterations, const bool useKernel);
+
+    private:
+        typedef void (*PackRow)(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* dst, const int width);
+        typedef void (*UnpackRow)(const uint8_t* src, uint8_t* y, uint8_t* u, uint8_t* v, const int width);
+
+        static QMutex initMutex;
+        static bool initialized;
+        static QString instructionSet;
+        static PackRow packRow;
+        static UnpackRow unpackRow;
+};
+
+#endif // PIXELKERNELS_H
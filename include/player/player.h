@@ -3,6 +3,9 @@
 
 #include "audiothread.h"
 #include "ffdecoder.h"
+#include "framebus.h"
+#include "framecache.h"
+#include "playoutclock.h"
 #ifdef GUI
 #include "previewerrgb.h"
 #endif
@@ -27,6 +30,18 @@ class Player : public QObject
     // FFMpeg variables
     private:
         FFDecoder* decoder;
+        // Next clip of a back-to-back playout, its frames are held until the on air clip ends on each stream
+        FFDecoder* nextDecoder;
+        FFDecoder* retiredDecoder;
+        QMutex switchMutex;
+        QWaitCondition switchCondition;
+        bool videoSwitched;
+        bool audioSwitched;
+        bool previewSwitched;
+        bool detachingDecoder;
+
+        // Declared ahead of the threads pacing on it
+        PlayoutClock playoutClock;
         AudioThread* audioThread;
 #ifdef PORTAUDIO
         AudioThread* audioThreadPreview;
@@ -38,41 +53,57 @@ class Player : public QObject
         double videoRate;
         QString currentMediaFormat;
         QString currentCG;
+        QString name;
 
     // Vars
     private:
-        QMutex videoMutex;
-        QMutex audioMutex;
-        QList<AVDecodedFrame*> videoFramesList;
-        QList<AVDecodedFrame*> audioSamplesList;
+        FrameQueue videoFrames;
+        FrameQueue audioSamples;
+        FrameBus videoBus;
+        FrameBus audioBus;
+#ifdef PORTAUDIO
+        FrameBus audioPreviewBus;
+#endif
+        FrameCache frameCache;
+        bool stepped;
         bool loop;
         bool loaded;
         PlayingState playing;
+        int bufferDepth;
 #ifdef GUI
         PreviewerRGB* preview;
 #endif
-#ifdef DECKLINK
-        DeckLinkOutput* deckLinkOutput;
-#endif
+        OutputDevice* outputDevice;
 
     // FFMpeg functions
     private:
         const int64_t initFFMpeg(const QString& path);
         void cleanupFFMpeg();
+        void seek(const int64_t pos, const int64_t cacheFrom, const bool cue);
+        void stepFrame(const int64_t pos, const bool backward);
+        const bool waitForSwitch(const int generation, const bool& switched);
+        FFDecoder* switchStream(const int generation, bool& switched, FrameBus& bus);
+        FFDecoder* getDecoder();
+        void dropNextMedia();
+        void stopDecoder(FFDecoder* decoder);
 
     public:
-        const bool pushVideoFrame(AVDecodedFrame* v);
-        const bool pushVideoFramePreview(AVDecodedFrame* vp);
-        const bool pushAudioFrame(AVDecodedFrame* a);
-        const bool pushAudioFrameVU(AVDecodedFrame* aVU);
+        const bool pushVideoFrame(AVDecodedFrame* v, const int generation);
+        const bool pushAudioFrame(AVDecodedFrame* a, const int generation);
+        void cacheVideoFrame(AVDecodedFrame* v);
 #ifdef PORTAUDIO
-        const bool pushAudioFramePreview(AVDecodedFrame* ap);
+        const bool pushAudioFramePreview(AVDecodedFrame* ap, const int generation);
+        const bool hasAudioPreview();
 #endif
-        AVDecodedFrame* getNextVideoFrame();
+        AVDecodedFrame* getNextVideoFrame(bool* endOfStream = NULL);
         AVDecodedFrame* getNextAudioSample();
+        void abortQueues();
+        void resumeQueues();
+        const QString getQueueStatistics() const;
         void setStartMillisecond(const int64_t start_millisecond);
         const int64_t getStartMillisecond() const;
-        void setRecueBuffers(AVDecodedFrame* v, AVDecodedFrame* vp);
+        void setRecueBuffers(AVDecodedFrame* v);
+        void setPreviewFormat(const QString& format, const int width, const int height);
 
     // Player functions
     public:
@@ -80,13 +111,17 @@ class Player : public QObject
         void togglePreviewVideo(PreviewerRGB* previewer);
         void togglePreviewAudio(bool enabled);
 #endif
-#ifdef DECKLINK
-        const QString setDeckLinkOutput(QString inter);
-        const DeckLinkOutput* getDecklinkOutput() const;
-#endif
+        const QString setOutputDevice(QString inter);
+        const OutputDevice* getOutputDevice() const;
+
+        void setName(const QString& name);
+        const QString getName() const;
 
         const int64_t loadMedia(const QString& media_path);
+        const int64_t cueNextMedia(const QString& media_path);
         void waitForDecoding();
+        void setBufferDepth(const int depth);
+        void setCacheSize(const int megabytes);
         void changeFormat(const QString& format);
         void toggleLoop(const bool loop);
 
@@ -0,0 +1,70 @@
+#ifndef PLAYOUTCLOCK_H
+#define PLAYOUTCLOCK_H
+
+#include <stdint.h>
+#include <QMutex>
+#include <QString>
+
+class OutputDevice;
+
+#define TIMING_BUCKETS 8
+// Threads later than this, in microseconds, stalled and pick the timeline up again from now instead of rushing
+#define RESYNC_LATENESS 500000
+
+// Counts of timing samples in microseconds, bucketed from half a millisecond up to 40 milliseconds and beyond
+class TimingHistogram
+{
+    public:
+        TimingHistogram();
+
+    public:
+        void add(const int64_t value);
+        void reset();
+        const QString getStatistics() const;
+
+    private:
+        static const int64_t bucketLimits[TIMING_BUCKETS - 1];
+        int counts[TIMING_BUCKETS];
+        int64_t total;
+        int64_t sum;
+        int64_t max;
+};
+
+enum ClockStream
+{
+    VIDEO_STREAM,
+    AUDIO_STREAM
+};
+
+// Master clock of a port. Time is read from the reference clock of the output device, or the system clock
+// without one, so the preview and VU threads follow the output instead of drifting from it and from each other.
+// Both threads pace themselves from the same epoch and sleep to absolute deadlines on this clock
+class PlayoutClock
+{
+    public:
+        PlayoutClock();
+
+    public:
+        void setSource(OutputDevice* output);
+        // Microseconds on the reference clock
+        const int64_t now();
+        // Starts a new timeline, called when playback starts
+        void start();
+        const int64_t getEpoch() const;
+        // Returns how late the deadline was met in microseconds
+        const int64_t sleepUntil(const int64_t deadline);
+        void recordLateness(const ClockStream stream, const int64_t late);
+        const QString getStatistics();
+
+    private:
+        QMutex mutex;
+        OutputDevice* output;
+        int64_t epoch;
+
+        TimingHistogram lateness[2];
+        TimingHistogram jitter[2];
+        int64_t lastLateness[2];
+        bool hasLateness[2];
+};
+
+#endif // PLAYOUTCLOCK_H
@@ -0,0 +1,260 @@
+#ifndef RINGQUEUE_H
+#define RINGQUEUE_H
+
+#include "avdecodedframe.h"
+
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QString>
+#include <QWaitCondition>
+
+// Bounded single producer / single consumer queue.
+// Items are exchanged through atomic read/write indexes. The consumer and clear(), which may run on any thread,
+// claim an item by moving the read index past it with a compare and swap, so neither takes a lock. The mutex and
+// wait conditions are only touched when the producer has to wait for space or the consumer has to wait for items.
+template <typename T>
+class RingQueue
+{
+    public:
+        explicit RingQueue(const int capacity)
+        {
+            this->capacity = capacity;
+            length = capacity + 1;
+            items = new T[length];
+            for(int i=0; i<length; i++)
+                items[i] = T();
+        }
+
+        ~RingQueue()
+        {
+            delete[] items;
+        }
+
+    public:
+        // Producer side, blocks while the queue is full. Only returns false if the queue was aborted while waiting
+        bool push(const T& item)
+        {
+            int h = head;
+            int next = (h + 1) % length;
+
+            if(next == load(tail) && !waitForSpace(next))
+                return false;
+
+            items[h] = item;
+            head.fetchAndStoreOrdered(next);
+
+            int count = size();
+            if(count > highWaterMark)
+                highWaterMark.fetchAndStoreRelaxed(count);
+
+            if(consumerWaiting)
+            {
+                waitMutex.lock();
+                notEmpty.wakeAll();
+                waitMutex.unlock();
+            }
+
+            return true;
+        }
+
+        // Consumer side, waits up to timeout milliseconds for an item when the queue is empty
+        bool pop(T& item, const int timeout = 0)
+        {
+            bool waited = false;
+            while(true)
+            {
+                int t = load(tail);
+                if(t == load(head))
+                {
+                    if(timeout == 0 || waited || !waitForCount(1, timeout))
+                        return false;
+                    waited = true;
+                    continue;
+                }
+
+                // The producer only writes the slot once the read index moved past it, a concurrent clear
+                // that claimed the item first makes the swap fail
+                T candidate = items[t];
+                if(tail.testAndSetOrdered(t, (t + 1) % length))
+                {
+                    item = candidate;
+                    wakeProducer();
+                    return true;
+                }
+            }
+        }
+
+        bool peek(T& item, const int timeout = 0)
+        {
+            int t = load(tail);
+            if(t == load(head))
+            {
+                if(timeout == 0 || !waitForCount(1, timeout))
+                    return false;
+                t = load(tail);
+            }
+
+            item = items[t];
+
+            return true;
+        }
+
+        // Waits until at least count items are queued or the timeout in milliseconds expires
+        bool waitForCount(const int count, const int timeout)
+        {
+            if(size() >= count)
+                return true;
+
+            QElapsedTimer timer;
+            timer.start();
+
+            waitMutex.lock();
+            consumerWaiting.fetchAndStoreOrdered(1);
+
+            while(size() < count)
+            {
+                int remaining = timeout - (int)timer.elapsed();
+                if(remaining <= 0)
+                    break;
+                notEmpty.wait(&waitMutex, remaining);
+            }
+
+            consumerWaiting.fetchAndStoreOrdered(0);
+            waitMutex.unlock();
+
+            return size() >= count;
+        }
+
+        // Hands every item queued so far to the given function, items pushed meanwhile are kept. Runs on any thread,
+        // the items are claimed one by one against the consumer
+        template <typename F>
+        void clear(F releaseItem)
+        {
+            const int h = load(head);
+
+            int t = load(tail);
+            while(t != h && (h - t + length) % length <= (load(head) - t + length) % length)
+            {
+                T candidate = items[t];
+                if(tail.testAndSetOrdered(t, (t + 1) % length))
+                    releaseItem(candidate);
+                t = load(tail);
+            }
+
+            wakeProducer();
+        }
+
+        // Releases a producer blocked in push, used when the decoder is stopped
+        void abort()
+        {
+            aborted.fetchAndStoreOrdered(1);
+
+            waitMutex.lock();
+            notFull.wakeAll();
+            waitMutex.unlock();
+        }
+
+        void resume()
+        {
+            aborted.fetchAndStoreOrdered(0);
+        }
+
+        const int size() const
+        {
+            return (load(head) - load(tail) + length) % length;
+        }
+
+        const bool isEmpty() const
+        {
+            return size() == 0;
+        }
+
+        const int getCapacity() const
+        {
+            return capacity;
+        }
+
+        const int getHighWaterMark() const
+        {
+            return highWaterMark;
+        }
+
+        const int getWaitCount() const
+        {
+            return waitCount;
+        }
+
+        const int getWaitTime() const
+        {
+            return waitTime;
+        }
+
+        const QString getStatistics() const
+        {
+            return QString::number(size()) + "/" + QString::number(capacity)
+                    + " high water: " + QString::number(getHighWaterMark())
+                    + " waits: " + QString::number(getWaitCount())
+                    + " wait time: " + QString::number(getWaitTime()) + " ms";
+        }
+
+    private:
+        static int load(const QAtomicInt& value)
+        {
+            return const_cast<QAtomicInt&>(value).fetchAndAddAcquire(0);
+        }
+
+        bool waitForSpace(const int next)
+        {
+            QElapsedTimer timer;
+            timer.start();
+
+            waitMutex.lock();
+            producerWaiting.fetchAndStoreOrdered(1);
+
+            while(next == load(tail) && !aborted)
+                notFull.wait(&waitMutex, 100);
+
+            producerWaiting.fetchAndStoreOrdered(0);
+            bool hasSpace = next != load(tail);
+            waitMutex.unlock();
+
+            waitCount.ref();
+            waitTime.fetchAndAddRelaxed((int)timer.elapsed());
+
+            return hasSpace;
+        }
+
+        void wakeProducer()
+        {
+            if(producerWaiting)
+            {
+                waitMutex.lock();
+                notFull.wakeAll();
+                waitMutex.unlock();
+            }
+        }
+
+    private:
+        T* items;
+        int capacity;
+        int length;
+
+        QAtomicInt head;
+        QAtomicInt tail;
+        QAtomicInt aborted;
+        QAtomicInt producerWaiting;
+        QAtomicInt consumerWaiting;
+
+        QMutex waitMutex;
+        QWaitCondition notFull;
+        QWaitCondition notEmpty;
+
+        QAtomicInt highWaterMark;
+        QAtomicInt waitCount;
+        QAtomicInt waitTime;
+};
+
+typedef RingQueue<AVDecodedFrame*> FrameQueue;
+
+#endif // RINGQUEUE_H
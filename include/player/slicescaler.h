@@ -0,0 +1,64 @@
+#ifndef SLICESCALER_H
+#define SLICESCALER_H
+
+#include <QList>
+#include <QMutex>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThreadPool>
+
+extern "C"
+{
+    #include <libswscale/swscale.h>
+}
+
+class SliceJob;
+
+// Splits a frame conversion into horizontal bands converted in parallel, each band with its own SwsContext
+// or, for same size conversions PixelKernels handles, with the hand-written kernel.
+// Interlaced frames are converted field by field so chroma is never interpolated across fields.
+class SliceScaler
+{
+    public:
+        SliceScaler();
+        ~SliceScaler();
+
+    public:
+        const bool init(const int srcWidth, const int srcHeight, const AVPixelFormat srcFormat,
+                        const int dstWidth, const int dstHeight, const AVPixelFormat dstFormat,
+                        const int flags, const bool interlaced);
+        void scale(const uint8_t* const src[], const int srcStride[], uint8_t* const dst[], const int dstStride[]);
+        void cleanup();
+
+        void setSliceCount(const int sliceCount);
+        const int getSliceCount() const;
+        const int getJobCount() const;
+
+        static QThreadPool* getThreadPool();
+        static void destroy();
+
+    private:
+        const bool createJobs();
+        void deleteJobs();
+
+    private:
+        static QMutex poolMutex;
+        static QThreadPool* threadPool;
+
+        QMutex mutex;
+        QList<SliceJob*> jobs;
+        QSemaphore done;
+
+        int srcWidth;
+        int srcHeight;
+        AVPixelFormat srcFormat;
+        int dstWidth;
+        int dstHeight;
+        AVPixelFormat dstFormat;
+        int flags;
+        bool interlaced;
+        int sliceCount;
+        bool changed;
+};
+
+#endif // SLICESCALER_H
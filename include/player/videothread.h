@@ -1,17 +1,25 @@
 #ifndef VIDEOTHREAD_H
 #define VIDEOTHREAD_H
 
-#include "avdecodedframe.h"
+#include "playoutclock.h"
+#include "ringqueue.h"
 
 #include <QMutex>
 #include <QThread>
 
+#ifdef GUI
+extern "C"
+{
+    #include <libswscale/swscale.h>
+}
+#endif
+
 class VideoThread : public QThread
 {
     Q_OBJECT
 
     public:
-        explicit VideoThread(QObject* parent = 0);
+        explicit VideoThread(PlayoutClock* clock, QObject* parent = 0);
         ~VideoThread();
 
     public:
@@ -20,19 +28,41 @@ class VideoThread : public QThread
         void stopPlaying();
         void cleanup(const int64_t pos);
 
-        const bool pushVideoFrame(AVDecodedFrame* vp);
+        FrameQueue* getQueue();
         const int64_t getCurrentPlayTime() const;
 
+        void setPreview(const bool preview);
+        void changeFormat(const QString& format, const int width, const int height);
+        const QByteArray renderPreview(AVDecodedFrame* v);
+
     private:
         bool playing;
         bool loop;
         bool preview;
         int64_t video_clock;
+        PlayoutClock* clock;
         QMutex videoMutex;
-        QList<AVDecodedFrame*> previewFramesList;
+        FrameQueue videoFrames;
+
+#ifdef GUI
+        // Preview variables, the RGBA conversion only runs while a previewer is attached
+        QMutex previewMutex;
+        SwsContext* swsContextPreview;
+        AVFrame* framePreview;
+        int sourceWidth;
+        int sourceHeight;
+        int previewWidth;
+        int previewHeight;
+        int previewOffset;
+        int previewFrameSize;
+        bool previewChanged;
+#endif
 
     private:
         void run();
+#ifdef GUI
+        void cleanupPreview();
+#endif
 
     signals:
         void previewVideo(const QByteArray& videoBuffer);
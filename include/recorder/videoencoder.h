@@ -2,6 +2,7 @@
 #define VIDEOENCODER_H
 
 #include "avdecodedframe.h"
+#include "pixelkernels.h"
 
 #include <QString>
 
@@ -37,6 +38,7 @@ class VideoEncoder
         AVFrame* frame;
         AVFrame* tmpFrame;
         SwsContext* swsContext;
+        PixelKernel kernel;
 
         int frameSize;
 
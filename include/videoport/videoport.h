@@ -6,7 +6,7 @@
 class VideoPort
 {
     public:
-        VideoPort(const int num);
+        VideoPort(const int num, const int output);
         ~VideoPort();
 
     public:
@@ -16,7 +16,10 @@ class VideoPort
         int num;
         QString debugName;
         PortState state;
-        DeckLinkInput* input;
+        int output;
+        int bufferDepth;
+        int cacheSize;
+        InputDevice* input;
 
         Player* player;
 
@@ -24,6 +27,9 @@ class VideoPort
     public:
         const int activatePlayout();
         const int deactivatePlayout();
+        const int setBufferDepth(const int depth);
+        const int setLowLatency(const bool enabled);
+        const int setCacheSize(const int megabytes);
 
     // Playout functions
     public:
@@ -31,6 +37,8 @@ class VideoPort
         const int changeFormat(const QString& format) const;
         const int64_t getCurrentPlayTime() const;
         const int64_t getCurrentTimeCode() const;
+        const int getAudioBufferLevel() const;
+        const int getAudioUnderruns() const;
 
         const int recue(const bool loop) const;
         const int take() const;
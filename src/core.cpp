@@ -1,4 +1,8 @@
 #include "core.h"
+#include "decoderstage.h"
+#include "framepool.h"
+#include "pixelkernels.h"
+#include "slicescaler.h"
 
 #include <QDateTime>
 #include <QDir>
@@ -68,6 +72,12 @@ Core::~Core()
     while(!videoPortList.isEmpty())
         delete videoPortList.takeFirst();
 
+    DeviceControl::destroy();
+
+    SliceScaler::destroy();
+    StageItem::destroy();
+    FramePool::destroy();
+
     file->close();
 	//avformat_network_deinit();
     delete file;
@@ -76,22 +86,39 @@ Core::~Core()
 
 void Core::initChannels()
 {
-    if(DeckLinkControl::init())
+    if(DeviceControl::init())
     {
         // Initialize the devices list
-        QStringList inputList = DeckLinkControl::getInputList();
-        QStringList outputList = DeckLinkControl::getOutputList();
+        QStringList inputList = DeviceControl::getInputList();
+        QStringList outputList = DeviceControl::getOutputList();
         if(inputList.size() == outputList.size())
         {
             for(int i=0; i<inputList.size(); i++)
             {
-                VideoPort* vp = new VideoPort(i+1);
+                VideoPort* vp = new VideoPort(i+1, i+1);
                 videoPortList.append(vp);
             }
         }
     }
 }
 
+// Ports without a card, for soak tests and benchmarks. Each port gets its own virtual output
+const int Core::addVirtualPorts(const int count, const QString& dumpPath, const bool realtime)
+{
+    for(int i=0; i<count; i++)
+    {
+        int port = videoPortList.size() + 1;
+        int output = DeviceControl::addVirtualOutput("Virtual " + QString::number(port), dumpPath, realtime);
+
+        VideoPort* vp = new VideoPort(port, output);
+        videoPortList.append(vp);
+    }
+
+    qDebug() << "Added virtual ports: " + QString::number(count);
+
+    return videoPortList.size();
+}
+
 // VideoPort functions
 
 const int Core::getVideoPortCount() const
@@ -125,6 +152,33 @@ const int Core::deactivatePlayout(const int port) const
     return -1;
 }
 
+const int Core::setBufferDepth(const int port, const int depth) const
+{
+    VideoPort* videoPort = getVideoPort(port);
+    if(videoPort != NULL)
+        return videoPort->setBufferDepth(depth);
+
+    return -1;
+}
+
+const int Core::setLowLatency(const int port, const bool enabled) const
+{
+    VideoPort* videoPort = getVideoPort(port);
+    if(videoPort != NULL)
+        return videoPort->setLowLatency(enabled);
+
+    return -1;
+}
+
+const int Core::setCacheSize(const int port, const int megabytes) const
+{
+    VideoPort* videoPort = getVideoPort(port);
+    if(videoPort != NULL)
+        return videoPort->setCacheSize(megabytes);
+
+    return -1;
+}
+
 // Playout functions
 
 const int64_t Core::loadPortItem(const int port, const QString& path, const bool canTake) const
@@ -163,6 +217,24 @@ const int64_t Core::getCurrentTimeCode(const int port) const
     return -1;
 }
 
+const int Core::getAudioBufferLevel(const int port) const
+{
+    VideoPort* videoPort = getVideoPort(port);
+    if(videoPort != NULL)
+        return videoPort->getAudioBufferLevel();
+
+    return -1;
+}
+
+const int Core::getAudioUnderruns(const int port) const
+{
+    VideoPort* videoPort = getVideoPort(port);
+    if(videoPort != NULL)
+        return videoPort->getAudioUnderruns();
+
+    return -1;
+}
+
 const int Core::recue(const int port, const bool loop) const
 {
     VideoPort* videoPort = getVideoPort(port);
@@ -243,3 +315,8 @@ const double Core::reverse(const int port) const
 
     return -1;
 }
+
+void Core::benchmarkConversions(const int width, const int height, const int iterations) const
+{
+    PixelKernels::benchmark(width, height, iterations);
+}
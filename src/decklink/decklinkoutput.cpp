@@ -1,8 +1,6 @@
 #include "decklinkoutput.h"
-#include "player.h"
 
-#include <QDataStream>
-#include <QFile>
+#include <QMutexLocker>
 
 #include <comutil.h>
 
@@ -10,6 +8,9 @@
 
 using namespace log4cxx;
 
+// Frames of the ring beyond the buffer depth, for the preview and the frames completing while the next one is scheduled
+#define SPARE_OUTPUT_FRAMES 3
+
 // List of known pixel formats and their matching display names
 const BMDPixelFormat knownPixelFormats[] = { bmdFormat8BitYUV, bmdFormat10BitYUV, bmdFormat8BitARGB, bmdFormat8BitBGRA, bmdFormat10BitRGB, (BMDPixelFormat)0 };
 const char* knownPixelFormatNames[]	= { "8-bit YUV", "10-bit YUV", "8-bit ARGB", "8-bit BGRA", "10-bit RGB", NULL };
@@ -21,31 +22,14 @@ DeckLinkOutput::DeckLinkOutput(IDeckLink* deckLinkDevice)
     _bstr_t deviceName(deviceNameBSTR, false);
     this->deviceName.append(deviceName);
     this->setDisplayMode = bmdModePAL;
-    filename = "";
 
     // ** List the video output display modes supported by the card
     //print_output_modes(deckLinkDevice);
 
-    width = 720;
-    height = 576;
-    rowBytes = width * 2;
-    frameSize = width * rowBytes;
-    vancRows = 32;
-    videoOffset = vancRows * rowBytes;
-    canPreview = true;
-    startFrame = 0;
-    ratio = 25.0 / 1000;
-    totalFrames = 0;
-    prerollCount = 0;
-    endFrame = 0;
-    totalAudioSamples = 0;
-    playing = false;
-
-    sampleRate = bmdAudioSampleRate48kHz;
     sampleType = bmdAudioSampleType16bitInteger;
-    channelCount = 8;
     streamType = bmdAudioOutputStreamTimestamped;
     pixelFormat = bmdFormat8BitYUV;
+    callbacks = false;
 
     deckLinkDevice->QueryInterface(IID_IDeckLinkOutput, (void**)&outputCard);
 }
@@ -64,6 +48,18 @@ bool DeckLinkOutput::isInitialized()
     return outputCard != NULL;
 }
 
+// The hardware reference clock keeps running while the output is idle, it paces the frames on the output
+const int64_t DeckLinkOutput::getReferenceTime()
+{
+    BMDTimeValue hardwareTime;
+    BMDTimeValue timeInFrame;
+    BMDTimeValue ticksPerFrame;
+    if(outputCard->GetHardwareReferenceClock(1000000, &hardwareTime, &timeInFrame, &ticksPerFrame) != S_OK)
+        return OutputDevice::getReferenceTime();
+
+    return hardwareTime;
+}
+
 void DeckLinkOutput::print_output_modes(IDeckLink* deckLink)
 {
     IDeckLinkOutput*					deckLinkOutput = NULL;
@@ -139,11 +135,24 @@ bail:
         deckLinkOutput->Release();
 }
 
-bool DeckLinkOutput::enableCard()
+bool DeckLinkOutput::enableOutput(const QString& format)
 {
     BMDDisplayModeSupport displayModeSupport;
     IDeckLinkDisplayMode* displayMode;
 
+    if(format == "PAL" || format == "PAL 16:9")
+        setDisplayMode = bmdModePAL;
+    else if(format == "720p50")
+        setDisplayMode = bmdModeHD720p50;
+    else if(format == "720p5994")
+        setDisplayMode = bmdModeHD720p5994;
+    else if(format == "1080p25")
+        setDisplayMode = bmdModeHD1080p25;
+    else if(format == "1080i50")
+        setDisplayMode = bmdModeHD1080i50;
+    else if(format == "1080i5994")
+        setDisplayMode = bmdModeHD1080i5994;
+
     // FIXME: Issue with Decklink Duo 2
     // Add flag to setOutputFlag for testing | bmdVideoOutputVANC);
     BMDVideoOutputFlags setOutputFlag = (BMDVideoOutputFlags)(bmdVideoOutputFlagDefault | bmdVideoOutputVITC);
@@ -152,25 +161,22 @@ bool DeckLinkOutput::enableCard()
 
     if (displayModeSupport != bmdDisplayModeNotSupported)
     {
-        outputCard->EnableAudioOutput(sampleRate, sampleType, channelCount, streamType);
+        outputCard->EnableAudioOutput(bmdAudioSampleRate48kHz, sampleType, channelCount, streamType);
         outputCard->EnableVideoOutput(setDisplayMode, setOutputFlag);
 
         width = displayMode->GetWidth();
         height = displayMode->GetHeight();
         rowBytes = width * 2;
-        frameSize = height * rowBytes;
-        displayMode->GetFrameRate(&frameDuration, &frameTimescale);
-        originalFrameDuration = frameDisplayTime = frameDuration;
-        canPreview = true;
-        startFrame = 0;
-        ratio = 25.0 / 1000;
-        totalFrames = 0;
-        prerollCount = 0;
-        endFrame = 0;
-        playing = false;
-        totalAudioSamples = 0;
-
-        this->loadBars();
+
+        BMDTimeValue duration;
+        BMDTimeScale timescale;
+        displayMode->GetFrameRate(&duration, &timescale);
+        frameDuration = duration;
+        frameTimescale = timescale;
+
+        // Frames are reported back even without a player attached, so they can be recycled
+        outputCard->SetScheduledFrameCompletionCallback(this);
+        allocateFrames();
 
         return true;
     }
@@ -178,25 +184,7 @@ bool DeckLinkOutput::enableCard()
     return false;
 }
 
-void DeckLinkOutput::loadBars()
-{
-    if(filename != "")
-    {
-        char* arr = new char[frameSize];
-
-        QFile file(filename);
-        if(file.open(QIODevice::ReadWrite))
-        {
-            QDataStream stream(&file);
-            stream.readRawData(arr, frameSize);
-        }
-
-        this->outputVideo((uint8_t*)arr, frameSize, true, 0);
-        delete[] arr;
-    }
-}
-
-void DeckLinkOutput::disableCard()
+void DeckLinkOutput::disableOutput()
 {
     BOOL active;
     outputCard->IsScheduledPlaybackRunning(&active);
@@ -205,337 +193,266 @@ void DeckLinkOutput::disableCard()
 
     outputCard->DisableVideoOutput();
     outputCard->DisableAudioOutput();
+    outputCard->SetScheduledFrameCompletionCallback(NULL);
+
+    releaseFrames();
 }
 
-const QString DeckLinkOutput::getDeviceName() const
+void DeckLinkOutput::setCallbacks(const bool enabled)
 {
-    return deviceName;
+    callbacks = enabled;
+    outputCard->SetAudioCallback(enabled ? this : NULL);
 }
 
-const bool DeckLinkOutput::changeFormat(const QString& format)
+// The ring covers the buffer depth, it is resized when the depth changes while the format is enabled
+void DeckLinkOutput::allocateFrames()
 {
-    if(!filename.contains(format))
-    {
-        disableCard();
-        filename = "bars/" + format + ".yuv";
+    releaseFrames();
 
-        if(format == "PAL" || format == "PAL 16:9")
-        {
-            filename = "bars/PAL.yuv";
-            setDisplayMode = bmdModePAL;
-        }
-        else if(format == "720p50")
-            setDisplayMode = bmdModeHD720p50;
-        else if(format == "720p5994")
-            setDisplayMode = bmdModeHD720p5994;
-        else if(format == "1080p25")
-            setDisplayMode = bmdModeHD1080p25;
-        else if(format == "1080i50")
-            setDisplayMode = bmdModeHD1080i50;
-        else if(format == "1080i5994")
-            setDisplayMode = bmdModeHD1080i5994;
-
-        bool success = enableCard();
-
-        if(format == "PAL" || format == "PAL 16:9")
-        {
-            vancRows = 32;
-            videoOffset = vancRows * rowBytes;
-        }
-        else // TODO: VANC for HD resolutions
+    QMutexLocker locker(&frameMutex);
+    resizeFrames();
+}
+
+void DeckLinkOutput::bufferDepthChanged()
+{
+    QMutexLocker locker(&frameMutex);
+
+    // Without a format the ring is allocated when the output is enabled
+    if(!outputFrames.isEmpty())
+        resizeFrames();
+}
+
+// Called with the frame mutex held. Surplus frames the card still holds are released once it reports them back
+void DeckLinkOutput::resizeFrames()
+{
+    const int size = bufferDepth + SPARE_OUTPUT_FRAMES;
+
+    while(outputFrames.size() < size)
+    {
+        IDeckLinkMutableVideoFrame* frame;
+        if(outputCard->CreateVideoFrame(width, height, rowBytes, pixelFormat, bmdFrameFlagDefault, &frame) != S_OK)
         {
-            vancRows = 0;
-            videoOffset = 0;
+            LOG4CXX_ERROR(Logger::getLogger("DeckLinkOutput"), "Could not allocate output frame " + QString::number(outputFrames.size()).toStdString());
+            break;
         }
 
-        return success;
+        outputFrames.append(frame);
+        freeFrames.append(frame);
     }
 
-    return true;
+    while(outputFrames.size() > size && !freeFrames.isEmpty())
+    {
+        IDeckLinkMutableVideoFrame* frame = freeFrames.takeLast();
+        outputFrames.removeOne(frame);
+        frame->Release();
+    }
 }
 
-void DeckLinkOutput::setRate(const double rate)
+// Called once the card returned all frames, frames still held by it are freed when it lets them go
+void DeckLinkOutput::releaseFrames()
 {
-    frameDisplayTime = frameDuration / rate;
-    ratio = 25.0 * rate / 1000;
-}
+    QMutexLocker locker(&frameMutex);
 
-void DeckLinkOutput::setStartFrame(const int64_t start_frame)
-{
-    startFrame = start_frame;
+    for(int i=0; i<outputFrames.size(); i++)
+        outputFrames.at(i)->Release();
+    outputFrames.clear();
+    freeFrames.clear();
 }
 
-void DeckLinkOutput::adjustFPS(const double adjust)
+// Takes the next free frame of the ring and fills it with the picture and its VITC, NULL if the card holds all of them
+IDeckLinkMutableVideoFrame* DeckLinkOutput::fillFrame(const uint8_t* frame, const int64_t timecode)
 {
-    frameDuration = originalFrameDuration / adjust;
-    frameDisplayTime = frameDuration;
-}
+    IDeckLinkMutableVideoFrame*	pDLVideoFrame = NULL;
+    void* pFrame;
 
-void DeckLinkOutput::startPlayback(Player* player)
-{
-    while(playing)
+    frameMutex.lock();
+    if(!freeFrames.isEmpty())
+        pDLVideoFrame = freeFrames.takeFirst();
+    frameMutex.unlock();
+
+    if(pDLVideoFrame == NULL)
     {
-        Sleep(1);
+        LOG4CXX_WARN(Logger::getLogger("DeckLinkOutput"), "No free output frame, the card holds all " + QString::number(outputFrames.size()).toStdString());
+        return NULL;
     }
 
-    totalFrames = 0;
-    prerollCount = 0;
-    endFrame = 0;
-    playing = false;
-    totalAudioSamples = 0;
-    canPreview = false;
-    this->player = player;
+    pDLVideoFrame->GetBytes((void**)&pFrame);
+    memcpy(pFrame, frame, frameSize);
 
-    if(player != NULL)
+    // TODO: check this with decklink duo 2, the VANC lines are right above the picture
+    /*IDeckLinkVideoFrameAncillary* vanc;
+    if(vancRows > 0 && outputCard->CreateAncillaryData(pixelFormat, &vanc) == S_OK && vanc != NULL)
     {
-        outputCard->SetScheduledFrameCompletionCallback(this);
-        outputCard->SetAudioCallback(this);
-
-        int count = 0;
-        for(int i=0; i<10; i++)
+        BMDDisplayMode vancDisplayMode = vanc->GetDisplayMode();
+        LOG4CXX_ERROR(Logger::getLogger("DeckLinkOutput"), "create vanc:" + vancDisplayMode);
+        for(int i=0; i<vancRows; i++)
         {
-            AVDecodedFrame* v = NULL;
-            do
-            {
-                v = player->getNextVideoFrame();
-
-                // Ensures there is no deadlock if the file is too small
-                if(count++ > 100)
-                    break;
-            }
-            while(v == NULL);
-
-            if(v != NULL)
+            void* buffer;
+            if(vanc->GetBufferForVerticalBlankingLine(i+1, &buffer) == S_OK && buffer)
             {
-                this->outputVideo(v->getBuffer(), v->getSize(), false, startFrame + v->getClockPTS() * ratio);
-                delete v;
+                memcpy(buffer, frame - videoOffset + i * rowBytes, rowBytes);
+                LOG4CXX_ERROR(Logger::getLogger("DeckLinkOutput"), "vanc buffer:" + i * rowBytes);
             }
         }
 
-        outputCard->BeginAudioPreroll();
-    }
-    else
-    {
-        outputCard->SetScheduledFrameCompletionCallback(NULL);
-        outputCard->SetAudioCallback(NULL);
+        pDLVideoFrame->SetAncillaryData(vanc);
+        vanc->Release();
+        LOG4CXX_ERROR(Logger::getLogger("DeckLinkOutput"), "done vanc");
+    }*/
 
-        outputCard->StartScheduledPlayback(0, frameTimescale, 1.0);
-        playing = true;
-    }
+    int64_t frames = timecode;
+    unsigned char fr = frames % 25;
+    frames /= 25;
+    unsigned char sec = frames % 60;
+    frames /= 60;
+    unsigned char min = frames % 60;
+    frames /= 60;
+    unsigned char hr = frames;
+
+    pDLVideoFrame->SetTimecodeFromComponents(bmdTimecodeVITC, hr, min, sec, fr, bmdTimecodeFlagDefault);
+
+    return pDLVideoFrame;
 }
 
-void DeckLinkOutput::stopPlayback(const bool immediate)
+void DeckLinkOutput::recycleFrame(IDeckLinkVideoFrame* frame)
 {
-    if(immediate)
-    {
-        LOG4CXX_DEBUG(Logger::getLogger("DeckLinkOutput"), "Immediate stop playback");
+    QMutexLocker locker(&frameMutex);
 
-        outputCard->StopScheduledPlayback(0, NULL, 0);
-        totalFrames = 0;
-        prerollCount = 0;
-        endFrame = 0;
-        totalAudioSamples = 0;
-        canPreview = true;
-        playing = false;
-    }
-    else
+    for(int i=0; i<outputFrames.size(); i++)
     {
-        if(endFrame > 0 && totalFrames > endFrame)
+        if(outputFrames.at(i) == frame)
         {
-            LOG4CXX_DEBUG(Logger::getLogger("DeckLinkOutput"), "Stopping playback at frame: " + QString::number(endFrame-1).toStdString());
-            outputCard->StopScheduledPlayback((endFrame-1) * frameDisplayTime, NULL, frameTimescale);
-        }
-        else
-        {
-            LOG4CXX_DEBUG(Logger::getLogger("DeckLinkOutput"), "Stopping playback at frame: " + QString::number(totalFrames-1).toStdString());
-            outputCard->StopScheduledPlayback((totalFrames-1) * frameDisplayTime, NULL, frameTimescale);
+            // The depth was lowered while the card held the frame
+            if(outputFrames.size() > bufferDepth + SPARE_OUTPUT_FRAMES)
+            {
+                outputFrames.at(i)->Release();
+                outputFrames.removeAt(i);
+            }
+            else freeFrames.append(outputFrames.at(i));
+            break;
         }
     }
 }
 
-void DeckLinkOutput::outputVideo(const uint8_t* videoBuffer, const int size, const bool preview, const int64_t timecode)
+bool DeckLinkOutput::displayFrame(const uint8_t* frame, const int64_t timecode)
 {
-    IDeckLinkMutableVideoFrame*	pDLVideoFrame;
-    void* pFrame;
+    IDeckLinkMutableVideoFrame* pDLVideoFrame = fillFrame(frame, timecode);
+    if(pDLVideoFrame == NULL)
+        return false;
 
-    HRESULT res = outputCard->CreateVideoFrame(width, height, rowBytes, pixelFormat, bmdFrameFlagDefault, &pDLVideoFrame);
-    if(res == S_OK)
-    {
-        pDLVideoFrame->GetBytes((void**)&pFrame);
+    // The card is done with the frame once the call returns
+    HRESULT res = outputCard->DisplayVideoFrameSync(pDLVideoFrame);
+    recycleFrame(pDLVideoFrame);
 
-        if(size > frameSize)
-        {
-            memcpy(pFrame, videoBuffer + videoOffset, frameSize);
-            // TODO: check this with decklink duo 2
-            /*IDeckLinkVideoFrameAncillary* vanc;
-            if(outputCard->CreateAncillaryData(pixelFormat, &vanc) == S_OK && vanc != NULL)
-            {
-                BMDDisplayMode vancDisplayMode = vanc->GetDisplayMode();
-                LOG4CXX_ERROR(Logger::getLogger("DeckLinkOutput"), "create vanc:" + vancDisplayMode);
-                for(int i=0; i<vancRows; i++)
-                {
-                    void* buffer;
-                    if(vanc->GetBufferForVerticalBlankingLine(i+1, &buffer) == S_OK && buffer)
-                    {
-                        memcpy(buffer, videoBuffer + i * rowBytes, rowBytes);
-                        LOG4CXX_ERROR(Logger::getLogger("DeckLinkOutput"), "vanc buffer:" + i * rowBytes);
-                    }
-                }
+    return res == S_OK;
+}
 
-                pDLVideoFrame->SetAncillaryData(vanc);
-                vanc->Release();
-                LOG4CXX_ERROR(Logger::getLogger("DeckLinkOutput"), "done vanc");
-            }*/
-        }
-        else memcpy(pFrame, videoBuffer, frameSize);
+bool DeckLinkOutput::scheduleFrame(const uint8_t* frame, const int64_t timecode, const int64_t displayTime, const int64_t duration)
+{
+    IDeckLinkMutableVideoFrame* pDLVideoFrame = fillFrame(frame, timecode);
+    if(pDLVideoFrame == NULL)
+        return false;
 
-        int64_t frames = timecode;
-        unsigned char fr = frames % 25;
-        frames /= 25;
-        unsigned char sec = frames % 60;
-        frames /= 60;
-        unsigned char min = frames % 60;
-        frames /= 60;
-        unsigned char hr = frames;
+    // Goes back to the ring in ScheduledFrameCompleted
+    HRESULT res = outputCard->ScheduleVideoFrame(pDLVideoFrame, displayTime, duration, frameTimescale);
+    if(res != S_OK)
+    {
+        LOG4CXX_ERROR(Logger::getLogger("DeckLinkOutput"), "Error scheduling video frame: " + QString::number(res).toStdString());
+        recycleFrame(pDLVideoFrame);
+    }
 
-        pDLVideoFrame->SetTimecodeFromComponents(bmdTimecodeVITC, hr, min, sec, fr, bmdTimecodeFlagDefault);
+    return res == S_OK;
+}
 
-        if(preview)
-        {
-            if(canPreview)
-                outputCard->DisplayVideoFrameSync(pDLVideoFrame);
-        }
-        else
-        {
-            res = outputCard->ScheduleVideoFrame(pDLVideoFrame, totalFrames * frameDisplayTime, frameDisplayTime, frameTimescale);
-            if(res == S_OK)
-                totalFrames++;
-            else LOG4CXX_ERROR(Logger::getLogger("DeckLinkOutput"), "Error scheduling video frame: " + QString::number(res).toStdString());
-        }
+const int DeckLinkOutput::scheduleAudio(const uint8_t* samples, const int count, const int64_t streamTime)
+{
+    unsigned int written = 0;
+    HRESULT res = outputCard->ScheduleAudioSamples((void*)samples, count, streamTime, bmdAudioSampleRate48kHz, &written);
+    if(res != S_OK)
+    {
+        LOG4CXX_ERROR(Logger::getLogger("DeckLinkOutput"), "Error scheduling audio samples: " + QString::number(res).toStdString());
+        return -1;
+    }
 
-        pDLVideoFrame->Release();
+    return written;
+}
 
-        BMDReferenceStatus referenceStatus;
-        res = outputCard->GetReferenceStatus(&referenceStatus);
-        if(referenceStatus != bmdReferenceLocked && referenceStatus != bmdReferenceNotSupportedByHardware)
-            emit genlockError();
-    }
+const uint32_t DeckLinkOutput::getBufferedAudioSamples()
+{
+    uint32_t bufferedSampleFrameCount = 0;
+    outputCard->GetBufferedAudioSampleFrameCount(&bufferedSampleFrameCount);
+
+    return bufferedSampleFrameCount;
 }
 
-void DeckLinkOutput::outputAudio(const uint8_t* audioBuffer, const int size)
+void DeckLinkOutput::beginAudioPreroll()
 {
-    // Divide audio buffer size by 2*channels
-    int sample_size = size / 16;
+    outputCard->BeginAudioPreroll();
+}
+
+void DeckLinkOutput::endAudioPreroll()
+{
+    outputCard->EndAudioPreroll();
+}
 
-    // Check for playback active if in bridge mode
+const bool DeckLinkOutput::isPlaybackRunning()
+{
     BOOL active;
     outputCard->IsScheduledPlaybackRunning(&active);
-    if(!active && prerollCount == 0)
-        outputCard->StartScheduledPlayback(0, frameTimescale, 1.0);
 
-    HRESULT res = outputCard->ScheduleAudioSamples((void*)audioBuffer, sample_size, totalAudioSamples, sampleRate, NULL);
+    return active;
+}
 
-    if(res == S_OK)
-        totalAudioSamples += sample_size;
-    else LOG4CXX_ERROR(Logger::getLogger("DeckLinkOutput"), "Error scheduling audio samples: " + QString::number(res).toStdString());
+void DeckLinkOutput::startScheduledPlayback()
+{
+    outputCard->StartScheduledPlayback(0, frameTimescale, 1.0);
 }
 
-HRESULT STDMETHODCALLTYPE DeckLinkOutput::ScheduledFrameCompleted(IDeckLinkVideoFrame*, BMDOutputFrameCompletionResult result)
+void DeckLinkOutput::stopScheduledPlayback(const bool immediate, const int64_t stopTime)
 {
-    if(playing)
-    {
-        if(result == bmdOutputFrameDisplayedLate)
-        {
-            LOG4CXX_WARN(Logger::getLogger("DeckLinkOutput"), "Frame displayed late");
-            totalFrames += 1;
-        }
-        else if(result == bmdOutputFrameDropped)
-        {
-            LOG4CXX_WARN(Logger::getLogger("DeckLinkOutput"), "Dropped frame");
-        }
-        else if(result == bmdOutputFrameFlushed)
-             LOG4CXX_WARN(Logger::getLogger("DeckLinkOutput"), "Flushed frame");
+    if(immediate)
+        outputCard->StopScheduledPlayback(0, NULL, 0);
+    else outputCard->StopScheduledPlayback(stopTime, NULL, frameTimescale);
+}
 
-        int count = 0;
-        AVDecodedFrame* v = NULL;
-        do
-        {
-            v = player->getNextVideoFrame();
+const bool DeckLinkOutput::isReferenceLocked()
+{
+    BMDReferenceStatus referenceStatus;
+    outputCard->GetReferenceStatus(&referenceStatus);
 
-            if(v == NULL) // Check for end of file
-            {
-                LOG4CXX_DEBUG(Logger::getLogger("DeckLinkOutput"), "Reached EOF");
-                endFrame = totalFrames;
-            }
-            // Ensures there is no deadlock
-            if(count++ > 10)
-                break;
-        }
-        while(v == NULL);
+    return referenceStatus == bmdReferenceLocked || referenceStatus == bmdReferenceNotSupportedByHardware;
+}
 
-        if(v != NULL)
-        {
-            this->outputVideo(v->getBuffer(), v->getSize(), false, startFrame + v->getClockPTS() * ratio);
-            delete v;
-        }
-    }
+HRESULT STDMETHODCALLTYPE DeckLinkOutput::ScheduledFrameCompleted(IDeckLinkVideoFrame* completed_frame, BMDOutputFrameCompletionResult result)
+{
+    recycleFrame(completed_frame);
+
+    if(!callbacks)
+        return S_OK;
+
+    FrameCompletion completion = FRAME_COMPLETED;
+    if(result == bmdOutputFrameDisplayedLate)
+        completion = FRAME_DISPLAYED_LATE;
+    else if(result == bmdOutputFrameDropped)
+        completion = FRAME_DROPPED;
+    else if(result == bmdOutputFrameFlushed)
+        completion = FRAME_FLUSHED;
+
+    frameCompleted(completion);
 
     return S_OK;
 }
 
 HRESULT STDMETHODCALLTYPE DeckLinkOutput::RenderAudioSamples(BOOL preroll)
 {
-    if(preroll && prerollCount++ > 20)
-    {
-        outputCard->EndAudioPreroll();
-        outputCard->StartScheduledPlayback(0, frameTimescale, 1.0);
-        playing = true;
-        LOG4CXX_DEBUG(Logger::getLogger("DeckLinkOutput"), "Playback started");
-    }
-    else
-    {
-        if(playing || preroll)
-        {
-            // Check the count of buffered audio samples and only schedule if below waterlevel
-            uint32_t bufferedSampleFrameCount;
-            outputCard->GetBufferedAudioSampleFrameCount(&bufferedSampleFrameCount);
-
-            if(bufferedSampleFrameCount < (uint32_t)sampleRate)
-            {
-                int count = 0;
-                AVDecodedFrame* a = NULL;
-                do
-                {
-                    a = player->getNextAudioSample();
-
-                    // Ensures there is no deadlock
-                    if(count++ > 10)
-                        break;
-                }
-                while(a == NULL);
-
-                if(a != NULL)
-                {
-                    this->outputAudio(a->getBuffer(), a->getSize());
-                    delete a;
-                }
-            }
-        }
-    }
+    renderAudio(preroll != FALSE);
 
     return S_OK;
 }
 
 HRESULT STDMETHODCALLTYPE DeckLinkOutput::ScheduledPlaybackHasStopped()
 {
-    LOG4CXX_DEBUG(Logger::getLogger("DeckLinkOutput"), "Playback stopped at frame: " + QString::number(totalFrames).toStdString());
-
-    totalFrames = 0;
-    prerollCount = 0;
-    endFrame = 0;
-    playing = false;
-    totalAudioSamples = 0;
-    canPreview = true;
+    playbackStopped();
 
     return S_OK;
 }
@@ -17,10 +17,8 @@ IOBridge::IOBridge(QObject *parent) :
 #ifdef GUI
     preview = NULL;
 #endif
-#ifdef DECKLINK
-    deckLinkOutput = NULL;
-    deckLinkInput = NULL;
-#endif
+    outputDevice = NULL;
+    inputDevice = NULL;
     recorder = new Recorder(this);
     ioBridge = NULL;
 
@@ -76,31 +74,30 @@ void IOBridge::togglePreviewVideo(PreviewerRGB* previewer)
 }
 #endif
 
-#ifdef DECKLINK
-const QString IOBridge::setDeckLinkInput(QString inter)
+const QString IOBridge::setInputDevice(QString inter)
 {
     videoMutex.lock();
     audioMutex.lock();
 
-    if(deckLinkInput != NULL)
+    if(inputDevice != NULL)
     {
-        deckLinkInput->setIOBridge(NULL);
-        deckLinkInput->disableCard();
+        inputDevice->setIOBridge(NULL);
+        inputDevice->disableCard();
 #ifdef GUI
         if(preview != NULL)
             preview->stopAudio();
 #endif
     }
-    deckLinkInput = NULL;
+    inputDevice = NULL;
 
     if(inter.contains("Input"))
     {
         inter.remove(QRegExp(".*\\("));
         inter.remove(")");
 
-        deckLinkInput = DeckLinkControl::getInput(inter.toInt());
-        deckLinkInput->enableCard();
-        deckLinkInput->setIOBridge(this);
+        inputDevice = DeviceControl::getInput(inter.toInt());
+        inputDevice->enableCard();
+        inputDevice->setIOBridge(this);
     }
 
     audioMutex.unlock();
@@ -109,19 +106,19 @@ const QString IOBridge::setDeckLinkInput(QString inter)
     return inter;
 }
 
-const DeckLinkInput* IOBridge::getDecklinkInput() const
+const InputDevice* IOBridge::getInputDevice() const
 {
-    return deckLinkInput;
+    return inputDevice;
 }
 
-const QString IOBridge::setDeckLinkOutput(QString inter)
+const QString IOBridge::setOutputDevice(QString inter)
 {
     videoMutex.lock();
     audioMutex.lock();
 
-    if(deckLinkOutput != NULL)
-        deckLinkOutput->disableCard();
-    deckLinkOutput = NULL;
+    if(outputDevice != NULL)
+        outputDevice->disableCard();
+    outputDevice = NULL;
 
 #ifdef GUI
     if(preview != NULL)
@@ -133,9 +130,9 @@ const QString IOBridge::setDeckLinkOutput(QString inter)
         inter.remove(QRegExp(".*\\("));
         inter.remove(")");
 
-        deckLinkOutput = DeckLinkControl::getOutput(inter.toInt());
-        deckLinkOutput->enableCard();
-        deckLinkOutput->startPlayback(NULL);
+        outputDevice = DeviceControl::getOutput(inter.toInt());
+        outputDevice->enableCard();
+        outputDevice->startPlayback(NULL);
     }
 
     audioMutex.unlock();
@@ -144,11 +141,10 @@ const QString IOBridge::setDeckLinkOutput(QString inter)
     return inter;
 }
 
-const DeckLinkOutput* IOBridge::getDecklinkOutput() const
+const OutputDevice* IOBridge::getOutputDevice() const
 {
-    return deckLinkOutput;
+    return outputDevice;
 }
-#endif
 
 const void IOBridge::setIOBridge(IOBridge* ioBridge)
 {
@@ -164,22 +160,16 @@ const void IOBridge::rebootInterface()
 {
     if(ioBridge != NULL)
     {
-#ifdef DECKLINK
-        if(deckLinkInput != NULL)
-            deckLinkInput->setIOBridge(NULL);
-#endif
+        if(inputDevice != NULL)
+            inputDevice->setIOBridge(NULL);
         ioBridge->rebootInterface();
-#ifdef DECKLINK
-        if(deckLinkInput != NULL)
-            deckLinkInput->setIOBridge(this);
-#endif
+        if(inputDevice != NULL)
+            inputDevice->setIOBridge(this);
     }
     else
     {
-#ifdef DECKLINK
-    if(deckLinkOutput != NULL)
-        deckLinkOutput->stopPlayback(true);
-#endif
+        if(outputDevice != NULL)
+            outputDevice->stopPlayback(true);
     }
 }
 
@@ -193,10 +183,8 @@ void IOBridge::changeFormat(const QString& format)
     videoMutex.lock();
     audioMutex.lock();
 
-#ifdef DECKLINK
-    if(deckLinkInput != NULL)
-        deckLinkInput->setIOBridge(NULL);
-#endif
+    if(inputDevice != NULL)
+        inputDevice->setIOBridge(NULL);
 
     if(ioBridge != NULL)
         ioBridge->changeFormat(format);
@@ -205,12 +193,10 @@ void IOBridge::changeFormat(const QString& format)
 
     currentMediaFormat = format;
 
-#ifdef DECKLINK
-    if(deckLinkInput != NULL)
-        deckLinkInput->changeFormat(format);
-    if(deckLinkOutput != NULL)
-        deckLinkOutput->changeFormat(format);
-#endif
+    if(inputDevice != NULL)
+        inputDevice->changeFormat(format);
+    if(outputDevice != NULL)
+        outputDevice->changeFormat(format);
 
 #ifdef GUI
     if(preview != NULL)
@@ -259,10 +245,8 @@ void IOBridge::changeFormat(const QString& format)
 
     initFFMpeg();
 
-#ifdef DECKLINK
-    if(deckLinkInput != NULL)
-        deckLinkInput->setIOBridge(this);
-#endif
+    if(inputDevice != NULL)
+        inputDevice->setIOBridge(this);
 
     audioMutex.unlock();
     videoMutex.unlock();
@@ -275,10 +259,8 @@ bool IOBridge::isRecording() const
 
 void IOBridge::startRecording()
 {
-#ifdef DECKLINK
-    if(deckLinkInput != NULL)
-        deckLinkInput->flushCard();
-#endif
+    if(inputDevice != NULL)
+        inputDevice->flushCard();
     recording = true;
 }
 
@@ -294,7 +276,7 @@ void IOBridge::clearBuffers()
         AVDecodedFrame* buffer = getNextVideoFrame();
         if(buffer == NULL)
             break;
-        delete buffer;
+        buffer->release();
     }
 
     while(true)
@@ -302,7 +284,7 @@ void IOBridge::clearBuffers()
         AVDecodedFrame* buffer = getNextAudioSample();
         if(buffer == NULL)
             break;
-        delete buffer;
+        buffer->release();
     }
 }
 
@@ -340,12 +322,10 @@ const void IOBridge::pushVideoFrame(uint8_t* v, const int frameSize)
             emit previewVideo(QByteArray((char*)framePreview->data[0], previewSize));
 #endif
 
-    #ifdef DECKLINK
-            if(deckLinkOutput != NULL)
-                deckLinkOutput->outputVideo(v, frameSize + videoOffset, false, 0);
-    #endif
+            if(outputDevice != NULL)
+                outputDevice->outputVideo(v, frameSize + videoOffset, false, 0);
             if(recording)
-                videoFramesList.append(new AVDecodedFrame(AVMEDIA_TYPE_VIDEO, v, frameSize + videoOffset, 0, 0));
+                videoFramesList.append(AVDecodedFrame::create(AVMEDIA_TYPE_VIDEO, v, frameSize + videoOffset, 0, 0));
 
             if(ioBridge != NULL)
                 ioBridge->pushVideoFrame(v, frameSize);
@@ -359,16 +339,14 @@ const void IOBridge::pushAudioFrame(uint8_t* a, const int audioSize)
 {
     audioMutex.lock();
 
-#ifdef DECKLINK
-    if(deckLinkOutput != NULL)
-        deckLinkOutput->outputAudio(a, audioSize);
-#endif
+    if(outputDevice != NULL)
+        outputDevice->outputAudio(a, audioSize);
 
     if(ioBridge != NULL)
         ioBridge->pushAudioFrame(a, audioSize);
 
     if(recording)
-        audioSamplesList.append(new AVDecodedFrame(AVMEDIA_TYPE_AUDIO, a, audioSize, 0, 0));
+        audioSamplesList.append(AVDecodedFrame::create(AVMEDIA_TYPE_AUDIO, a, audioSize, 0, 0));
 
 #ifdef GUI
     emit previewAudio(QByteArray((char*)a, audioSize));
@@ -561,22 +539,20 @@ void IOBridge::cleanupFilters()
 void IOBridge::cleanup()
 {
     videoMutex.lock();
-    videoFramesList.clear();
+    AVDecodedFrame::releaseAll(videoFramesList);
     videoMutex.unlock();
     audioMutex.lock();
-    audioSamplesList.clear();
+    AVDecodedFrame::releaseAll(audioSamplesList);
     audioMutex.unlock();
 
     cleanupFFMpeg();
 
-#ifdef DECKLINK
-    if(deckLinkInput != NULL)
-        deckLinkInput->disableCard();
-    deckLinkInput = NULL;
-    if(deckLinkOutput != NULL)
-        deckLinkOutput->disableCard();
-    deckLinkOutput = NULL;
-#endif
+    if(inputDevice != NULL)
+        inputDevice->disableCard();
+    inputDevice = NULL;
+    if(outputDevice != NULL)
+        outputDevice->disableCard();
+    outputDevice = NULL;
 
 #ifdef GUI
     if(preview != NULL)
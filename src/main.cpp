@@ -29,6 +29,29 @@ extern "C" __declspec(dllexport) const int deactivatePlayout(const int port)
     return core->deactivatePlayout(port);
 }
 
+extern "C" __declspec(dllexport) const int setBufferDepth(const int port, const int depth)
+{
+    return core->setBufferDepth(port, depth);
+}
+
+// Low latency runs the output with 4 frames scheduled ahead instead of 10
+extern "C" __declspec(dllexport) const int setLowLatency(const int port, const bool enabled)
+{
+    return core->setLowLatency(port, enabled);
+}
+
+// Memory kept for frame stepping in megabytes, 0 disables the frame cache
+extern "C" __declspec(dllexport) const int setCacheSize(const int port, const int megabytes)
+{
+    return core->setCacheSize(port, megabytes);
+}
+
+// Empty dump path discards the output
+extern "C" __declspec(dllexport) const int addVirtualPorts(const int count, const char* dumpPath, const bool realtime)
+{
+    return core->addVirtualPorts(count, dumpPath, realtime);
+}
+
 // Player functions
 
 extern "C" __declspec(dllexport) const int64_t loadPortItem(const int port, const char* path, const bool canTake)
@@ -51,6 +74,17 @@ extern "C" __declspec(dllexport) const int64_t getCurrentTimeCode(const int port
     return core->getCurrentTimeCode(port);
 }
 
+// Milliseconds of audio scheduled on the output at its last refill
+extern "C" __declspec(dllexport) const int getAudioBufferLevel(const int port)
+{
+    return core->getAudioBufferLevel(port);
+}
+
+extern "C" __declspec(dllexport) const int getAudioUnderruns(const int port)
+{
+    return core->getAudioUnderruns(port);
+}
+
 extern "C" __declspec(dllexport) const int recue(const int port, const bool loop)
 {
     return core->recue(port, loop);
@@ -95,3 +129,10 @@ extern "C" __declspec(dllexport) const double reverse(const int port)
 {
     return core->reverse(port);
 }
+
+// Diagnostics functions
+
+extern "C" __declspec(dllexport) void benchmarkConversions(const int width, const int height, const int iterations)
+{
+    core->benchmarkConversions(width, height, iterations);
+}
@@ -0,0 +1,78 @@
+#include "devicecontrol.h"
+#include "virtualoutput.h"
+
+#ifdef DECKLINK
+#include "decklinkcontrol.h"
+#endif
+
+QList<InputDevice*> DeviceControl::inputList;
+QList<OutputDevice*> DeviceControl::outputList;
+QList<OutputDevice*> DeviceControl::virtualOutputList;
+
+bool DeviceControl::init()
+{
+    bool success = true;
+
+#ifdef DECKLINK
+    success = DeckLinkControl::init();
+    if(success)
+    {
+        for(int i=1; i<=DeckLinkControl::getInputList().size(); i++)
+            inputList.append(DeckLinkControl::getInput(i));
+        for(int i=1; i<=DeckLinkControl::getOutputList().size(); i++)
+            outputList.append(DeckLinkControl::getOutput(i));
+    }
+#endif
+
+    return success;
+}
+
+void DeviceControl::destroy()
+{
+    // Cards are owned by their control
+    inputList.clear();
+    outputList.clear();
+    qDeleteAll(virtualOutputList);
+    virtualOutputList.clear();
+
+#ifdef DECKLINK
+    DeckLinkControl::destroy();
+#endif
+}
+
+const QStringList DeviceControl::getInputList()
+{
+    QStringList list;
+    for(int i=0; i<inputList.size(); i++)
+        list.append(inputList.at(i)->getDeviceName() + " Input (" + QString::number(i+1) + ")");
+
+    return list;
+}
+
+const QStringList DeviceControl::getOutputList()
+{
+    QStringList list;
+    for(int i=0; i<outputList.size(); i++)
+        list.append(outputList.at(i)->getDeviceName() + " Output (" + QString::number(i+1) + ")");
+
+    return list;
+}
+
+InputDevice* DeviceControl::getInput(const int pos)
+{
+    return inputList.at(pos-1);
+}
+
+OutputDevice* DeviceControl::getOutput(const int pos)
+{
+    return outputList.at(pos-1);
+}
+
+const int DeviceControl::addVirtualOutput(const QString& name, const QString& dumpPath, const bool realtime)
+{
+    VirtualOutput* output = new VirtualOutput(name, dumpPath, realtime);
+    virtualOutputList.append(output);
+    outputList.append(output);
+
+    return outputList.size();
+}
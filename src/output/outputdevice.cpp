@@ -0,0 +1,489 @@
+#include "outputdevice.h"
+#include "player.h"
+
+#include <QDataStream>
+#include <QFile>
+
+extern "C"
+{
+    #include <libavutil/mem.h>
+    #include <libavutil/time.h>
+}
+
+#include <log4cxx/logger.h>
+
+using namespace log4cxx;
+
+OutputDevice::OutputDevice(QObject* parent) : QObject(parent)
+{
+    player = NULL;
+    deviceName = "";
+    format = "PAL";
+    filename = "";
+
+    width = 720;
+    height = 576;
+    rowBytes = width * 2;
+    frameSize = width * rowBytes;
+    vancRows = 32;
+    videoOffset = vancRows * rowBytes;
+    canPreview = true;
+    startFrame = 0;
+    ratio = 25.0 / 1000;
+    totalFrames = 0;
+    prerollCount = 0;
+    endFrame = 0;
+    totalAudioSamples = 0;
+    playing = false;
+    referenceCheck = 0;
+    bufferDepth = DEFAULT_BUFFER_DEPTH;
+    endOfStream = false;
+
+    sampleRate = 48000;
+    channelCount = 8;
+
+    audioRingSize = sampleRate * AUDIO_RING_SECONDS * 2 * channelCount;
+    audioRing = (uint8_t*)av_malloc(audioRingSize);
+    audioRead = 0;
+    audioFill = 0;
+    pendingAudio = NULL;
+    audioLevel = 0;
+    audioLowest = -1;
+    audioUnderruns = 0;
+    audioStarved = false;
+
+    originalFrameDuration = frameDisplayTime = frameDuration = 1000;
+    frameTimescale = 25000;
+}
+
+OutputDevice::~OutputDevice()
+{
+    resetAudio();
+    av_freep(&audioRing);
+}
+
+bool OutputDevice::enableCard()
+{
+    if(enableOutput(format))
+    {
+        rowBytes = width * 2;
+        frameSize = height * rowBytes;
+        originalFrameDuration = frameDisplayTime = frameDuration;
+        canPreview = true;
+        startFrame = 0;
+        ratio = 25.0 / 1000;
+        totalFrames = 0;
+        prerollCount = 0;
+        endFrame = 0;
+        playing = false;
+        totalAudioSamples = 0;
+
+        this->loadBars();
+
+        return true;
+    }
+
+    return false;
+}
+
+void OutputDevice::loadBars()
+{
+    if(filename != "")
+    {
+        char* arr = new char[frameSize];
+
+        QFile file(filename);
+        if(file.open(QIODevice::ReadWrite))
+        {
+            QDataStream stream(&file);
+            stream.readRawData(arr, frameSize);
+        }
+
+        this->outputVideo((uint8_t*)arr, frameSize, true, 0);
+        delete[] arr;
+    }
+}
+
+void OutputDevice::disableCard()
+{
+    disableOutput();
+}
+
+const QString OutputDevice::getDeviceName() const
+{
+    return deviceName;
+}
+
+const bool OutputDevice::changeFormat(const QString& format)
+{
+    if(!filename.contains(format))
+    {
+        disableCard();
+        filename = "bars/" + format + ".yuv";
+
+        if(format == "PAL" || format == "PAL 16:9")
+            filename = "bars/PAL.yuv";
+        this->format = format;
+
+        bool success = enableCard();
+
+        if(format == "PAL" || format == "PAL 16:9")
+        {
+            vancRows = 32;
+            videoOffset = vancRows * rowBytes;
+        }
+        else // TODO: VANC for HD resolutions
+        {
+            vancRows = 0;
+            videoOffset = 0;
+        }
+
+        return success;
+    }
+
+    return true;
+}
+
+// Reverse rates schedule frames like forward ones, the decoder delivers them backwards
+void OutputDevice::setRate(const double rate)
+{
+    frameDisplayTime = frameDuration / qAbs(rate);
+    ratio = 25.0 * qAbs(rate) / 1000;
+}
+
+void OutputDevice::setStartFrame(const int64_t start_frame)
+{
+    startFrame = start_frame;
+}
+
+void OutputDevice::adjustFPS(const double adjust)
+{
+    frameDuration = originalFrameDuration / adjust;
+    frameDisplayTime = frameDuration;
+}
+
+// Takes effect as frames complete, a shallower buffer drains, a deeper one fills from the player
+void OutputDevice::setBufferDepth(const int depth)
+{
+    bufferDepth = qBound(MIN_BUFFER_DEPTH, depth, MAX_BUFFER_DEPTH);
+    bufferDepthChanged();
+}
+
+void OutputDevice::bufferDepthChanged()
+{
+}
+
+const int OutputDevice::getBufferDepth() const
+{
+    return bufferDepth;
+}
+
+const int64_t OutputDevice::getReferenceTime()
+{
+    return av_gettime();
+}
+
+const int OutputDevice::getAudioBufferLevel() const
+{
+    return (int64_t)audioLevel * 1000 / sampleRate;
+}
+
+const int OutputDevice::getAudioUnderruns() const
+{
+    return audioUnderruns;
+}
+
+const QString OutputDevice::getAudioStatistics() const
+{
+    int64_t lowest = audioLowest < 0 ? audioLevel : audioLowest;
+
+    return "buffered " + QString::number(getAudioBufferLevel()) + " ms, lowest " +
+           QString::number(lowest * 1000 / sampleRate) + " ms, underruns " + QString::number(audioUnderruns);
+}
+
+void OutputDevice::startPlayback(Player* player)
+{
+    while(playing)
+    {
+        av_usleep(1000);
+    }
+
+    totalFrames = 0;
+    prerollCount = 0;
+    endFrame = 0;
+    playing = false;
+    totalAudioSamples = 0;
+    canPreview = false;
+    scheduledFrames.fetchAndStoreOrdered(0);
+    endOfStream = false;
+    resetAudio();
+    audioUnderruns = 0;
+    this->player = player;
+
+    if(player != NULL)
+    {
+        setCallbacks(true);
+
+        // The player waited for the decoder to fill the buffer, short clips preroll what they have
+        scheduleFrames();
+
+        beginAudioPreroll();
+    }
+    else
+    {
+        setCallbacks(false);
+
+        startScheduledPlayback();
+        playing = true;
+    }
+}
+
+void OutputDevice::stopPlayback(const bool immediate)
+{
+    if(immediate)
+    {
+        LOG4CXX_DEBUG(Logger::getLogger("OutputDevice"), "Immediate stop playback");
+
+        stopScheduledPlayback(true, 0);
+        resetAudio();
+        totalFrames = 0;
+        prerollCount = 0;
+        endFrame = 0;
+        totalAudioSamples = 0;
+        canPreview = true;
+        playing = false;
+    }
+    else
+    {
+        if(endFrame > 0 && totalFrames > endFrame)
+        {
+            LOG4CXX_DEBUG(Logger::getLogger("OutputDevice"), "Stopping playback at frame: " + QString::number(endFrame-1).toStdString());
+            stopScheduledPlayback(false, (endFrame-1) * frameDisplayTime);
+        }
+        else
+        {
+            LOG4CXX_DEBUG(Logger::getLogger("OutputDevice"), "Stopping playback at frame: " + QString::number(totalFrames-1).toStdString());
+            stopScheduledPlayback(false, (totalFrames-1) * frameDisplayTime);
+        }
+    }
+}
+
+// Frames decoded with the VANC lines carry them above the picture
+void OutputDevice::outputVideo(const uint8_t* videoBuffer, const int size, const bool preview, const int64_t timecode)
+{
+    const uint8_t* frame = size > frameSize ? videoBuffer + videoOffset : videoBuffer;
+
+    if(preview)
+    {
+        if(canPreview)
+            displayFrame(frame, timecode);
+    }
+    else if(scheduleFrame(frame, timecode, totalFrames * frameDisplayTime, frameDisplayTime))
+    {
+        totalFrames++;
+        scheduledFrames.ref();
+    }
+
+    // Querying the card costs a driver call, the lock is checked about once a second
+    if(++referenceCheck >= REFERENCE_CHECK_INTERVAL)
+    {
+        referenceCheck = 0;
+        if(!isReferenceLocked())
+            emit genlockError();
+    }
+}
+
+void OutputDevice::outputAudio(const uint8_t* audioBuffer, const int size)
+{
+    // Divide audio buffer size by 2*channels
+    int sample_size = size / (2 * channelCount);
+
+    // Check for playback active if in bridge mode
+    if(!isPlaybackRunning() && prerollCount == 0)
+        startScheduledPlayback();
+
+    int written = scheduleAudio(audioBuffer, sample_size, totalAudioSamples);
+    if(written > 0)
+        totalAudioSamples += written;
+}
+
+void OutputDevice::frameCompleted(const FrameCompletion result)
+{
+    scheduledFrames.deref();
+
+    if(playing)
+    {
+        if(result == FRAME_DISPLAYED_LATE)
+        {
+            LOG4CXX_WARN(Logger::getLogger("OutputDevice"), "Frame displayed late");
+            totalFrames += 1;
+        }
+        else if(result == FRAME_DROPPED)
+        {
+            LOG4CXX_WARN(Logger::getLogger("OutputDevice"), "Dropped frame");
+        }
+        else if(result == FRAME_FLUSHED)
+             LOG4CXX_WARN(Logger::getLogger("OutputDevice"), "Flushed frame");
+
+        scheduleFrames();
+    }
+}
+
+// Schedules every frame the player has ready up to the buffer depth. An empty queue is left for the next
+// completion or audio request to catch up, the slots it missed are reported back late
+void OutputDevice::scheduleFrames()
+{
+    // Completions and audio requests may come from different device threads
+    QMutexLocker locker(&scheduleMutex);
+
+    while(!endOfStream && scheduledFrames.fetchAndAddAcquire(0) < bufferDepth)
+    {
+        bool end = false;
+        AVDecodedFrame* v = player->getNextVideoFrame(&end);
+        if(v == NULL)
+        {
+            if(end)
+            {
+                LOG4CXX_DEBUG(Logger::getLogger("OutputDevice"), "Reached EOF");
+                endOfStream = true;
+                endFrame = totalFrames;
+            }
+            else if(scheduledFrames.fetchAndAddAcquire(0) < MIN_BUFFER_DEPTH)
+                LOG4CXX_WARN(Logger::getLogger("OutputDevice"), "Output buffer running low: " + QString::number(scheduledFrames.fetchAndAddAcquire(0)).toStdString() + " frames");
+            break;
+        }
+
+        this->outputVideo(v->getBuffer(), v->getSize(), false, startFrame + v->getClockPTS() * ratio);
+        v->release();
+    }
+}
+
+void OutputDevice::renderAudio(const bool preroll)
+{
+    if(preroll && prerollCount++ > 20)
+    {
+        endAudioPreroll();
+        startScheduledPlayback();
+        playing = true;
+        LOG4CXX_DEBUG(Logger::getLogger("OutputDevice"), "Playback started");
+    }
+    else
+    {
+        // Once every scheduled frame completed no completion comes to schedule more, the audio requests go on
+        if(playing && scheduledFrames.fetchAndAddAcquire(0) < bufferDepth)
+            scheduleFrames();
+
+        if(playing || preroll)
+            fillAudio(preroll);
+    }
+}
+
+// Moves whatever the player has ready into the ring, then tops the device up to the water level in at most two
+// spans, the second one only when the data wraps around the end of the ring
+void OutputDevice::fillAudio(const bool preroll)
+{
+    QMutexLocker locker(&audioMutex);
+
+    const int bytesPerSample = 2 * channelCount;
+
+    while(true)
+    {
+        if(pendingAudio == NULL)
+        {
+            pendingAudio = player->getNextAudioSample();
+            if(pendingAudio == NULL)
+                break;
+        }
+
+        const int size = pendingAudio->getSize();
+        if(size > audioRingSize - audioFill)
+            break;
+
+        const int write = (audioRead + audioFill) % audioRingSize;
+        const int first = qMin(size, audioRingSize - write);
+        memcpy(audioRing + write, pendingAudio->getBuffer(), first);
+        memcpy(audioRing, pendingAudio->getBuffer() + first, size - first);
+        audioFill += size;
+
+        pendingAudio->release();
+        pendingAudio = NULL;
+    }
+
+    audioLevel = getBufferedAudioSamples();
+    if(!preroll)
+    {
+        if(audioLowest < 0 || audioLevel < audioLowest)
+            audioLowest = audioLevel;
+
+        // One underrun per gap, the device plays silence until the player catches up
+        if(audioLevel == 0 && audioFill == 0 && !endOfStream)
+        {
+            if(!audioStarved)
+            {
+                audioUnderruns++;
+                LOG4CXX_WARN(Logger::getLogger("OutputDevice"), "Audio underrun, " + QString::number(audioUnderruns).toStdString() + " so far");
+            }
+            audioStarved = true;
+        }
+        else audioStarved = false;
+    }
+
+    const uint32_t waterLevel = (int64_t)sampleRate * frameDuration * bufferDepth * AUDIO_WATER_LEVEL_FRAMES / frameTimescale;
+    if(audioLevel >= waterLevel)
+        return;
+
+    int wanted = (waterLevel - audioLevel) * bytesPerSample;
+    while(wanted > 0 && audioFill > 0)
+    {
+        int span = qMin(qMin(wanted, audioFill), audioRingSize - audioRead);
+        span -= span % bytesPerSample;
+        if(span == 0)
+            break;
+
+        int written = scheduleAudio(audioRing + audioRead, span / bytesPerSample, totalAudioSamples);
+        if(written <= 0)
+            break;
+
+        totalAudioSamples += written;
+        audioRead = (audioRead + written * bytesPerSample) % audioRingSize;
+        audioFill -= written * bytesPerSample;
+        wanted -= written * bytesPerSample;
+
+        // The device buffer is full
+        if(written * bytesPerSample < span)
+            break;
+    }
+
+    if(audioFill == 0)
+        audioRead = 0;
+}
+
+void OutputDevice::resetAudio()
+{
+    QMutexLocker locker(&audioMutex);
+
+    if(pendingAudio != NULL)
+        pendingAudio->release();
+    pendingAudio = NULL;
+    audioRead = 0;
+    audioFill = 0;
+    audioLevel = 0;
+    audioLowest = -1;
+    audioStarved = false;
+}
+
+void OutputDevice::playbackStopped()
+{
+    LOG4CXX_DEBUG(Logger::getLogger("OutputDevice"), "Playback stopped at frame: " + QString::number(totalFrames).toStdString());
+    LOG4CXX_DEBUG(Logger::getLogger("OutputDevice"), "Output audio: " + getAudioStatistics().toStdString());
+
+    resetAudio();
+
+    totalFrames = 0;
+    prerollCount = 0;
+    endFrame = 0;
+    playing = false;
+    totalAudioSamples = 0;
+    canPreview = true;
+    endOfStream = false;
+}
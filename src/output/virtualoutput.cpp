@@ -0,0 +1,423 @@
+#include "virtualoutput.h"
+
+#include <QDir>
+#include <QMutexLocker>
+
+extern "C"
+{
+    #include <libavutil/mathematics.h>
+    #include <libavutil/time.h>
+}
+
+#include <log4cxx/logger.h>
+
+using namespace log4cxx;
+
+VirtualOutput::VirtualOutput(const QString& name, const QString& dumpPath, const bool realtime)
+{
+    deviceName = name;
+    this->dumpPath = dumpPath;
+    this->realtime = realtime;
+    quit = false;
+
+    enabled = false;
+    callbacks = false;
+    preroll = false;
+    running = false;
+    stopping = false;
+    stopTime = 0;
+
+    modeDuration = frameDuration;
+    deviceTime = 0;
+    audioConsumed = 0;
+
+    framesShown = 0;
+    framesLate = 0;
+    framesDropped = 0;
+    videoUnderruns = 0;
+    silentTicks = 0;
+
+    clock = new Clock(this);
+    clock->start(QThread::TimeCriticalPriority);
+}
+
+VirtualOutput::~VirtualOutput()
+{
+    quit = true;
+    clock->wait();
+    delete clock;
+
+    closeDumps();
+}
+
+bool VirtualOutput::isInitialized()
+{
+    return true;
+}
+
+const QString VirtualOutput::getStatistics()
+{
+    QMutexLocker locker(&mutex);
+
+    return "shown " + QString::number(framesShown) + ", late " + QString::number(framesLate) + ", dropped " +
+           QString::number(framesDropped) + ", video underruns " + QString::number(videoUnderruns) +
+           ", silent ticks " + QString::number(silentTicks) + ", audio underruns " + QString::number(getAudioUnderruns());
+}
+
+bool VirtualOutput::enableOutput(const QString& format)
+{
+    QMutexLocker locker(&mutex);
+
+    if(format == "PAL" || format == "PAL 16:9")
+    {
+        width = 720;
+        height = 576;
+        frameDuration = 1000;
+        frameTimescale = 25000;
+    }
+    else if(format == "720p50")
+    {
+        width = 1280;
+        height = 720;
+        frameDuration = 1000;
+        frameTimescale = 50000;
+    }
+    else if(format == "720p5994")
+    {
+        width = 1280;
+        height = 720;
+        frameDuration = 1001;
+        frameTimescale = 60000;
+    }
+    else if(format == "1080p25" || format == "1080i50")
+    {
+        width = 1920;
+        height = 1080;
+        frameDuration = 1000;
+        frameTimescale = 25000;
+    }
+    else if(format == "1080i5994")
+    {
+        width = 1920;
+        height = 1080;
+        frameDuration = 1001;
+        frameTimescale = 30000;
+    }
+    else
+    {
+        LOG4CXX_ERROR(Logger::getLogger("VirtualOutput"), deviceName.toStdString() + ": unsupported format " + format.toStdString());
+        return false;
+    }
+
+    modeDuration = frameDuration;
+    enabled = true;
+    openDumps();
+
+    return true;
+}
+
+void VirtualOutput::disableOutput()
+{
+    QMutexLocker locker(&mutex);
+
+    running = false;
+    preroll = false;
+    enabled = false;
+    flushFrames();
+    closeDumps();
+}
+
+void VirtualOutput::setCallbacks(const bool enabled)
+{
+    QMutexLocker locker(&mutex);
+
+    callbacks = enabled;
+}
+
+bool VirtualOutput::displayFrame(const uint8_t* frame, const int64_t timecode)
+{
+    Q_UNUSED(frame);
+    Q_UNUSED(timecode);
+
+    return enabled;
+}
+
+bool VirtualOutput::scheduleFrame(const uint8_t* frame, const int64_t timecode, const int64_t displayTime, const int64_t duration)
+{
+    Q_UNUSED(timecode);
+
+    QMutexLocker locker(&mutex);
+
+    if(!enabled)
+        return false;
+
+    ScheduledFrame scheduled;
+    if(!freeFrames.isEmpty())
+        scheduled.picture = freeFrames.takeLast();
+    scheduled.picture.resize(frameSize);
+    memcpy(scheduled.picture.data(), frame, frameSize);
+    scheduled.displayTime = displayTime;
+    scheduled.duration = duration;
+
+    // Frames arrive in display order, late ones after an underrun included
+    frames.append(scheduled);
+
+    return true;
+}
+
+const int VirtualOutput::scheduleAudio(const uint8_t* samples, const int count, const int64_t streamTime)
+{
+    Q_UNUSED(streamTime);
+
+    QMutexLocker locker(&mutex);
+
+    if(!enabled)
+        return -1;
+
+    audio.append((const char*)samples, count * 2 * channelCount);
+
+    return count;
+}
+
+const uint32_t VirtualOutput::getBufferedAudioSamples()
+{
+    QMutexLocker locker(&mutex);
+
+    return audio.size() / (2 * channelCount);
+}
+
+void VirtualOutput::beginAudioPreroll()
+{
+    QMutexLocker locker(&mutex);
+
+    preroll = true;
+}
+
+void VirtualOutput::endAudioPreroll()
+{
+    QMutexLocker locker(&mutex);
+
+    preroll = false;
+}
+
+const bool VirtualOutput::isPlaybackRunning()
+{
+    QMutexLocker locker(&mutex);
+
+    return running;
+}
+
+void VirtualOutput::startScheduledPlayback()
+{
+    QMutexLocker locker(&mutex);
+
+    if(running)
+        return;
+
+    deviceTime = 0;
+    audioConsumed = 0;
+    stopping = false;
+    framesShown = framesLate = framesDropped = videoUnderruns = silentTicks = 0;
+    running = true;
+}
+
+void VirtualOutput::stopScheduledPlayback(const bool immediate, const int64_t stopTime)
+{
+    QMutexLocker locker(&mutex);
+
+    if(immediate)
+    {
+        running = false;
+        flushFrames();
+    }
+    else
+    {
+        stopping = true;
+        this->stopTime = stopTime;
+    }
+}
+
+const bool VirtualOutput::isReferenceLocked()
+{
+    return true;
+}
+
+void VirtualOutput::run()
+{
+    int64_t nextTick = av_gettime();
+
+    while(!quit)
+    {
+        mutex.lock();
+        const bool prerolling = preroll && callbacks;
+        const bool active = running;
+        mutex.unlock();
+
+        // Like a card, audio is asked for until the preroll ends and playback starts
+        if(prerolling)
+        {
+            renderAudio(true);
+            av_usleep(1000);
+            nextTick = av_gettime();
+            continue;
+        }
+
+        if(!active)
+        {
+            av_usleep(5000);
+            nextTick = av_gettime();
+            continue;
+        }
+
+        if(!tick() && !realtime)
+            av_usleep(1000);
+
+        if(realtime)
+        {
+            nextTick += modeDuration * AV_TIME_BASE / frameTimescale;
+            const int64_t wait = nextTick - av_gettime();
+            if(wait > 0)
+                av_usleep(wait);
+            else if(wait < -AV_TIME_BASE) // Stalled, start over instead of catching up
+                nextTick = av_gettime();
+        }
+    }
+}
+
+// Shows the frame due at the device time, false if none was
+const bool VirtualOutput::tick()
+{
+    QList<FrameCompletion> completions;
+    QByteArray picture;
+    bool stopped = false;
+
+    mutex.lock();
+
+    // Without a clock to keep up the device time waits for the next frame, the player is still asked for more
+    if(!realtime && frames.isEmpty() && !stopping)
+    {
+        const bool pull = callbacks;
+        mutex.unlock();
+
+        if(pull)
+            renderAudio(false);
+        return false;
+    }
+
+    // Without a clock to keep up with the next frame is shown right away
+    if(!realtime && !frames.isEmpty() && frames.first().displayTime > deviceTime)
+        deviceTime = frames.first().displayTime;
+
+    // Frames overtaken by a later one due already never make it to the output
+    while(frames.size() > 1 && frames.at(1).displayTime <= deviceTime)
+    {
+        freeFrames.append(frames.takeFirst().picture);
+        completions.append(FRAME_DROPPED);
+        framesDropped++;
+    }
+
+    if(!frames.isEmpty() && frames.first().displayTime <= deviceTime)
+    {
+        ScheduledFrame frame = frames.takeFirst();
+        picture = frame.picture;
+
+        if(frame.displayTime + frame.duration <= deviceTime)
+        {
+            completions.append(FRAME_DISPLAYED_LATE);
+            framesLate++;
+        }
+        else
+            completions.append(FRAME_COMPLETED);
+        framesShown++;
+    }
+    else if(frames.isEmpty())
+        videoUnderruns++;
+
+    deviceTime += modeDuration;
+
+    // Audio follows the device time, whatever is missing plays as silence
+    const int64_t audioDue = av_rescale(deviceTime, sampleRate, frameTimescale) - audioConsumed;
+    const int bytesDue = audioDue * 2 * channelCount;
+    const int bytesAvailable = qMin(bytesDue, audio.size());
+    if(audioDump.isOpen())
+    {
+        audioDump.write(audio.constData(), bytesAvailable);
+        if(bytesAvailable < bytesDue)
+            audioDump.write(QByteArray(bytesDue - bytesAvailable, 0));
+    }
+    audio.remove(0, bytesAvailable);
+    if(bytesAvailable < bytesDue && callbacks)
+        silentTicks++;
+    audioConsumed += audioDue;
+
+    if(!picture.isNull())
+    {
+        if(videoDump.isOpen())
+            videoDump.write(picture);
+        freeFrames.append(picture);
+    }
+
+    if(stopping && deviceTime > stopTime)
+    {
+        running = false;
+        stopping = false;
+        stopped = true;
+        flushFrames();
+    }
+
+    const bool pull = callbacks;
+    mutex.unlock();
+
+    if(stopped)
+        LOG4CXX_INFO(Logger::getLogger("VirtualOutput"), deviceName.toStdString() + " stopped: " + getStatistics().toStdString());
+
+    // The player is called without the lock, it schedules the next frames from here
+    if(pull)
+    {
+        for(int i=0; i<completions.size(); i++)
+            frameCompleted(completions.at(i));
+
+        if(stopped)
+            playbackStopped();
+        else
+            renderAudio(false);
+    }
+
+    return !picture.isNull();
+}
+
+// Called with the mutex held
+void VirtualOutput::flushFrames()
+{
+    while(!frames.isEmpty())
+        freeFrames.append(frames.takeFirst().picture);
+    audio.clear();
+}
+
+// Called with the mutex held
+void VirtualOutput::openDumps()
+{
+    closeDumps();
+
+    if(dumpPath.isEmpty())
+        return;
+
+    QDir dir(dumpPath);
+    QString base = dir.filePath(QString(deviceName).replace(' ', '_') + "_" + QString(format).replace(' ', '_'));
+
+    videoDump.setFileName(base + ".uyvy");
+    if(!videoDump.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        LOG4CXX_ERROR(Logger::getLogger("VirtualOutput"), "Could not open " + videoDump.fileName().toStdString());
+
+    audioDump.setFileName(base + ".pcm");
+    if(!audioDump.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        LOG4CXX_ERROR(Logger::getLogger("VirtualOutput"), "Could not open " + audioDump.fileName().toStdString());
+}
+
+void VirtualOutput::closeDumps()
+{
+    if(videoDump.isOpen())
+        videoDump.close();
+    if(audioDump.isOpen())
+        audioDump.close();
+}
@@ -0,0 +1,111 @@
+#include "audiopacketizer.h"
+
+#include <string.h>
+
+#include <QtGlobal>
+
+extern "C"
+{
+    #include <libavutil/mathematics.h>
+    #include <libavutil/mem.h>
+}
+
+AudioPacketizer::AudioPacketizer(const int bytesPerSample, const int sampleRate, const AVRational frameRate)
+{
+    this->bytesPerSample = bytesPerSample;
+    this->sampleRate = sampleRate;
+    this->frameRate = frameRate.num > 0 && frameRate.den > 0 ? frameRate : av_make_q(25, 1);
+
+    // One second is enough for any codec frame plus a pending block, larger chunks grow it
+    capacity = sampleRate * bytesPerSample;
+    buffer = (uint8_t*)av_malloc(capacity);
+    start = 0;
+    end = 0;
+    frame = 0;
+    blockSize = getBlockSamples(frame) * bytesPerSample;
+}
+
+AudioPacketizer::~AudioPacketizer()
+{
+    av_freep(&buffer);
+}
+
+const int AudioPacketizer::getBlockSamples(const int64_t frame) const
+{
+    int64_t samplesPerFrame = (int64_t)sampleRate * frameRate.den;
+
+    return (int)(av_rescale_rnd(frame + 1, samplesPerFrame, frameRate.num, AV_ROUND_DOWN)
+                 - av_rescale_rnd(frame, samplesPerFrame, frameRate.num, AV_ROUND_DOWN));
+}
+
+void AudioPacketizer::append(const uint8_t* data, const int size)
+{
+    if(size <= 0)
+        return;
+
+    reserve(size);
+    memcpy(buffer + end, data, size);
+    end += size;
+}
+
+// Pending samples are moved to the front before the buffer is grown
+void AudioPacketizer::reserve(const int size)
+{
+    if(end + size <= capacity)
+        return;
+
+    if(start > 0)
+    {
+        memmove(buffer, buffer + start, end - start);
+        end -= start;
+        start = 0;
+    }
+
+    if(end + size > capacity)
+    {
+        capacity = end + size;
+        buffer = (uint8_t*)av_realloc(buffer, capacity);
+    }
+}
+
+const uint8_t* AudioPacketizer::getBlock() const
+{
+    if(end - start < blockSize)
+        return NULL;
+
+    return buffer + start;
+}
+
+const int AudioPacketizer::getBlockSize() const
+{
+    return blockSize;
+}
+
+void AudioPacketizer::next()
+{
+    start += qMin(blockSize, end - start);
+    if(start == end)
+        start = end = 0;
+
+    blockSize = getBlockSamples(++frame) * bytesPerSample;
+}
+
+void AudioPacketizer::flush()
+{
+    int left = end - start;
+    if(left == 0 || left >= blockSize)
+        return;
+
+    int missing = blockSize - left;
+    reserve(missing);
+    memset(buffer + end, 0, missing);
+    end += missing;
+}
+
+void AudioPacketizer::reset()
+{
+    start = 0;
+    end = 0;
+    frame = 0;
+    blockSize = getBlockSamples(frame) * bytesPerSample;
+}
@@ -1,19 +1,15 @@
 #include "audiothread.h"
 
-extern "C"
-{
-    #include <libavutil/time.h>
-}
-
 #include <log4cxx/logger.h>
 
 using namespace log4cxx;
 
-AudioThread::AudioThread(bool preview, QObject* parent) : QThread(parent)
+AudioThread::AudioThread(bool preview, PlayoutClock* clock, QObject* parent) : QThread(parent), audioSamples(100)
 {
     playing = false;
     loop = false;
     this->preview = preview;
+    this->clock = clock;
 }
 
 AudioThread::~AudioThread()
@@ -45,19 +41,18 @@ int AudioThread::paCallback(const void*, void* outputBuffer, unsigned long, cons
 {
     AudioThread* self = (AudioThread*)userData;
 
-    self->audioMutex.lock();
-    if(!self->audioSamplesList.empty())
+    // The callback runs on the audio driver thread so it never waits for the decoder
+    AVDecodedFrame* a = NULL;
+    if(self->audioSamples.pop(a))
     {
-        AVDecodedFrame* a = self->audioSamplesList.takeFirst();
         if(a != NULL)
         {
             memcpy(outputBuffer, a->getBuffer(), a->getSize());
-            delete a;
+            a->release();
         }
         else if(!self->loop)
             self->playing = false;
     }
-    self->audioMutex.unlock();
 
     return 0;
 }
@@ -70,13 +65,12 @@ void AudioThread::run()
     if(preview)
     {
         int nb_samples = 1024;
-        while(audioSamplesList.empty() && playing)
-            this->usleep(1000);
+        AVDecodedFrame* first = NULL;
+        while(playing && !audioSamples.peek(first, 10))
+            continue;
 
-        audioMutex.lock();
-        if(!audioSamplesList.empty() && audioSamplesList.first() != NULL)
-            nb_samples = audioSamplesList.first()->getSize()/4; // Divide audio buffer size by 2*channels
-        audioMutex.unlock();
+        if(first != NULL)
+            nb_samples = first->getSize()/4; // Divide audio buffer size by 2*channels
 
         PaError err = Pa_OpenDefaultStream(&stream, 0, 2, paInt16, 48000, nb_samples, paCallback, this);
         if(err < 0)
@@ -89,7 +83,8 @@ void AudioThread::run()
     }
 #endif
 
-    int64_t last_clock = av_gettime();
+    // The VU path is paced on the port clock, the preview plays out on the sound card clock
+    int64_t deadline = clock->getEpoch();
 
     while(playing)
     {
@@ -97,31 +92,29 @@ void AudioThread::run()
         {
             int64_t diff = 0;
 
-            audioMutex.lock();
-
-            if(!audioSamplesList.empty())
+            AVDecodedFrame* a = NULL;
+            if(audioSamples.pop(a, 10))
             {
-                AVDecodedFrame* a = audioSamplesList.takeFirst();
                 if(a != NULL)
                 {
 #ifdef GUI
                     emit previewAudio(QByteArray((char*)a->getBuffer(), a->getSize()));
 #endif
                     diff = a->getPTS();
-                    delete a;
+                    a->release();
                 }
                 else if(!loop)
                     playing = false;
             }
-            audioMutex.unlock();
 
             if(diff > 0)
             {
-                last_clock += diff;
-                int64_t msecs = last_clock - av_gettime();
+                deadline += diff;
 
-                if(msecs > 0.0)
-                    this->usleep(msecs);
+                int64_t lateness = clock->sleepUntil(deadline);
+                clock->recordLateness(AUDIO_STREAM, lateness);
+                if(lateness > RESYNC_LATENESS)
+                    deadline += lateness;
             }
         }
         else this->msleep(10);
@@ -145,26 +138,12 @@ void AudioThread::stopPlaying()
     this->wait();
 }
 
-const bool AudioThread::pushAudioFrame(AVDecodedFrame* a)
+FrameQueue* AudioThread::getQueue()
 {
-    audioMutex.lock();
-
-    if(audioSamplesList.size() > 100)
-    {
-        audioMutex.unlock();
-        return false;
-    }
-
-    audioSamplesList.append(a);
-    audioMutex.unlock();
-
-    return true;
+    return &audioSamples;
 }
 
 void AudioThread::cleanup()
 {
-    audioMutex.lock();
-    qDeleteAll(audioSamplesList);
-    audioSamplesList.clear();
-    audioMutex.unlock();
+    audioSamples.clear(AVDecodedFrame::releaseFrame);
 }
@@ -1,19 +1,66 @@
 #include "avdecodedframe.h"
+#include "framepool.h"
 
-AVDecodedFrame::AVDecodedFrame(AVMediaType type, uint8_t* data, const int size, const int64_t pts, const int64_t clockPts)
+AVDecodedFrame::AVDecodedFrame(FramePool* pool, uint8_t* buffer, const int capacity)
 {
-    this->type = type;
-    this->pts = pts * 1000;
-    this->clockPts = clockPts;
+    this->pool = pool;
+    source = NULL;
+    this->buffer = buffer;
+    bufferCapacity = capacity;
 
-    frameSize = size;
-    buffer = new uint8_t[frameSize];
-    memcpy(buffer, data, frameSize);
+    type = AVMEDIA_TYPE_UNKNOWN;
+    pts = 0;
+    clockPts = 0;
+    frameSize = 0;
 }
 
 AVDecodedFrame::~AVDecodedFrame()
 {
-    delete buffer;
+}
+
+AVDecodedFrame* AVDecodedFrame::create(AVMediaType type, const uint8_t* data, const int size, const int64_t pts, const int64_t clockPts)
+{
+    AVDecodedFrame* frame = allocate(type, size, pts, clockPts);
+    memcpy(frame->buffer, data, size);
+
+    return frame;
+}
+
+AVDecodedFrame* AVDecodedFrame::allocate(AVMediaType type, const int size, const int64_t pts, const int64_t clockPts)
+{
+    return FramePool::getPool(size)->acquire(type, size, pts, clockPts);
+}
+
+AVDecodedFrame* AVDecodedFrame::wrap(AVMediaType type, AVFrame* frame, const int size, const int64_t pts, const int64_t clockPts)
+{
+    return FramePool::getWrapperPool()->acquireWrapper(type, frame, size, pts, clockPts);
+}
+
+void AVDecodedFrame::ref()
+{
+    refCount.ref();
+}
+
+void AVDecodedFrame::release()
+{
+    if(!refCount.deref())
+        pool->recycle(this);
+}
+
+void AVDecodedFrame::releaseFrame(AVDecodedFrame* frame)
+{
+    if(frame != NULL)
+        frame->release();
+}
+
+void AVDecodedFrame::releaseAll(QList<AVDecodedFrame*>& frames)
+{
+    while(!frames.isEmpty())
+    {
+        AVDecodedFrame* frame = frames.takeFirst();
+        if(frame != NULL)
+            frame->release();
+    }
 }
 
 const int64_t AVDecodedFrame::getPTS()
@@ -31,6 +78,11 @@ const uint8_t* AVDecodedFrame::getBuffer()
     return buffer;
 }
 
+uint8_t* AVDecodedFrame::getWritableBuffer()
+{
+    return buffer;
+}
+
 const int AVDecodedFrame::getSize()
 {
     return frameSize;
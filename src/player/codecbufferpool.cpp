@@ -0,0 +1,280 @@
+#include "codecbufferpool.h"
+
+#include <windows.h>
+#include <malloc.h>
+
+extern "C"
+{
+    #include <libavutil/imgutils.h>
+    #include <libavutil/pixdesc.h>
+}
+
+#include <log4cxx/logger.h>
+
+using namespace log4cxx;
+
+#define BUFFER_ALIGNMENT 64
+// Decoders may read a little past the end of a plane
+#define BUFFER_PADDING 16
+
+#define LARGE_PAGES_UNKNOWN 0
+#define LARGE_PAGES_ENABLED 1
+#define LARGE_PAGES_UNAVAILABLE -1
+
+QMutex CodecBufferPool::largePageMutex;
+int CodecBufferPool::largePageState = LARGE_PAGES_UNKNOWN;
+size_t CodecBufferPool::largePageSize = 0;
+
+CodecBufferPool::CodecBufferPool()
+{
+    for(int i=0; i<AV_NUM_DATA_POINTERS; i++)
+    {
+        pools[i] = NULL;
+        poolSizes[i] = 0;
+    }
+    poolWidth = 0;
+    poolHeight = 0;
+    poolFormat = AV_PIX_FMT_NONE;
+
+    enableLargePages();
+}
+
+// Buffers still referenced by frames in the pipeline are freed when they are released
+CodecBufferPool::~CodecBufferPool()
+{
+    mutex.lock();
+    resetPools();
+    mutex.unlock();
+}
+
+void CodecBufferPool::attach(AVCodecContext* codecContext)
+{
+    codecContext->opaque = this;
+    codecContext->get_buffer2 = getBuffer;
+    codecContext->thread_safe_callbacks = 1;
+}
+
+// Large pages need the "Lock pages in memory" right, without it the pools fall back to aligned heap memory
+const bool CodecBufferPool::enableLargePages()
+{
+    largePageMutex.lock();
+
+    if(largePageState == LARGE_PAGES_UNKNOWN)
+    {
+        largePageState = LARGE_PAGES_UNAVAILABLE;
+        largePageSize = GetLargePageMinimum();
+
+        HANDLE token = NULL;
+        if(largePageSize > 0 && OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token))
+        {
+            TOKEN_PRIVILEGES privileges;
+            privileges.PrivilegeCount = 1;
+            privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+
+            if(LookupPrivilegeValue(NULL, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0].Luid)
+                    && AdjustTokenPrivileges(token, FALSE, &privileges, 0, NULL, NULL) && GetLastError() == ERROR_SUCCESS)
+            {
+                largePageState = LARGE_PAGES_ENABLED;
+            }
+
+            CloseHandle(token);
+        }
+
+        if(largePageState == LARGE_PAGES_ENABLED)
+        {
+            LOG4CXX_INFO(Logger::getLogger("CodecBufferPool"), "Large pages enabled for decoded pictures (" << largePageSize << " bytes)");
+        }
+        else LOG4CXX_INFO(Logger::getLogger("CodecBufferPool"), "Large pages not available, decoded pictures use aligned memory");
+    }
+
+    bool enabled = largePageState == LARGE_PAGES_ENABLED;
+
+    largePageMutex.unlock();
+
+    return enabled;
+}
+
+int CodecBufferPool::getBuffer(AVCodecContext* codecContext, AVFrame* frame, int flags)
+{
+    CodecBufferPool* pool = (CodecBufferPool*)codecContext->opaque;
+    if(pool == NULL || codecContext->codec_type != AVMEDIA_TYPE_VIDEO || !(codecContext->codec->capabilities & AV_CODEC_CAP_DR1))
+        return avcodec_default_get_buffer2(codecContext, frame, flags);
+
+    // Palette and hardware formats keep the default allocator
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get((AVPixelFormat)frame->format);
+    if(desc == NULL || desc->flags & (AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_PSEUDOPAL | AV_PIX_FMT_FLAG_HWACCEL))
+        return avcodec_default_get_buffer2(codecContext, frame, flags);
+
+    return pool->fillFrame(codecContext, frame);
+}
+
+const int CodecBufferPool::fillFrame(AVCodecContext* codecContext, AVFrame* frame)
+{
+    requests.ref();
+
+    int width = frame->width;
+    int height = frame->height;
+    int strideAlign[AV_NUM_DATA_POINTERS];
+    avcodec_align_dimensions2(codecContext, &width, &height, strideAlign);
+
+    // Widen the picture until every stride suits both the codec and the cache line size
+    int linesize[4];
+    bool unaligned = false;
+    do
+    {
+        int ret = av_image_fill_linesizes(linesize, (AVPixelFormat)frame->format, width);
+        if(ret < 0)
+            return ret;
+
+        width += width & ~(width - 1);
+
+        unaligned = false;
+        for(int i=0; i<4; i++)
+        {
+            if(linesize[i] % BUFFER_ALIGNMENT != 0 || linesize[i] % strideAlign[i] != 0)
+                unaligned = true;
+        }
+    }
+    while(unaligned);
+
+    uint8_t* data[4];
+    int size = av_image_fill_pointers(data, (AVPixelFormat)frame->format, height, NULL, linesize);
+    if(size < 0)
+        return size;
+
+    int planeSizes[4] = { 0, 0, 0, 0 };
+    int planes = 0;
+    for(; planes<3 && data[planes + 1] != NULL; planes++)
+        planeSizes[planes] = data[planes + 1] - data[planes];
+    planeSizes[planes] = size - (data[planes] - data[0]);
+    planes++;
+
+    mutex.lock();
+
+    if(frame->width != poolWidth || frame->height != poolHeight || frame->format != poolFormat)
+    {
+        resetPools();
+
+        for(int i=0; i<planes; i++)
+        {
+            poolSizes[i] = planeSizes[i] + BUFFER_PADDING + BUFFER_ALIGNMENT - 1;
+            pools[i] = av_buffer_pool_init2(poolSizes[i], this, allocateBuffer, NULL);
+            if(pools[i] == NULL)
+            {
+                resetPools();
+                mutex.unlock();
+                return AVERROR(ENOMEM);
+            }
+        }
+
+        poolWidth = frame->width;
+        poolHeight = frame->height;
+        poolFormat = frame->format;
+    }
+
+    for(int i=0; i<planes; i++)
+    {
+        frame->buf[i] = av_buffer_pool_get(pools[i]);
+        if(frame->buf[i] == NULL)
+        {
+            mutex.unlock();
+            av_frame_unref(frame);
+            return AVERROR(ENOMEM);
+        }
+
+        frame->data[i] = frame->buf[i]->data;
+        frame->linesize[i] = linesize[i];
+    }
+
+    mutex.unlock();
+
+    for(int i=planes; i<AV_NUM_DATA_POINTERS; i++)
+    {
+        frame->data[i] = NULL;
+        frame->linesize[i] = 0;
+    }
+    frame->extended_data = frame->data;
+
+    return 0;
+}
+
+void CodecBufferPool::resetPools()
+{
+    for(int i=0; i<AV_NUM_DATA_POINTERS; i++)
+    {
+        if(pools[i] != NULL)
+            av_buffer_pool_uninit(&pools[i]);
+        pools[i] = NULL;
+        poolSizes[i] = 0;
+    }
+
+    poolWidth = 0;
+    poolHeight = 0;
+    poolFormat = AV_PIX_FMT_NONE;
+}
+
+// Called by av_buffer_pool_get when a pool has no free buffer left
+AVBufferRef* CodecBufferPool::allocateBuffer(void* opaque, int size)
+{
+    CodecBufferPool* pool = (CodecBufferPool*)opaque;
+    pool->allocations.ref();
+
+    // Large pages are only worth it for planes that fill most of one
+    if(largePageState == LARGE_PAGES_ENABLED && (size_t)size >= largePageSize)
+    {
+        size_t rounded = ((size + largePageSize - 1) / largePageSize) * largePageSize;
+        uint8_t* data = (uint8_t*)VirtualAlloc(NULL, rounded, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+        if(data != NULL)
+        {
+            AVBufferRef* buffer = av_buffer_create(data, size, freeLargePage, NULL, 0);
+            if(buffer != NULL)
+            {
+                pool->largePages.ref();
+                return buffer;
+            }
+            VirtualFree(data, 0, MEM_RELEASE);
+        }
+    }
+
+    uint8_t* data = (uint8_t*)_aligned_malloc(size, BUFFER_ALIGNMENT);
+    if(data == NULL)
+        return NULL;
+
+    AVBufferRef* buffer = av_buffer_create(data, size, freeAligned, NULL, 0);
+    if(buffer == NULL)
+        _aligned_free(data);
+
+    return buffer;
+}
+
+void CodecBufferPool::freeAligned(void* opaque, uint8_t* data)
+{
+    _aligned_free(data);
+}
+
+void CodecBufferPool::freeLargePage(void* opaque, uint8_t* data)
+{
+    VirtualFree(data, 0, MEM_RELEASE);
+}
+
+const int CodecBufferPool::getRequestCount() const
+{
+    return requests;
+}
+
+const int CodecBufferPool::getAllocationCount() const
+{
+    return allocations;
+}
+
+const int CodecBufferPool::getLargePageCount() const
+{
+    return largePages;
+}
+
+const QString CodecBufferPool::getStatistics() const
+{
+    return "requests: " + QString::number(getRequestCount())
+            + " allocations: " + QString::number(getAllocationCount())
+            + " large pages: " + QString::number(getLargePageCount());
+}
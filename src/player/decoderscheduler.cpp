@@ -0,0 +1,175 @@
+#include "decoderscheduler.h"
+#include "ffdecoder.h"
+
+#include <QThread>
+
+#include <log4cxx/logger.h>
+
+using namespace log4cxx;
+
+// Codecs do not scale past this many threads in a useful way
+#define MAX_DECODER_THREADS 16
+
+QMutex DecoderScheduler::mutex;
+QMap<FFDecoder*, DecoderScheduler::DecoderEntry> DecoderScheduler::decoders;
+int DecoderScheduler::threadBudget = 0;
+
+void DecoderScheduler::attach(FFDecoder* decoder, const QString& name, AVCodecContext* codecContext, const double fps)
+{
+    mutex.lock();
+
+    DecoderEntry entry;
+    entry.name = name;
+    entry.weight = getWeight(codecContext, fps);
+    entry.threads = 0;
+    entry.busyTime = 0;
+    entry.attached.start();
+
+    // Frame threads add a frame of latency per thread, they only pay off on HD long GOP material.
+    // Intra codecs and SD pictures decode with slice threads
+    const AVCodec* codec = codecContext->codec;
+    entry.frameThreads = codec != NULL && (codec->capabilities & AV_CODEC_CAP_FRAME_THREADS) && codecContext->height > 608;
+    bool sliceThreads = codec != NULL && (codec->capabilities & AV_CODEC_CAP_SLICE_THREADS);
+
+    decoders.insert(decoder, entry);
+    rebalance();
+
+    int threads = decoders.value(decoder).threads;
+    if(entry.frameThreads)
+        codecContext->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+    else if(sliceThreads)
+        codecContext->thread_type = FF_THREAD_SLICE;
+    else threads = 1;
+    codecContext->thread_count = threads;
+
+    LOG4CXX_DEBUG(Logger::getLogger("DecoderScheduler"), name.toStdString() << " " << codecContext->codec_id << " "
+                  << codecContext->width << "x" << codecContext->height << " -> " << threads << (entry.frameThreads ? " frame" : " slice") << " threads");
+    LOG4CXX_DEBUG(Logger::getLogger("DecoderScheduler"), formatStatistics().toStdString());
+
+    mutex.unlock();
+}
+
+void DecoderScheduler::detach(FFDecoder* decoder)
+{
+    mutex.lock();
+
+    if(decoders.contains(decoder))
+    {
+        decoders.remove(decoder);
+        rebalance();
+    }
+
+    mutex.unlock();
+}
+
+// Time spent decoding and converting, used for the CPU share of each port
+void DecoderScheduler::addBusyTime(FFDecoder* decoder, const qint64 nsecs)
+{
+    mutex.lock();
+
+    QMap<FFDecoder*, DecoderEntry>::iterator it = decoders.find(decoder);
+    if(it != decoders.end())
+        it.value().busyTime += nsecs;
+
+    mutex.unlock();
+}
+
+// 0 uses one thread per core
+void DecoderScheduler::setThreadBudget(const int threads)
+{
+    mutex.lock();
+    threadBudget = threads;
+    rebalance();
+    mutex.unlock();
+}
+
+const int DecoderScheduler::getThreadBudget()
+{
+    if(threadBudget > 0)
+        return threadBudget;
+
+    return qMax(QThread::idealThreadCount(), 1);
+}
+
+const QString DecoderScheduler::getStatistics()
+{
+    mutex.lock();
+    QString statistics = formatStatistics();
+    mutex.unlock();
+
+    return statistics;
+}
+
+void DecoderScheduler::rebalance()
+{
+    double totalWeight = 0;
+    for(QMap<FFDecoder*, DecoderEntry>::const_iterator it = decoders.constBegin(); it != decoders.constEnd(); ++it)
+        totalWeight += it.value().weight;
+
+    int budget = getThreadBudget();
+    for(QMap<FFDecoder*, DecoderEntry>::iterator it = decoders.begin(); it != decoders.end(); ++it)
+    {
+        int threads = 1;
+        if(totalWeight > 0)
+            threads = (int)(budget * it.value().weight / totalWeight + 0.5);
+        threads = qBound(1, threads, MAX_DECODER_THREADS);
+
+        if(threads != it.value().threads)
+        {
+            it.value().threads = threads;
+            it.key()->setThreadShare(threads);
+        }
+    }
+}
+
+// Relative decoding cost, a 25 fps SD MPEG-2 picture weights 2
+const double DecoderScheduler::getWeight(const AVCodecContext* codecContext, const double fps)
+{
+    double cost = 1.0;
+    switch(codecContext->codec_id)
+    {
+        case AV_CODEC_ID_H264:
+        case AV_CODEC_ID_HEVC:
+        case AV_CODEC_ID_VP9:
+            cost = 4.0;
+            break;
+        case AV_CODEC_ID_MPEG2VIDEO:
+        case AV_CODEC_ID_MPEG4:
+            cost = 2.0;
+            break;
+        case AV_CODEC_ID_RAWVIDEO:
+        case AV_CODEC_ID_V210:
+            cost = 0.25;
+            break;
+        default:
+            break;
+    }
+
+    double pixels = (double)codecContext->width * codecContext->height / (720.0 * 576.0);
+
+    return cost * qMax(pixels, 0.1) * (fps > 0 ? fps : 25.0) / 25.0;
+}
+
+// CPU share is the part of the busy time of all decoders, load is the number of cores kept busy on average
+const QString DecoderScheduler::formatStatistics()
+{
+    qint64 totalBusy = 0;
+    for(QMap<FFDecoder*, DecoderEntry>::const_iterator it = decoders.constBegin(); it != decoders.constEnd(); ++it)
+        totalBusy += it.value().busyTime;
+
+    QString statistics = "Thread budget: " + QString::number(getThreadBudget());
+    for(QMap<FFDecoder*, DecoderEntry>::const_iterator it = decoders.constBegin(); it != decoders.constEnd(); ++it)
+    {
+        const DecoderEntry& entry = it.value();
+        double share = totalBusy > 0 ? 100.0 * entry.busyTime / totalBusy : 0;
+        qint64 elapsed = entry.attached.nsecsElapsed();
+        double load = elapsed > 0 ? (double)entry.busyTime / elapsed : 0;
+
+        statistics += ", " + entry.name + " weight: " + QString::number(entry.weight, 'f', 2)
+                    + " threads: " + QString::number(entry.threads)
+                    + " CPU share: " + QString::number(share, 'f', 1) + "%"
+                    + " load: " + QString::number(load, 'f', 2);
+    }
+
+    return statistics;
+}
@@ -0,0 +1,114 @@
+#include "decoderstage.h"
+#include "ffdecoder.h"
+
+QMutex StageItem::freeMutex;
+QList<AVPacket*> StageItem::freePackets;
+QList<AVFrame*> StageItem::freeFrames;
+
+void StageItem::release(StageItem& item)
+{
+    if(item.packet != NULL)
+        recyclePacket(item.packet);
+    if(item.frame != NULL)
+        recycleFrame(item.frame);
+}
+
+AVPacket* StageItem::allocatePacket()
+{
+    AVPacket* packet = NULL;
+
+    freeMutex.lock();
+    if(!freePackets.isEmpty())
+        packet = freePackets.takeLast();
+    freeMutex.unlock();
+
+    return packet != NULL ? packet : av_packet_alloc();
+}
+
+AVFrame* StageItem::allocateFrame()
+{
+    AVFrame* frame = NULL;
+
+    freeMutex.lock();
+    if(!freeFrames.isEmpty())
+        frame = freeFrames.takeLast();
+    freeMutex.unlock();
+
+    return frame != NULL ? frame : av_frame_alloc();
+}
+
+void StageItem::recyclePacket(AVPacket*& packet)
+{
+    if(packet == NULL)
+        return;
+
+    av_packet_unref(packet);
+
+    freeMutex.lock();
+    bool kept = freePackets.size() < STAGE_FREE_LIST_SIZE;
+    if(kept)
+        freePackets.append(packet);
+    freeMutex.unlock();
+
+    if(!kept)
+        av_packet_free(&packet);
+    packet = NULL;
+}
+
+void StageItem::recycleFrame(AVFrame*& frame)
+{
+    if(frame == NULL)
+        return;
+
+    av_frame_unref(frame);
+
+    freeMutex.lock();
+    bool kept = freeFrames.size() < STAGE_FREE_LIST_SIZE;
+    if(kept)
+        freeFrames.append(frame);
+    freeMutex.unlock();
+
+    if(!kept)
+        av_frame_free(&frame);
+    frame = NULL;
+}
+
+void StageItem::destroy()
+{
+    freeMutex.lock();
+    while(!freePackets.isEmpty())
+    {
+        AVPacket* packet = freePackets.takeFirst();
+        av_packet_free(&packet);
+    }
+    while(!freeFrames.isEmpty())
+    {
+        AVFrame* frame = freeFrames.takeFirst();
+        av_frame_free(&frame);
+    }
+    freeMutex.unlock();
+}
+
+void FrameSpan::release(FrameSpan* span)
+{
+    if(span != NULL)
+    {
+        AVDecodedFrame::releaseAll(span->frames);
+        delete span;
+    }
+}
+
+DecoderStage::DecoderStage(FFDecoder* decoder, StageType type) : QThread(decoder)
+{
+    this->decoder = decoder;
+    this->type = type;
+}
+
+DecoderStage::~DecoderStage()
+{
+}
+
+void DecoderStage::run()
+{
+    decoder->runStage(type);
+}
@@ -1,7 +1,11 @@
 #include "avdecodedframe.h"
+#include "decoderscheduler.h"
+#include "frameindex.h"
+#include "framepool.h"
 #include "player.h"
 #include "ffdecoder.h"
 
+#include <QElapsedTimer>
 #include <QStringList>
 
 extern "C"
@@ -16,7 +20,12 @@ extern "C"
 
 using namespace log4cxx;
 
-FFDecoder::FFDecoder(Player* player, bool loop) : QThread(player)
+// Reverse spans cover at least this many frames, intra only material would otherwise seek for every frame
+#define REVERSE_SPAN_FRAMES 12
+
+QAtomicInt FFDecoder::generationCounter;
+
+FFDecoder::FFDecoder(Player* player, bool loop) : QThread(player), videoPackets(25), audioPackets(200), videoFrames(4), reverseSpans(1)
 {
     this->player = player;
 
@@ -29,18 +38,41 @@ FFDecoder::FFDecoder(Player* player, bool loop) : QThread(player)
 
     tmpFrame = NULL;
     frameUYVY = NULL;
-    swsContext = NULL;
-
-#ifdef GUI
-    framePreview = NULL;
-    swsContextPreview = NULL;
-#endif
+    scaler = NULL;
+    videoPool = NULL;
+    bufferPool = NULL;
+    passThrough = false;
+    threadShare = 0;
+    coalescedSeeks = 0;
+    endOfFile = false;
+    startMillisecond = AV_NOPTS_VALUE;
+
+    // Generations keep growing across decoders so the buses of a player never see a number twice
+    generation.fetchAndStoreOrdered(generationCounter.fetchAndAddOrdered(1) + 1);
+    demuxGeneration = getGeneration();
+    videoDecodeGeneration = demuxGeneration;
+    videoConvertGeneration = demuxGeneration;
+    audioDecodeGeneration = demuxGeneration;
+
+    frameIndex = NULL;
+    seekTarget = AV_NOPTS_VALUE;
+    cacheTarget = AV_NOPTS_VALUE;
+    seekCue = true;
+    videoSeekTarget = AV_NOPTS_VALUE;
+    videoPublishTarget = AV_NOPTS_VALUE;
+    audioSeekTarget = AV_NOPTS_VALUE;
+    seekDiscarded = 0;
+    seekPending = false;
 
     frameAudio = NULL;
     swrContext = NULL;
+    outputSamples = NULL;
+    outputSamplesCapacity = 0;
 
 #ifdef PORTAUDIO
     swrContextPreview = NULL;
+    previewSamples = NULL;
+    previewSamplesCapacity = 0;
 #endif
 
     filterFrame = NULL;
@@ -48,6 +80,24 @@ FFDecoder::FFDecoder(Player* player, bool loop) : QThread(player)
     buffersinkContext = NULL;
     buffersrcContext = NULL;
 
+    videoDecodeStage = new DecoderStage(this, VIDEO_DECODE_STAGE);
+    videoConvertStage = new DecoderStage(this, VIDEO_CONVERT_STAGE);
+    audioDecodeStage = new DecoderStage(this, AUDIO_DECODE_STAGE);
+
+    videoReverseStage = new DecoderStage(this, VIDEO_REVERSE_STAGE);
+    reversePlayback = false;
+    reverseSpanPending = false;
+    reverseStart = AV_NOPTS_VALUE;
+    reverseEnd = AV_NOPTS_VALUE;
+    videoSpanStart = 0;
+    videoSpanEnd = 0;
+    reverseConvert = false;
+    reverseSpan = NULL;
+    convertOutputClock = AV_NOPTS_VALUE;
+    audioDiscarded = false;
+    monoInterleaver = NULL;
+    audioPacketizer = NULL;
+
     decoding = false;
     this->loop = loop;
     fps = 0.0;
@@ -67,15 +117,67 @@ void FFDecoder::setRate(const double rate)
 void FFDecoder::toggleLoop(const bool loop, const bool active)
 {
     this->loop = loop;
-    if(loop && !decoding && active)
-    {
+
+    // The demuxer waits for a seek once it reached the end of the file
+    if(loop && endOfFile && active)
         seek(0, AVSEEK_FLAG_BACKWARD);
-        decoding = true;
-        start();
-    }
 }
 
+// Trick play decodes a subset of the pictures and repeats them to keep the output cadence
+const bool FFDecoder::isTrickPlay(const double rate)
+{
+    return qAbs(rate) > TRICK_PLAY_RATE + 0.05;
+}
+
+// Up to 4x B frames are skipped, faster shuttles only decode keyframes
+const AVDiscard FFDecoder::getSkipFrame(const double rate)
+{
+    if(!isTrickPlay(rate))
+        return AVDISCARD_DEFAULT;
+
+    return qAbs(rate) > 4.05 ? AVDISCARD_NONKEY : AVDISCARD_NONREF;
+}
+
+// Share of the decoder thread budget, applied to the conversion slices right away
+void FFDecoder::setThreadShare(const int threads)
+{
+    threadShare = threads;
+    if(scaler != NULL)
+        scaler->setSliceCount(threads);
+}
+
+// The convert stage owns the output geometry, a running decoder applies the change before the next generation
 void FFDecoder::changeFormat(const QString& format)
+{
+    if(!isRunning())
+    {
+        applyFormat(format);
+        return;
+    }
+
+    DecoderCommand command;
+    command.type = FORMAT_COMMAND;
+    command.format = format;
+    queueStageCommand(command);
+}
+
+// Replaces the CG overlay, an empty cg removes it. Applied like a format change
+void FFDecoder::setFilter(const QString& cg, const QString& format)
+{
+    if(!isRunning())
+    {
+        applyFilter(cg, format);
+        return;
+    }
+
+    DecoderCommand command;
+    command.type = FILTER_COMMAND;
+    command.cg = cg;
+    command.format = format;
+    queueStageCommand(command);
+}
+
+void FFDecoder::applyFormat(const QString& format)
 {
 	// Video output variables
 	if(format == "PAL" || format == "PAL 16:9")
@@ -96,38 +198,30 @@ void FFDecoder::changeFormat(const QString& format)
 
 	outputFrameSize = (outputWidth * outputHeight) * 2;
 	outputFormat = AV_PIX_FMT_UYVY422;
-	
-#ifdef GUI
-    // Preview variables
-    if(format == "PAL")
-        previewWidth = 360;
-    else previewWidth = 512;
-    previewHeight = videoCodecContext->height == 608 ? 304 : 288;
-    previewOffset = 0;
-    if(previewHeight == 304)
-        previewOffset = 16 * previewWidth;
-    previewFrameSize = (previewWidth * previewHeight - previewOffset) * 4; 
-    previewFormat = AV_PIX_FMT_RGBA;
-#endif
-
-    // Video convert contexts
-	if(swsContext != NULL)
-        sws_freeContext(swsContext);
-    swsContext = NULL;
-    swsContext = sws_getContext(videoCodecContext->width, videoCodecContext->height, videoCodecContext->pix_fmt,
-							outputWidth, outputHeight, outputFormat,
-							SWS_BILINEAR, NULL, NULL, NULL);
-
-#ifdef GUI
-	if(swsContextPreview != NULL)
-        sws_freeContext(swsContextPreview);
-    swsContextPreview = NULL;
-    swsContextPreview = sws_getContext(videoCodecContext->width, videoCodecContext->height, videoCodecContext->pix_fmt,
-							previewWidth, previewHeight, previewFormat,
-							SWS_FAST_BILINEAR, NULL, NULL, NULL);
-#endif
 
-    createFrames(format);
+    // Uncompressed UYVY at the output raster needs no conversion. D10 decodes to planar 4:2:2 and is always converted
+    passThrough = videoCodecContext->pix_fmt == outputFormat && videoCodecContext->width == outputWidth && videoCodecContext->height == outputHeight;
+    if(passThrough)
+        LOG4CXX_DEBUG(Logger::getLogger("FFDecoder"), "Source is UYVY at output size, decoded frames are passed through");
+
+    // Output frames are scaled straight into pooled buffers, keep enough ready for the output queue
+    videoPool = FramePool::getPool(outputFrameSize);
+    if(!passThrough)
+        videoPool->preallocate(10);
+
+    // The preview is derived from the output frames by the video thread
+    player->setPreviewFormat(format, outputWidth, outputHeight);
+
+    // Video convert contexts, the conversion is split in slices over the worker pool
+    if(scaler == NULL)
+        scaler = new SliceScaler();
+    if(threadShare > 0)
+        scaler->setSliceCount(threadShare);
+    scaler->init(videoCodecContext->width, videoCodecContext->height, videoCodecContext->pix_fmt,
+                 outputWidth, outputHeight, outputFormat,
+                 SWS_BILINEAR, format != "720p50" && format != "720p5994");
+
+    createOutputFrame(format);
 }
 
 void FFDecoder::createFrames(const QString& format)
@@ -137,17 +231,17 @@ void FFDecoder::createFrames(const QString& format)
         av_frame_free(&tmpFrame);
     tmpFrame = av_frame_alloc();
 
-#ifdef GUI
-    // Allocate video frame for video preview
-    if(framePreview != NULL)
-        av_frame_free(&framePreview);
-    framePreview = av_frame_alloc();
-    framePreview->width  = previewWidth;
-    framePreview->height = previewHeight;
-    framePreview->format = previewFormat;
-    av_frame_get_buffer(framePreview, 32);
-#endif
+    createOutputFrame(format);
+
+    // Allocate audio frame
+    if(frameAudio != NULL)
+        av_frame_free(&frameAudio);
+    frameAudio = av_frame_alloc();
+}
 
+// Only touched by the convert stage once decoding runs
+void FFDecoder::createOutputFrame(const QString& format)
+{
     // Allocate video frame for output
     if(frameUYVY != NULL)
         av_frame_free(&frameUYVY);
@@ -160,19 +254,10 @@ void FFDecoder::createFrames(const QString& format)
         frameUYVY->interlaced_frame = 1;
         frameUYVY->top_field_first = 1;
     }
-    av_frame_get_buffer(frameUYVY, 32);
-
-    // Allocate audio frame
-    if(frameAudio != NULL)
-        av_frame_free(&frameAudio);
-    frameAudio = av_frame_alloc();
+    // Planes are pointed at pooled frame buffers in decodeVideo
 }
 
-#ifdef DECKLINK
-const int64_t FFDecoder::init(const QString& path, const QString& format, DeckLinkOutput* deckLinkOutput)
-#else
-const int64_t FFDecoder::init(const QString& path, const QString& format)
-#endif
+const int64_t FFDecoder::init(const QString& path, const QString& format, OutputDevice* outputDevice)
 {
     // Open video file
     //if(avformat_open_input(&avFormatContext, "http://docs.gstreamer.com/media/sintel_trailer-480p.webm", NULL, NULL) != 0)
@@ -229,6 +314,21 @@ const int64_t FFDecoder::init(const QString& path, const QString& format)
             AVCodecContext* codecContext = avcodec_alloc_context3(codec);
             avcodec_parameters_to_context(codecContext, codecParameters);
 
+            // Decoded pictures are allocated from our own pools so they can be referenced down the pipeline
+            if(codecType == AVMEDIA_TYPE_VIDEO && (codec->capabilities & AV_CODEC_CAP_DR1))
+            {
+                if(bufferPool == NULL)
+                    bufferPool = new CodecBufferPool();
+                bufferPool->attach(codecContext);
+            }
+
+            // Codec threads come from the budget shared by all ports
+            if(codecType == AVMEDIA_TYPE_VIDEO && videoCodecContext == NULL)
+            {
+                double streamFps = av_q2d(av_guess_frame_rate(avFormatContext, avFormatContext->streams[i], NULL));
+                DecoderScheduler::attach(this, player->getName(), codecContext, streamFps);
+            }
+
             // Open codec
             if(avcodec_open2(codecContext, codec, NULL) < 0)
             {
@@ -248,29 +348,27 @@ const int64_t FFDecoder::init(const QString& path, const QString& format)
                 {
                     QStringList split = QString(timecode->value).split(QRegExp(":|;"));
 
-                    int64_t start_millisecond = split.at(0).toInt() * 1000 * 3600;
-                    start_millisecond += split.at(1).toInt() * 1000 * 60;
-                    start_millisecond += split.at(2).toInt() * 1000;
-                    start_millisecond += split.at(3).toInt() * 1000 / 25;
-
-                    player->setStartMillisecond(start_millisecond);
+                    // Applied by the player once the clip goes on air
+                    startMillisecond = split.at(0).toInt() * 1000 * 3600;
+                    startMillisecond += split.at(1).toInt() * 1000 * 60;
+                    startMillisecond += split.at(2).toInt() * 1000;
+                    startMillisecond += split.at(3).toInt() * 1000 / 25;
                 }
 
                 videoStream = avFormatContext->streams[i];
                 fps = av_q2d(av_guess_frame_rate(avFormatContext, videoStream, NULL));
 
-#ifdef DECKLINK
-                if(deckLinkOutput != NULL)
+                if(outputDevice != NULL)
                 {
                     // Reset adjustment
-                    deckLinkOutput->adjustFPS(1.0);
+                    outputDevice->adjustFPS(1.0);
 
                     // Adjust output according to source file FPS
                     if(format == "PAL" || format == "PAL 16:9" || format == "1080p25" || format == "1080i50")
                     {
                         if(fps != 25.0)
                         {
-                            deckLinkOutput->adjustFPS(fps/25.0);
+                            outputDevice->adjustFPS(fps/25.0);
                             LOG4CXX_WARN(Logger::getLogger("FFDecoder"), "FPS mismatch on file: " + path.toStdString() + " -> " + QString::number(fps).toStdString() + " != 25.0 (Output format: " + format.toStdString() + ")");
                         }
                     }
@@ -278,7 +376,7 @@ const int64_t FFDecoder::init(const QString& path, const QString& format)
                     {
                         if(fps != 50.0)
                         {
-                            deckLinkOutput->adjustFPS(fps/50.0);
+                            outputDevice->adjustFPS(fps/50.0);
                             LOG4CXX_WARN(Logger::getLogger("FFDecoder"), "FPS mismatch on file: " + path.toStdString() + " -> " + QString::number(fps).toStdString() + " != 50.0 (Output format: " + format.toStdString() + ")");
                         }
                     }
@@ -286,7 +384,7 @@ const int64_t FFDecoder::init(const QString& path, const QString& format)
                     {
                         if(fps != 59.94)
                         {
-                            deckLinkOutput->adjustFPS(fps/59.94);
+                            outputDevice->adjustFPS(fps/59.94);
                             LOG4CXX_WARN(Logger::getLogger("FFDecoder"), "FPS mismatch on file: " + path.toStdString() + " -> " + QString::number(fps).toStdString() + " != 59.94 (Output format: " + format.toStdString() + ")");
                         }
                     }
@@ -294,12 +392,11 @@ const int64_t FFDecoder::init(const QString& path, const QString& format)
                     {
                         if(fps != 29.97)
                         {
-                            deckLinkOutput->adjustFPS(fps/29.97);
+                            outputDevice->adjustFPS(fps/29.97);
                             LOG4CXX_WARN(Logger::getLogger("FFDecoder"), "FPS mismatch on file: " + path.toStdString() + " -> " + QString::number(fps).toStdString() + " != 29.97 (Output format: " + format.toStdString() + ")");
                         }
                     }
                 }
-#endif
 
                 if(videoCodecContext->pix_fmt == AV_PIX_FMT_NONE)
                 {
@@ -308,7 +405,7 @@ const int64_t FFDecoder::init(const QString& path, const QString& format)
                     return -1;
                 }
 
-				changeFormat(format);
+				applyFormat(format);
             }
             else if(codecType == AVMEDIA_TYPE_AUDIO && audioCodecContext == NULL && audioStream == NULL)
             {
@@ -336,7 +433,7 @@ const int64_t FFDecoder::init(const QString& path, const QString& format)
                     inputChannelLayout = AV_CH_LAYOUT_STEREO;
                 else if(audioCodecContext->channels == 4)
                     inputChannelLayout = AV_CH_LAYOUT_3POINT1;
-                AVSampleFormat inputSampleFormat = audioCodecContext->channels > 1 ? audioCodecContext->sample_fmt : av_get_planar_sample_fmt(audioCodecContext->sample_fmt);
+                AVSampleFormat inputSampleFormat = audioCodecContext->channels > 1 ? audioCodecContext->sample_fmt : MonoInterleaver::getPlaneFormat(audioCodecContext->sample_fmt);
 
                 // Audio resample context
                 swrContext = swr_alloc();
@@ -381,9 +478,23 @@ const int64_t FFDecoder::init(const QString& path, const QString& format)
     // Create audio and video frames
     this->createFrames(format);
 
+    // Keyframe index used to seek to the right GOP, loaded from the cache or built in the background
+    if(videoStream != NULL)
+    {
+        frameIndex = new FrameIndex(path, videoStream->index);
+        frameIndex->open();
+    }
+
     return duration_ms;
 }
 
+void FFDecoder::applyFilter(const QString& cg, const QString& format)
+{
+    cleanupFilters();
+    if(cg != "")
+        initFilters(cg, format);
+}
+
 const bool FFDecoder::initFilters(const QString& cg, const QString& format)
 {
     QString overlay = videoCodecContext->height == 608 ? "0:32" : "0:0";
@@ -463,81 +574,91 @@ const bool FFDecoder::initFilters(const QString& cg, const QString& format)
 
 void FFDecoder::startDecoding()
 {
+    player->resumeQueues();
+    videoPackets.resume();
+    audioPackets.resume();
+    videoFrames.resume();
+    reverseSpans.resume();
     decoding = true;
 }
 
-int FFDecoder::convertOutput(SwrContext* swrContext, const uint8_t** inputSamples, const int& input_nb_samples, int nb_channels, uint8_t*** outputBuffer)
+// The buffer is only reallocated when a frame needs more samples than any frame before it
+int FFDecoder::convertOutput(SwrContext* swrContext, const uint8_t** inputSamples, const int& input_nb_samples, int nb_channels, uint8_t**& outputBuffer, int& capacity)
 {
-    int64_t dst_nb_samples = av_rescale_rnd(swr_get_delay(swrContext, audioCodecContext->sample_rate) + frameAudio->nb_samples, outputSampleRate, audioCodecContext->sample_rate, AV_ROUND_UP);
+    int64_t dst_nb_samples = av_rescale_rnd(swr_get_delay(swrContext, audioCodecContext->sample_rate) + input_nb_samples, outputSampleRate, audioCodecContext->sample_rate, AV_ROUND_UP);
 
-    int line_size;
-    av_samples_alloc_array_and_samples(outputBuffer, &line_size, nb_channels, dst_nb_samples, outputSampleFormat, 1);
+    if(outputBuffer == NULL || dst_nb_samples > capacity)
+    {
+        freeSamples(outputBuffer, capacity);
+
+        int line_size;
+        if(av_samples_alloc_array_and_samples(&outputBuffer, &line_size, nb_channels, dst_nb_samples, outputSampleFormat, 1) < 0)
+        {
+            outputBuffer = NULL;
+            return 0;
+        }
+        capacity = dst_nb_samples;
+    }
 
-    int ret = swr_convert(swrContext, *outputBuffer, dst_nb_samples, (const uint8_t**)inputSamples, input_nb_samples);
+    int ret = swr_convert(swrContext, outputBuffer, dst_nb_samples, (const uint8_t**)inputSamples, input_nb_samples);
+    if(ret < 0)
+        return 0;
 
     return av_samples_get_buffer_size(NULL, nb_channels, ret, outputSampleFormat, 1);
 }
 
+void FFDecoder::freeSamples(uint8_t**& samples, int& capacity)
+{
+    if(samples != NULL)
+    {
+        av_freep(&samples[0]);
+        av_freep(&samples);
+    }
+    samples = NULL;
+    capacity = 0;
+}
+
 #ifdef PORTAUDIO
 void FFDecoder::pushAudioFrame(const double& sr, const int& data_size, uint8_t** outputBuffer, const int& data_size_preview, uint8_t** previewBuffer)
 #else
 void FFDecoder::pushAudioFrame(const double& sr, const int& data_size, uint8_t** outputBuffer)
 #endif
 {
-    double pts = (double)data_size / sr;
-
-    int64_t diff = pts * 1000.0 + 0.5; // 0.5 is to round up
-
-    AVDecodedFrame* a = new AVDecodedFrame(AVMEDIA_TYPE_AUDIO, outputBuffer[0], data_size, diff, diff);
-    AVDecodedFrame* aVU = new AVDecodedFrame(AVMEDIA_TYPE_AUDIO, outputBuffer[0], data_size, diff, diff);
-
-#ifdef PORTAUDIO
-    pts = (double)data_size_preview / sr;
-    diff = pts * 1000.0 + 0.5;
-    AVDecodedFrame* ap = new AVDecodedFrame(AVMEDIA_TYPE_AUDIO, previewBuffer[0], data_size_preview, diff, diff);
-#endif
-
     LOG4CXX_TRACE(Logger::getLogger("FFDecoder"), "AUDIO -> Start push");
 
-    bool pushed = false;
-    while(!(pushed = player->pushAudioFrame(a)) && decoding)
-        this->usleep(10);
-
-    if(!pushed && !decoding)
-    {
-        if(a != NULL)
-            delete a;
-    }
+    audioPacketizer->append(outputBuffer[0], data_size);
+    pushAudioBlocks();
 
     LOG4CXX_TRACE(Logger::getLogger("FFDecoder"), "AUDIO -> pushAudioFrame");
 
-    while(!(pushed = player->pushAudioFrameVU(aVU)) && decoding)
-        this->usleep(10);
-
-    if(!pushed && !decoding)
-    {
-        if(aVU != NULL)
-            delete aVU;
-    }
-
-    LOG4CXX_TRACE(Logger::getLogger("FFDecoder"), "AUDIO -> pushAudioFrameVU");
-
 #ifdef PORTAUDIO
-    while(!(pushed = player->pushAudioFramePreview(ap)) && decoding)
-        this->usleep(10);
-
-    if(!pushed && !decoding)
+    if(previewBuffer != NULL)
     {
-        if(ap != NULL)
-            delete ap;
+        double pts = (double)data_size_preview / sr;
+        int64_t diff = pts * 1000.0 + 0.5;
+        player->pushAudioFramePreview(AVDecodedFrame::create(AVMEDIA_TYPE_AUDIO, previewBuffer[0], data_size_preview, diff, diff), audioDecodeGeneration);
     }
-#endif
 
     LOG4CXX_TRACE(Logger::getLogger("FFDecoder"), "AUDIO -> pushAudioFramePreview");
+#endif
 
     LOG4CXX_TRACE(Logger::getLogger("FFDecoder"), "AUDIO -> End push");
 }
 
+// Output audio leaves the decoder one video frame at a time, the same frame is shared by the output and the VU meters
+void FFDecoder::pushAudioBlocks()
+{
+    for(const uint8_t* block = audioPacketizer->getBlock(); block != NULL; block = audioPacketizer->getBlock())
+    {
+        int size = audioPacketizer->getBlockSize();
+        double pts = (double)size / sr;
+        int64_t diff = pts * 1000.0 + 0.5; // 0.5 is to round up
+
+        player->pushAudioFrame(AVDecodedFrame::create(AVMEDIA_TYPE_AUDIO, block, size, diff, diff), audioDecodeGeneration);
+        audioPacketizer->next();
+    }
+}
+
 void FFDecoder::run()
 {
     if(avFormatContext != NULL)
@@ -551,117 +672,439 @@ void FFDecoder::run()
         sr = (double)(outputChannelCount * 2 * outputSampleRate);
         bytes_per_sample = av_get_bytes_per_sample(outputSampleFormat) * outputChannelCount;
 
-        inputSamples = NULL;
-        input_linesize = 0;
-        input_nb_samples = 0;
-
-        swrContextMono = NULL;
+        // Mono tracks are gathered from consecutive audio streams
+        monoInterleaver = NULL;
+        if(audioStream != NULL && audioCodecContext->channels == 1)
+        {
+            int tracks = 0;
+            while(tracks < MONO_INTERLEAVER_CHANNELS && audioStream->index + tracks < (int)avFormatContext->nb_streams
+                    && avFormatContext->streams[audioStream->index + tracks]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO
+                    && avFormatContext->streams[audioStream->index + tracks]->codecpar->channels == 1)
+                tracks++;
+
+            monoInterleaver = new MonoInterleaver(tracks, audioCodecContext->sample_fmt, audioCodecContext->sample_rate);
+            LOG4CXX_DEBUG(Logger::getLogger("FFDecoder"), "Interleaving " << tracks << " mono tracks with "
+                          << monoInterleaver->getInstructionSet().toStdString() << " kernels");
+        }
 
+        // Audio is re-chunked to the video frame cadence so the output schedules both in lockstep
+        audioPacketizer = NULL;
         if(audioStream != NULL)
         {
-            if(audioCodecContext->channels == 1)
-            {
-                swrContextMono = swr_alloc();
-
-                av_opt_set_int(swrContextMono, "in_channel_count",  1, 0);
-                av_opt_set_int(swrContextMono, "out_channel_count",  1, 0);
-                av_opt_set_int(swrContextMono, "in_channel_layout",  AV_CH_LAYOUT_MONO, 0);
-                av_opt_set_int(swrContextMono, "out_channel_layout", AV_CH_LAYOUT_MONO,  0);
-                av_opt_set_int(swrContextMono, "in_sample_rate",     audioCodecContext->sample_rate, 0);
-                av_opt_set_int(swrContextMono, "out_sample_rate",    audioCodecContext->sample_rate, 0);
-                av_opt_set_sample_fmt(swrContextMono, "in_sample_fmt",  audioCodecContext->sample_fmt, 0);
-                av_opt_set_sample_fmt(swrContextMono, "out_sample_fmt", audioCodecContext->sample_fmt,  0);
-
-                swr_init(swrContextMono);
-            }
+            AVRational frameRate = videoStream != NULL ? av_guess_frame_rate(avFormatContext, videoStream, NULL) : av_make_q(25, 1);
+            audioPacketizer = new AudioPacketizer(bytes_per_sample, outputSampleRate, frameRate);
         }
 
-        last_audio_index = 0;
-        index = 0;
+        endOfFile = false;
+
+        startStages();
 
+        // The thread lives as long as the clip is loaded, seeks are applied between two packets
         while(decoding)
         {
-            AVPacket packet = { 0 };
+            processCommands();
+
+            if(endOfFile)
+            {
+                commandMutex.lock();
+                if(commands.isEmpty() && decoding)
+                    commandCondition.wait(&commandMutex, 100);
+                commandMutex.unlock();
+                continue;
+            }
+
+            if(reversePlayback)
+            {
+                demuxReverse();
+                continue;
+            }
+
+            AVPacket* packet = StageItem::allocatePacket();
 
-            int ret = av_read_frame(avFormatContext, &packet);
+            int ret = av_read_frame(avFormatContext, packet);
             if(ret >= 0)
             {
-                if(videoStream != NULL && packet.stream_index == videoStream->index)
+                StageQueue* queue = NULL;
+                if(videoStream != NULL && packet->stream_index == videoStream->index)
+                    queue = &videoPackets;
+                else if(audioStream != NULL && avFormatContext->streams[packet->stream_index]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO && !audioDiscarded)
+                    queue = &audioPackets;
+
+                // Keyframe only shuttles never read the packets the decoder would skip
+                bool keyframesOnly = queue == &videoPackets && getSkipFrame(rate) == AVDISCARD_NONKEY;
+                if(keyframesOnly && !(packet->flags & AV_PKT_FLAG_KEY))
+                    queue = NULL;
+                int64_t keyframePts = queue == &videoPackets ? packet->pts : AV_NOPTS_VALUE;
+
+                StageItem item = StageItem();
+                item.packet = packet;
+                item.generation = demuxGeneration;
+
+                // Blocks while the decode stage is behind
+                if(queue == NULL || !queue->push(item))
+                    StageItem::recyclePacket(packet);
+
+                // Jumps to the keyframe standing for the next output frame
+                FrameIndexEntry keyframe;
+                if(keyframesOnly && keyframePts != AV_NOPTS_VALUE && frameIndex != NULL
+                        && frameIndex->findKeyframe(keyframePts + (int64_t)(qAbs(rate) * getFrameDuration()), keyframe) && keyframe.pts > keyframePts)
                 {
-                    decodeVideo(&packet);
-                }
-                else if(audioStream != NULL)
-                {
-                    if(avFormatContext->streams[packet.stream_index]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO)
-                        decodeAudio(&packet);
+                    int64_t timestamp = keyframe.dts != AV_NOPTS_VALUE ? qMin(keyframe.pts, keyframe.dts) : keyframe.pts;
+                    av_seek_frame(avFormatContext, videoStream->index, timestamp, AVSEEK_FLAG_BACKWARD);
                 }
             }
             else
             {
-                if(ret == AVERROR_EOF || ret == AVERROR(EIO) || (videoStream != NULL && totalFrames >= videoStream->duration))
-                {
-                    if(videoStream != NULL && packet.stream_index == videoStream->index)
-                    {
-                        decodeVideo(&packet);
-                    }
-                    else if(audioStream != NULL)
-                    {
-                        if(avFormatContext->streams[packet.stream_index]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO)
-                            decodeAudio(&packet);
-                    }
-                }
+                StageItem::recyclePacket(packet);
 
-                while(!player->pushVideoFrame(NULL) && decoding)
-                    this->usleep(10);
-                while(!player->pushVideoFramePreview(NULL) && decoding)
-                    this->usleep(10);
-                while(!player->pushAudioFrame(NULL) && decoding)
-                    this->usleep(10);
-                while(!player->pushAudioFrameVU(NULL) && decoding)
-                    this->usleep(10);
-#ifdef PORTAUDIO
-                while(!player->pushAudioFramePreview(NULL) && decoding)
-                    this->usleep(10);
-#endif
+                // The stages drain their codecs and signal the end of the stream to every consumer
+                StageItem item = StageItem();
+                item.endOfStream = true;
+                item.generation = demuxGeneration;
+
+                if(videoStream != NULL)
+                    videoPackets.push(item);
+                if(audioStream != NULL)
+                    audioPackets.push(item);
 
                 if(!loop)
-                    decoding = false;
-                else
                 {
-                    lastPTS = 0.0;
-                    totalFrames = 0;
-                    seek(0, AVSEEK_FLAG_BACKWARD);
+                    endOfFile = true;
+                    continue;
                 }
+
+                seekStream(0, AVSEEK_FLAG_BACKWARD);
             }
+        }
+
+        stopStages();
+        decoding = false;
+
+        if(monoInterleaver != NULL)
+            delete monoInterleaver;
+        monoInterleaver = NULL;
+
+        if(audioPacketizer != NULL)
+            delete audioPacketizer;
+        audioPacketizer = NULL;
+
+        LOG4CXX_DEBUG(Logger::getLogger("FFDecoder"), "Frame pools: " << FramePool::getStatistics().toStdString());
+        if(bufferPool != NULL)
+            LOG4CXX_DEBUG(Logger::getLogger("FFDecoder"), "Codec buffers: " << bufferPool->getStatistics().toStdString());
+        LOG4CXX_DEBUG(Logger::getLogger("FFDecoder"), "Decoder threads: " << DecoderScheduler::getStatistics().toStdString());
+        LOG4CXX_DEBUG(Logger::getLogger("FFDecoder"), "Frame queues: " << player->getQueueStatistics().toStdString());
+        LOG4CXX_DEBUG(Logger::getLogger("FFDecoder"), "Stage queues: video packets: " << videoPackets.getStatistics().toStdString()
+                      << ", audio packets: " << audioPackets.getStatistics().toStdString()
+                      << ", video frames: " << videoFrames.getStatistics().toStdString());
+    }
+}
+
+// Mono tracks are interleaved from several streams, samples gathered before a seek and the partial block of the packetizer are dropped
+void FFDecoder::resetAudioSamples()
+{
+    if(monoInterleaver != NULL)
+        monoInterleaver->reset();
+    if(audioPacketizer != NULL)
+        audioPacketizer->reset();
+}
+
+void FFDecoder::startStages()
+{
+    if(videoStream != NULL)
+    {
+        videoDecodeStage->start();
+        videoConvertStage->start();
+        videoReverseStage->start();
+    }
+    if(audioStream != NULL)
+        audioDecodeStage->start();
+}
+
+void FFDecoder::stopStages()
+{
+    // Stages finish on their own after the last end of stream marker or when decoding is stopped
+    videoDecodeStage->wait();
+    videoConvertStage->wait();
+    videoReverseStage->wait();
+    audioDecodeStage->wait();
+
+    videoPackets.clear(StageItem::release);
+    audioPackets.clear(StageItem::release);
+    videoFrames.clear(StageItem::release);
+    reverseSpans.clear(FrameSpan::release);
+
+    FrameSpan::release(reverseSpan);
+    reverseSpan = NULL;
+}
+
+void FFDecoder::runStage(const StageType type)
+{
+    if(type == VIDEO_DECODE_STAGE)
+        runVideoDecode();
+    else if(type == VIDEO_CONVERT_STAGE)
+        runVideoConvert();
+    else if(type == VIDEO_REVERSE_STAGE)
+        runVideoReverse();
+    else if(type == AUDIO_DECODE_STAGE)
+        runAudioDecode();
+}
+
+void FFDecoder::runVideoDecode()
+{
+    while(decoding)
+    {
+        StageItem item;
+        if(!videoPackets.pop(item, 10))
+            continue;
+
+        // Packets demuxed before the latest seek are dropped without decoding
+        if(item.generation < getGeneration())
+        {
+            StageItem::release(item);
+            continue;
+        }
+
+        if(item.generation != videoDecodeGeneration)
+        {
+            // First packet after a seek, the codec still holds pictures from before it
+            avcodec_flush_buffers(videoCodecContext);
+            lastPTS = 0.0;
+            totalFrames = 0;
+            videoSeekTarget = cacheTarget != AV_NOPTS_VALUE ? cacheTarget : seekTarget;
+            seekDiscarded = 0;
+            videoCodecContext->skip_frame = getSkipFrame(rate);
+            videoDecodeGeneration = item.generation;
+        }
+
+        videoSpanStart = item.spanStart;
+        videoSpanEnd = item.spanEnd;
 
-            av_packet_unref(&packet);
+        if(item.endOfSpan)
+        {
+            // The span is read up to its end, drain the codec before the demuxer seeks back
+            decodeVideo(NULL);
+            avcodec_flush_buffers(videoCodecContext);
+            lastPTS = 0.0;
+
+            videoFrames.push(item);
+        }
+        else if(item.endOfStream)
+        {
+            // Drain the frames still buffered in the codec before looping or waiting for a seek
+            decodeVideo(NULL);
+            avcodec_flush_buffers(videoCodecContext);
+            lastPTS = 0.0;
+            totalFrames = 0;
+            videoSeekTarget = AV_NOPTS_VALUE;
+
+            videoFrames.push(item);
         }
+        else
+        {
+            QElapsedTimer timer;
+            timer.start();
+            decodeVideo(item.packet);
+            DecoderScheduler::addBusyTime(this, timer.nsecsElapsed());
+            StageItem::release(item);
+        }
+    }
+}
+
+void FFDecoder::runVideoConvert()
+{
+    while(decoding)
+    {
+        StageItem item;
+        if(!videoFrames.pop(item, 10))
+            continue;
 
-        if(audioSamplesList.empty() && inputSamples != NULL)
+        if(item.generation < getGeneration())
         {
-            av_freep(&inputSamples[0]);
-            av_freep(&inputSamples);
+            StageItem::release(item);
+            continue;
         }
-        inputSamples = NULL;
 
-        while(!audioSamplesList.empty())
+        // The first frame after a seek is shown on the output while paused, unless the seek only refills the frame cache
+        if(item.generation != videoConvertGeneration)
         {
-            AudioSampleArray* sampleArray = audioSamplesList.takeFirst();
-            inputSamples = sampleArray->getSamples();
+            applyStageCommands(item.generation);
+
+            firstDecodedFrame = seekCue;
+            videoPublishTarget = cacheTarget != AV_NOPTS_VALUE ? seekTarget : AV_NOPTS_VALUE;
+            reverseConvert = reversePlayback;
+            FrameSpan::release(reverseSpan);
+            reverseSpan = NULL;
+            convertOutputClock = AV_NOPTS_VALUE;
+            videoConvertGeneration = item.generation;
+        }
 
-            if(inputSamples != NULL)
+        if(item.endOfSpan || (item.endOfStream && reverseConvert))
+            pushReverseSpan(item.endOfStream);
+        else if(item.endOfStream)
+            player->pushVideoFrame(NULL, item.generation);
+        else
+        {
+            // Frames of the window before the seek target are converted for the frame cache only
+            bool publish = !isBeforeSeekTarget(item.frame, videoStream, videoPublishTarget);
+            if(publish)
+                videoPublishTarget = AV_NOPTS_VALUE;
+
+            QElapsedTimer timer;
+            timer.start();
+            convertVideo(item.frame, item.pts, item.diff, publish);
+            DecoderScheduler::addBusyTime(this, timer.nsecsElapsed());
+            StageItem::release(item);
+        }
+    }
+}
+
+// Hands a complete span to the reverse stage, blocks while the previous span is still being published
+void FFDecoder::pushReverseSpan(const bool endOfStream)
+{
+    if(reverseSpan == NULL)
+        appendReverseFrame(NULL);
+
+    reverseSpan->endOfStream = endOfStream;
+    if(!reverseSpans.push(reverseSpan))
+        FrameSpan::release(reverseSpan);
+    reverseSpan = NULL;
+}
+
+void FFDecoder::appendReverseFrame(AVDecodedFrame* v)
+{
+    if(reverseSpan == NULL)
+    {
+        reverseSpan = new FrameSpan();
+        reverseSpan->endOfStream = false;
+        reverseSpan->cue = firstDecodedFrame;
+        reverseSpan->generation = videoConvertGeneration;
+        firstDecodedFrame = false;
+    }
+
+    if(v != NULL)
+        reverseSpan->frames.append(v);
+}
+
+// Publishes the spans last frame first, a newer seek stops the span being published
+void FFDecoder::runVideoReverse()
+{
+    int generation = 0;
+    int64_t outputClock = AV_NOPTS_VALUE;
+
+    while(decoding)
+    {
+        FrameSpan* span = NULL;
+        if(!reverseSpans.pop(span, 10))
+            continue;
+
+        if(span->generation != generation)
+        {
+            generation = span->generation;
+            outputClock = AV_NOPTS_VALUE;
+        }
+
+        while(!span->frames.isEmpty() && decoding && span->generation >= getGeneration())
+        {
+            AVDecodedFrame* v = span->frames.takeLast();
+            if(span->cue)
             {
-                av_freep(&inputSamples[0]);
-                av_freep(&inputSamples);
+                player->setRecueBuffers(v);
+                span->cue = false;
             }
+            publishVideoFrame(v, span->generation, outputClock);
+        }
+
+        if(span->endOfStream && decoding && span->generation >= getGeneration())
+            player->pushVideoFrame(NULL, span->generation);
 
-            delete sampleArray;
-            inputSamples = NULL;
+        FrameSpan::release(span);
+    }
+}
+
+// In trick play every output frame stands for rate frames of media. Each picture is published for the
+// output frames elapsed since the previous one, pictures closer than an output frame are dropped
+void FFDecoder::publishVideoFrame(AVDecodedFrame* v, const int generation, int64_t& outputClock)
+{
+    if(!isTrickPlay(rate) || fps <= 0)
+    {
+        player->pushVideoFrame(v, generation);
+        return;
+    }
+
+    int64_t clock = v->getClockPTS() * 1000;
+    int64_t step = (int64_t)(qAbs(rate) * 1000000.0 / fps);
+    int direction = rate < 0 ? -1 : 1;
+    int maxRepeat = qMax((int)fps, 1);
+
+    // Restart the cadence after a loop or a jump of more than a second
+    int64_t distance = (clock - outputClock) * direction;
+    if(outputClock == AV_NOPTS_VALUE || distance < -step * maxRepeat || distance > step * maxRepeat)
+    {
+        outputClock = clock;
+        distance = 0;
+    }
+
+    int repeat = (int)((distance + step) / (double)step + 0.5);
+    if(repeat <= 0)
+    {
+        v->release();
+        return;
+    }
+    outputClock += direction * repeat * step;
+
+    for(int i=1; i<repeat; i++)
+    {
+        v->ref();
+        player->pushVideoFrame(v, generation);
+    }
+    player->pushVideoFrame(v, generation);
+}
+
+void FFDecoder::runAudioDecode()
+{
+    while(decoding)
+    {
+        StageItem item;
+        if(!audioPackets.pop(item, 10))
+            continue;
+
+        if(item.generation < getGeneration())
+        {
+            StageItem::release(item);
+            continue;
         }
 
-        if(swrContextMono != NULL)
-            swr_free(&swrContextMono);
-        swrContextMono = NULL;
+        if(item.generation != audioDecodeGeneration)
+        {
+            avcodec_flush_buffers(audioCodecContext);
+            audioSeekTarget = seekTarget;
+            resetAudioSamples();
+            audioDecodeGeneration = item.generation;
+        }
+
+        if(item.endOfStream)
+        {
+            avcodec_flush_buffers(audioCodecContext);
+            audioSeekTarget = AV_NOPTS_VALUE;
+
+            // The last block is completed with silence, the cadence restarts with the next loop
+            audioPacketizer->flush();
+            pushAudioBlocks();
+            audioPacketizer->reset();
+
+            player->pushAudioFrame(NULL, audioDecodeGeneration);
+#ifdef PORTAUDIO
+            player->pushAudioFramePreview(NULL, audioDecodeGeneration);
+#endif
+        }
+        else
+        {
+            QElapsedTimer timer;
+            timer.start();
+            decodeAudio(item.packet);
+            DecoderScheduler::addBusyTime(this, timer.nsecsElapsed());
+            StageItem::release(item);
+        }
     }
 }
 
@@ -686,100 +1129,135 @@ void FFDecoder::decodeVideo(AVPacket* packet)
             return;
         }
 
+        // Frames outside a reverse span are decoded again with the span they present in
+        if(videoSpanEnd > videoSpanStart)
+        {
+            int64_t timestamp = av_frame_get_best_effort_timestamp(tmpFrame);
+            if(timestamp == AV_NOPTS_VALUE || timestamp < videoSpanStart || timestamp >= videoSpanEnd)
+            {
+                seekDiscarded++;
+                continue;
+            }
+        }
+
+        // Frames decoded from the keyframe up to a seek target are only references, they are never converted or queued
+        if(isBeforeSeekTarget(tmpFrame, videoStream, videoSeekTarget))
+        {
+            seekDiscarded++;
+            continue;
+        }
+        videoSeekTarget = AV_NOPTS_VALUE;
+
         totalFrames++;
         double pts = 0.0;
 
-        if(packet->dts != AV_NOPTS_VALUE)
+        if(packet == NULL || packet->dts != AV_NOPTS_VALUE)
             pts = av_frame_get_best_effort_timestamp(tmpFrame);
         else pts = 0;
 
-        pts -= avFormatContext->start_time;
+        pts -= getStreamStart(videoStream);
         pts *= videoTB;
         pts += tmpFrame->repeat_pict * fpsx2;
 
         int64_t diff = (pts - lastPTS) * 1000.0 + 0.5; // 0.5 is to round up
-        if(lastPTS == 0.0)
+        if(lastPTS == 0.0 || videoSpanEnd > videoSpanStart)
             diff = 1000.0 / fps;
 
-        diff /= rate;
+        // Trick play pictures are repeated for every output frame, each one lasts a frame
+        if(isTrickPlay(rate))
+            diff = 1000.0 / fps;
+        else diff /= qAbs(rate);
         lastPTS = pts;
 
-        // Add the frame to the filtergraph
-        if(filterFrame != NULL)
-            av_buffersrc_add_frame_flags(buffersrcContext, tmpFrame, AV_BUFFERSRC_FLAG_KEEP_REF);
+        // Hand the decoded picture over to the conversion stage
+        StageItem item = StageItem();
+        item.frame = StageItem::allocateFrame();
+        item.pts = pts;
+        item.diff = diff;
+        item.generation = videoDecodeGeneration;
+        av_frame_move_ref(item.frame, tmpFrame);
 
-        while(true)
-        {
-            AVFrame* scaleFrame = tmpFrame;
-            if(filterFrame != NULL)
-            {
-                scaleFrame = filterFrame;
+        if(!videoFrames.push(item))
+            StageItem::release(item);
+    }
+}
 
-                if(av_buffersink_get_frame(buffersinkContext, filterFrame) < 0)
-                    break;
-            }
+void FFDecoder::convertVideo(AVFrame* frame, const double pts, const int64_t diff, const bool publish)
+{
+    // Add the frame to the filtergraph
+    if(filterFrame != NULL)
+        av_buffersrc_add_frame_flags(buffersrcContext, frame, AV_BUFFERSRC_FLAG_KEEP_REF);
 
-#if defined(DECKLINK) || defined(GUI)
-            double pts_ms = pts * 1000;
-#endif
-            AVDecodedFrame* v = NULL;
+    while(true)
+    {
+        AVFrame* scaleFrame = frame;
+        if(filterFrame != NULL)
+        {
+            scaleFrame = filterFrame;
 
-#ifdef DECKLINK
-            sws_scale(swsContext, scaleFrame->data, scaleFrame->linesize, 0, videoCodecContext->height, frameUYVY->data, frameUYVY->linesize);
-            v = new AVDecodedFrame(AVMEDIA_TYPE_VIDEO, frameUYVY->data[0], outputFrameSize, diff, pts_ms);
-#endif
+            if(av_buffersink_get_frame(buffersinkContext, filterFrame) < 0)
+                break;
+        }
 
-            AVDecodedFrame* vp = NULL;
-#ifdef GUI
-            sws_scale(swsContextPreview, scaleFrame->data, scaleFrame->linesize, 0, videoCodecContext->height, framePreview->data, framePreview->linesize);
-            vp = new AVDecodedFrame(AVMEDIA_TYPE_VIDEO, framePreview->data[0] + previewOffset, previewFrameSize, diff, pts_ms);
-#endif
+        double pts_ms = pts * 1000;
+
+        // One output frame is published to every video consumer, the preview is derived from it.
+        // Pass through frames are only shared when the decoder laid the rows out contiguously
+        AVDecodedFrame* v = NULL;
+        if(passThrough && scaleFrame->buf[0] != NULL && scaleFrame->format == outputFormat
+                && scaleFrame->width == outputWidth && scaleFrame->height == outputHeight && scaleFrame->linesize[0] == outputWidth * 2)
+        {
+            v = AVDecodedFrame::wrap(AVMEDIA_TYPE_VIDEO, scaleFrame, outputFrameSize, diff, pts_ms);
+        }
+        else
+        {
+            v = videoPool->acquire(AVMEDIA_TYPE_VIDEO, outputFrameSize, diff, pts_ms);
+            av_image_fill_arrays(frameUYVY->data, frameUYVY->linesize, v->getWritableBuffer(), outputFormat, outputWidth, outputHeight, 1);
+            scaler->scale(scaleFrame->data, scaleFrame->linesize, frameUYVY->data, frameUYVY->linesize);
+        }
 
+        if(!publish)
+            player->cacheVideoFrame(v);
+        else if(reverseConvert)
+            appendReverseFrame(v);
+        else
+        {
             if(firstDecodedFrame)
             {
-                player->setRecueBuffers(v, vp);
+                player->setRecueBuffers(v);
                 firstDecodedFrame = false;
             }
 
             LOG4CXX_TRACE(Logger::getLogger("FFDecoder"), "VIDEO -> Start push");
 
-            bool pushed = false;
-
-            while(!(pushed = player->pushVideoFrame(v)) && decoding)
-                this->usleep(10);
-
-            if(!pushed && !decoding)
-            {
-                if(v != NULL)
-                    delete v;
-            }
-
-            LOG4CXX_TRACE(Logger::getLogger("FFDecoder"), "VIDEO -> pushVideoFrame");
-
-            while(!(pushed = player->pushVideoFramePreview(vp)) && decoding)
-                this->usleep(10);
-
-            if(!pushed && !decoding)
-            {
-                if(vp != NULL)
-                    delete vp;
-            }
-
-            LOG4CXX_TRACE(Logger::getLogger("FFDecoder"), "VIDEO -> pushVideoFramePreview");
+            publishVideoFrame(v, videoConvertGeneration, convertOutputClock);
 
             LOG4CXX_TRACE(Logger::getLogger("FFDecoder"), "VIDEO -> End push");
 
-            if(filterFrame != NULL)
-                av_frame_unref(filterFrame);
-            else break;
+            // The timer is restarted by seeks on the player thread
+            commandMutex.lock();
+            bool firstAfterSeek = seekPending;
+            seekPending = false;
+            qint64 seekLatency = seekTimer.elapsed();
+            commandMutex.unlock();
+
+            if(firstAfterSeek)
+                LOG4CXX_DEBUG(Logger::getLogger("FFDecoder"), "Seek: first frame at " << (int64_t)pts_ms << " ms published after " << seekLatency
+                              << " ms, " << seekDiscarded << " frames discarded");
         }
 
-        av_frame_unref(tmpFrame);
+        if(filterFrame != NULL)
+            av_frame_unref(filterFrame);
+        else break;
     }
 }
 
 void FFDecoder::decodeAudio(AVPacket* packet)
 {
+    // Packets queued before a rate change are dropped undecoded, the next seek flushes the codec
+    if(rate != 1.0)
+        return;
+
     int ret;
     ret = avcodec_send_packet(audioCodecContext, packet);
     if (ret < 0)
@@ -799,186 +1277,444 @@ void FFDecoder::decodeAudio(AVPacket* packet)
             return;
         }
 
-        if(rate == 1.0)
+        // Audio decoded from the keyframe before a seek target is dropped with the video
+        if(isBeforeSeekTarget(frameAudio, avFormatContext->streams[packet->stream_index], audioSeekTarget))
+            continue;
+
+        if(packet->stream_index == audioStream->index)
         {
-            if(packet->stream_index == audioStream->index)
-            {
-                uint8_t** outputBuffer = NULL;
-                int data_size = 0;
+            uint8_t** outputBuffer = NULL;
+            int data_size = 0;
 
-                if(audioCodecContext->channels > 1)
+            if(audioCodecContext->channels > 1)
+            {
+                if(frameAudio->format != outputSampleFormat || audioCodecContext->channels != outputChannelCount)
                 {
-                    if(frameAudio->format != outputSampleFormat || audioCodecContext->channels != outputChannelCount)
-                        data_size = convertOutput(swrContext, (const uint8_t**)frameAudio->extended_data, frameAudio->nb_samples, outputChannelCount, &outputBuffer);
-                    else
-                    {
-                        data_size = frameAudio->nb_samples * bytes_per_sample;
-                        outputBuffer = frameAudio->extended_data;
-                    }
+                    data_size = convertOutput(swrContext, (const uint8_t**)frameAudio->extended_data, frameAudio->nb_samples, outputChannelCount, outputSamples, outputSamplesCapacity);
+                    outputBuffer = outputSamples;
+                }
+                else
+                {
+                    data_size = frameAudio->nb_samples * bytes_per_sample;
+                    outputBuffer = frameAudio->extended_data;
+                }
 #ifdef PORTAUDIO
-                    uint8_t** previewBuffer = NULL;
-                    int data_size_preview = convertOutput(swrContextPreview, (const uint8_t**)frameAudio->extended_data, frameAudio->nb_samples, 2, &previewBuffer);
-                    pushAudioFrame(sr, data_size, outputBuffer, data_size_preview, previewBuffer);
-
-                    av_freep(&previewBuffer[0]);
-                    av_freep(&previewBuffer);
+                uint8_t** previewBuffer = NULL;
+                int data_size_preview = 0;
+                if(player->hasAudioPreview())
+                {
+                    data_size_preview = convertOutput(swrContextPreview, (const uint8_t**)frameAudio->extended_data, frameAudio->nb_samples, 2, previewSamples, previewSamplesCapacity);
+                    previewBuffer = previewSamples;
+                }
+                pushAudioFrame(sr, data_size, outputBuffer, data_size_preview, previewBuffer);
 #else
-                    pushAudioFrame(sr, data_size, outputBuffer);
+                pushAudioFrame(sr, data_size, outputBuffer);
 #endif
+            }
+            else if(monoInterleaver != NULL)
+                interleaveMono(packet->stream_index - audioStream->index);
+        }
+        else if(audioCodecContext->channels == 1 && monoInterleaver != NULL)
+            interleaveMono(packet->stream_index - audioStream->index);
+    }
+}
 
-                    if(frameAudio->format != outputSampleFormat || audioCodecContext->channels != outputChannelCount)
-                    {
-                        av_freep(&outputBuffer[0]);
-                        av_freep(&outputBuffer);
-                    }
-                }
-                else if(swrContextMono != NULL)
-                {
-                    if(last_audio_index != packet->stream_index)
-                        index = 0;
-
-                    if(last_audio_index == packet->stream_index)
-                    {
-                        audioSamplesList.append(new AudioSampleArray(inputSamples, input_linesize, input_nb_samples));
-                        inputSamples = NULL;
-                    }
+// Gathers a decoded mono frame and pushes the samples every track has delivered, already interleaved to the output format
+void FFDecoder::interleaveMono(const int track)
+{
+    monoInterleaver->append(track, frameAudio);
 
-                    if(inputSamples == NULL)
-                    {
-                        av_samples_alloc_array_and_samples(&inputSamples, &input_linesize, outputChannelCount, frameAudio->nb_samples, av_get_planar_sample_fmt(audioCodecContext->sample_fmt), 1);
-                        input_nb_samples = input_linesize / av_get_bytes_per_sample(audioCodecContext->sample_fmt);
-                        swr_convert(swrContextMono, &inputSamples[packet->stream_index - audioStream->index], input_linesize, (const uint8_t**)frameAudio->extended_data, frameAudio->nb_samples);
-                    }
-                    else
-                    {
-                        while(!audioSamplesList.empty())
-                        {
-                            AudioSampleArray* sampleArray = audioSamplesList.takeFirst();
-                            inputSamples = sampleArray->getSamples();
-                            input_linesize = sampleArray->getLinesize();
-                            input_nb_samples = sampleArray->getNbSamples();
+    int count = monoInterleaver->getAvailable();
+    if(count == 0)
+        return;
 
-                            data_size = convertOutput(swrContext, (const uint8_t**)inputSamples, input_nb_samples, outputChannelCount, &outputBuffer);
+    uint8_t* outputBuffer = monoInterleaver->interleave(count);
+    int data_size = count * bytes_per_sample;
 
 #ifdef PORTAUDIO
-                            uint8_t** previewBuffer = NULL;
-                            int data_size_preview = convertOutput(swrContextPreview, (const uint8_t**)inputSamples, input_nb_samples, 2, &previewBuffer);
-                            pushAudioFrame(sr, data_size, outputBuffer, data_size_preview, previewBuffer);
-
-                            av_freep(&previewBuffer[0]);
-                            av_freep(&previewBuffer);
+    uint8_t** previewBuffer = NULL;
+    int data_size_preview = 0;
+    if(player->hasAudioPreview())
+    {
+        data_size_preview = convertOutput(swrContextPreview, monoInterleaver->getPlanes(), count, 2, previewSamples, previewSamplesCapacity);
+        previewBuffer = previewSamples;
+    }
+    pushAudioFrame(sr, data_size, &outputBuffer, data_size_preview, previewBuffer);
 #else
-                            pushAudioFrame(sr, data_size, outputBuffer);
+    pushAudioFrame(sr, data_size, &outputBuffer);
 #endif
 
-                            av_freep(&outputBuffer[0]);
-                            av_freep(&outputBuffer);
+    monoInterleaver->consume(count);
+}
 
-                            av_freep(&inputSamples[0]);
-                            av_freep(&inputSamples);
+void FFDecoder::stopDecoding()
+{
+    decoding = false;
 
-                            delete sampleArray;
-                            inputSamples = NULL;
-                        }
+    commandMutex.lock();
+    commandCondition.wakeAll();
+    commandMutex.unlock();
 
-                        av_samples_alloc_array_and_samples(&inputSamples, &input_linesize, outputChannelCount, frameAudio->nb_samples, av_get_planar_sample_fmt(audioCodecContext->sample_fmt), 1);
-                        input_nb_samples = input_linesize / av_get_bytes_per_sample(audioCodecContext->sample_fmt);
-                        swr_convert(swrContextMono, &inputSamples[packet->stream_index - audioStream->index], input_linesize, (const uint8_t**)frameAudio->extended_data, frameAudio->nb_samples);
-                    }
-                }
-            }
-            else
-            {
-                if(audioCodecContext->channels == 1 && swrContextMono != NULL)
-                {
-                    if(last_audio_index != packet->stream_index)
-                        index = 0;
+    // Wakes the demuxer and the stages if they are blocked on a full queue
+    player->abortQueues();
+    videoPackets.abort();
+    audioPackets.abort();
+    videoFrames.abort();
+    reverseSpans.abort();
+    this->wait();
+}
 
-                    if(last_audio_index == audioStream->index)
-                        audioSamplesList.append(new AudioSampleArray(inputSamples, input_linesize, input_nb_samples));
+// Queues a seek for the demuxer and returns its generation, a reserved one if given. A seek still pending is
+// replaced, back to back seeks from a jog wheel only decode the latest target
+const int FFDecoder::seek(const int64_t pos, const int seek_flag, const int64_t cacheFrom, const bool cue, const int generation)
+{
+    commandMutex.lock();
+
+    DecoderCommand command;
+    command.type = SEEK_COMMAND;
+    command.pos = pos;
+    command.seekFlag = seek_flag;
+    command.cacheFrom = cacheFrom;
+    command.cue = cue;
+    command.generation = generation > 0 ? generation : reserveGeneration();
+    this->generation.fetchAndStoreOrdered(command.generation);
+
+    if(!commands.isEmpty() && commands.last().type == SEEK_COMMAND)
+    {
+        commands.last() = command;
+        coalescedSeeks++;
+    }
+    else commands.append(command);
 
-                    if(last_audio_index == packet->stream_index || index == 0)
-                    {
-                        inputSamples = NULL;
+    // Seek to first frame latency, logged when the target frame is published
+    seekTimer.start();
+    seekPending = true;
 
-                        if(!audioSamplesList.empty() && index < audioSamplesList.size())
-                        {
-                            AudioSampleArray* sampleArray = audioSamplesList.at(index++);
-                            inputSamples = sampleArray->getSamples();
-                            input_linesize = sampleArray->getLinesize();
-                            input_nb_samples = sampleArray->getNbSamples();
-                        }
+    commandCondition.wakeAll();
+    commandMutex.unlock();
 
-                        if(inputSamples == NULL)
-                        {
-                            av_samples_alloc_array_and_samples(&inputSamples, &input_linesize, outputChannelCount, frameAudio->nb_samples, av_get_planar_sample_fmt(audioCodecContext->sample_fmt), 1);
-                            input_nb_samples = input_linesize / av_get_bytes_per_sample(audioCodecContext->sample_fmt);
-                        }
-                    }
+    return command.generation;
+}
 
-                    if(inputSamples != NULL)
-                        swr_convert(swrContextMono, &inputSamples[packet->stream_index - audioStream->index], input_linesize, (const uint8_t**)frameAudio->extended_data, frameAudio->nb_samples);
-                }
-            }
+const int FFDecoder::getGeneration() const
+{
+    return const_cast<QAtomicInt&>(generation).fetchAndAddAcquire(0);
+}
 
-            last_audio_index = packet->stream_index;
-        }
+// Lets the player flush its buses to a generation before the seek carrying it is queued
+const int FFDecoder::reserveGeneration()
+{
+    return generationCounter.fetchAndAddOrdered(1) + 1;
+}
+
+// Start timecode of the clip in milliseconds, AV_NOPTS_VALUE if the file has none
+const int64_t FFDecoder::getStartMillisecond() const
+{
+    return startMillisecond;
+}
+
+const bool FFDecoder::hasAudio() const
+{
+    return audioStream != NULL;
+}
+
+// Runs in the demuxer thread between two packets
+void FFDecoder::processCommands()
+{
+    commandMutex.lock();
+    QList<DecoderCommand> pending = commands;
+    commands.clear();
+    commandMutex.unlock();
+
+    for(int i=0; i<pending.size(); i++)
+    {
+        if(pending[i].type == SEEK_COMMAND)
+            applySeek(pending[i]);
     }
+
+    // Rate changes are also picked up without a seek
+    discardAudio(rate != 1.0);
 }
 
-void FFDecoder::stopDecoding()
+// Tagged with the generation it was queued in, the player seeks after queueing it
+void FFDecoder::queueStageCommand(DecoderCommand& command)
 {
-    decoding = false;
-    this->wait();
+    commandMutex.lock();
+    command.generation = getGeneration();
+    stageCommands.append(command);
+    commandMutex.unlock();
 }
 
-void FFDecoder::seek(const int64_t pos, const int seek_flag)
+// Runs in the convert stage before the first frame of a new generation
+void FFDecoder::applyStageCommands(const int generation)
 {
-    if(videoStream != NULL)
+    commandMutex.lock();
+    QList<DecoderCommand> pending;
+    while(!stageCommands.isEmpty() && stageCommands.first().generation < generation)
+        pending.append(stageCommands.takeFirst());
+    commandMutex.unlock();
+
+    for(int i=0; i<pending.size(); i++)
+    {
+        if(pending[i].type == FORMAT_COMMAND)
+            applyFormat(pending[i].format);
+        else if(pending[i].type == FILTER_COMMAND)
+            applyFilter(pending[i].cg, pending[i].format);
+    }
+}
+
+// Decoding always restarts from the keyframe before pos, the stages flush their codecs when the
+// first item of the new generation reaches them and drop what comes before pos
+void FFDecoder::applySeek(const DecoderCommand& command)
+{
+    videoPackets.clear(StageItem::release);
+    audioPackets.clear(StageItem::release);
+    videoFrames.clear(StageItem::release);
+
+    reverseSpans.clear(FrameSpan::release);
+
+    seekTarget = command.pos;
+    cacheTarget = command.cacheFrom != AV_NOPTS_VALUE && command.cacheFrom < command.pos ? qMax(command.cacheFrom, (int64_t)0) : AV_NOPTS_VALUE;
+    seekCue = command.cue;
+    demuxGeneration = command.generation;
+    endOfFile = false;
+
+    // Audio is only played at 1x, the audio stage flushes its codec when the new generation reaches it
+    discardAudio(rate != 1.0);
+
+    // Negative rates play backwards from pos, the first span ends half a frame after it
+    reversePlayback = rate < 0 && videoStream != NULL;
+    if(reversePlayback)
+    {
+        seekTarget = AV_NOPTS_VALUE;
+        cacheTarget = AV_NOPTS_VALUE;
+        reverseEnd = toStreamTime(command.pos, videoStream) + getFrameDuration() / 2;
+        reverseSpanPending = true;
+
+        LOG4CXX_DEBUG(Logger::getLogger("FFDecoder"), "Reverse from " << command.pos << " ms, generation " << command.generation);
+        return;
+    }
+
+    // Decoding starts from the keyframe before the cache window
+    int64_t pos = cacheTarget != AV_NOPTS_VALUE ? cacheTarget : command.pos;
+
+    FrameIndexEntry keyframe;
+    if(videoStream != NULL && frameIndex != NULL && frameIndex->findKeyframe(toStreamTime(pos, videoStream), keyframe))
+    {
+        // Demuxers index by dts or pts, the smaller one never lands after the keyframe
+        int64_t timestamp = keyframe.dts != AV_NOPTS_VALUE ? qMin(keyframe.pts, keyframe.dts) : keyframe.pts;
+        av_seek_frame(avFormatContext, videoStream->index, timestamp, AVSEEK_FLAG_BACKWARD);
+
+        avio_flush(avFormatContext->pb);
+        avformat_flush(avFormatContext);
+    }
+    else seekStream(pos, command.seekFlag | AVSEEK_FLAG_BACKWARD);
+
+    LOG4CXX_DEBUG(Logger::getLogger("FFDecoder"), "Seek to " << command.pos << " ms, generation " << command.generation
+                  << ", " << coalescedSeeks << " seeks coalesced so far");
+}
+
+// One step of reverse demuxing. Each span is read forwards from a keyframe until the packets only present
+// after its end, then the demuxer seeks to the keyframe of the span before it
+void FFDecoder::demuxReverse()
+{
+    if(reverseSpanPending)
+    {
+        startReverseSpan();
+        return;
+    }
+
+    AVPacket* packet = StageItem::allocatePacket();
+    int ret = av_read_frame(avFormatContext, packet);
+
+    // Audio is not played backwards
+    if(ret >= 0 && packet->stream_index != videoStream->index)
+    {
+        StageItem::recyclePacket(packet);
+        return;
+    }
+
+    // The span starts at the first keyframe after the seek, the packets before it can not be decoded
+    if(ret >= 0 && reverseStart == AV_NOPTS_VALUE && (!(packet->flags & AV_PKT_FLAG_KEY) || packet->pts == AV_NOPTS_VALUE))
+    {
+        StageItem::recyclePacket(packet);
+        return;
+    }
+    if(ret >= 0 && reverseStart == AV_NOPTS_VALUE)
+        reverseStart = packet->pts;
+
+    // No keyframe before the end of the span, the start of the file is reached
+    if(reverseStart == AV_NOPTS_VALUE || reverseStart >= reverseEnd)
     {
-        AVRational tb;
-        tb.den = 1000;
-        tb.num = 1;
+        StageItem::recyclePacket(packet);
 
-        av_seek_frame(avFormatContext, videoStream->index, av_rescale_q(pos, tb, videoStream->time_base), seek_flag);
+        StageItem item = StageItem();
+        item.endOfStream = true;
+        item.generation = demuxGeneration;
+        videoPackets.push(item);
+
+        endOfFile = true;
+        return;
     }
 
-    for(int i=0; i<codecContextList.count(); i++)
+    // Decode order timestamps never decrease, once past the end no packet presents inside the span anymore
+    int64_t timestamp = ret >= 0 ? (packet->dts != AV_NOPTS_VALUE ? packet->dts : packet->pts) : AV_NOPTS_VALUE;
+    if(ret < 0 || (timestamp != AV_NOPTS_VALUE && timestamp >= reverseEnd))
     {
-        avcodec_flush_buffers(codecContextList[i]);
+        StageItem::recyclePacket(packet);
+
+        StageItem item = StageItem();
+        item.endOfSpan = true;
+        item.spanStart = reverseStart;
+        item.spanEnd = reverseEnd;
+        item.generation = demuxGeneration;
+        videoPackets.push(item);
+
+        reverseEnd = reverseStart;
+        reverseSpanPending = true;
+        return;
     }
 
+    // Keyframe only shuttles never queue the packets the decoder would skip
+    if(getSkipFrame(rate) == AVDISCARD_NONKEY && !(packet->flags & AV_PKT_FLAG_KEY))
+    {
+        StageItem::recyclePacket(packet);
+        return;
+    }
+
+    StageItem item = StageItem();
+    item.packet = packet;
+    item.spanStart = reverseStart;
+    item.spanEnd = reverseEnd;
+    item.generation = demuxGeneration;
+
+    if(!videoPackets.push(item))
+        StageItem::recyclePacket(packet);
+}
+
+// Seeks to the keyframe at least REVERSE_SPAN_FRAMES before the end of the next span
+void FFDecoder::startReverseSpan()
+{
+    reverseSpanPending = false;
+    reverseStart = AV_NOPTS_VALUE;
+
+    int64_t target = reverseEnd - qMax(REVERSE_SPAN_FRAMES, (int)qAbs(rate)) * getFrameDuration();
+
+    FrameIndexEntry keyframe;
+    if(frameIndex != NULL && frameIndex->findKeyframe(target, keyframe))
+        target = keyframe.dts != AV_NOPTS_VALUE ? qMin(keyframe.pts, keyframe.dts) : keyframe.pts;
+
+    // Before the first keyframe there is only the first one left
+    if(av_seek_frame(avFormatContext, videoStream->index, target, AVSEEK_FLAG_BACKWARD) < 0)
+        av_seek_frame(avFormatContext, videoStream->index, target, 0);
+
+    avio_flush(avFormatContext->pb);
+    avformat_flush(avFormatContext);
+}
+
+// Start time of the file in the time base of stream, the clip clock counts from there
+const int64_t FFDecoder::getStreamStart(const AVStream* stream) const
+{
+    if(avFormatContext->start_time == AV_NOPTS_VALUE)
+        return 0;
+
+    return av_rescale_q(avFormatContext->start_time, AV_TIME_BASE_Q, stream->time_base);
+}
+
+// Milliseconds on the clip clock in the time base of stream
+const int64_t FFDecoder::toStreamTime(const int64_t ms, const AVStream* stream) const
+{
+    AVRational tb;
+    tb.den = 1000;
+    tb.num = 1;
+
+    return av_rescale_q(ms, tb, stream->time_base) + getStreamStart(stream);
+}
+
+// Duration of one video frame in the video stream time base
+const int64_t FFDecoder::getFrameDuration() const
+{
+    if(videoStream == NULL || fps <= 0)
+        return 1;
+
+    return qMax((int64_t)(1.0 / (fps * av_q2d(videoStream->time_base)) + 0.5), (int64_t)1);
+}
+
+// True for frames ending before the seek target, stream is the one the frame was decoded from
+const bool FFDecoder::isBeforeSeekTarget(const AVFrame* frame, const AVStream* stream, const int64_t target) const
+{
+    if(target == AV_NOPTS_VALUE)
+        return false;
+
+    int64_t pts = av_frame_get_best_effort_timestamp(frame);
+    if(pts == AV_NOPTS_VALUE)
+        return false;
+
+    int64_t duration = frame->pkt_duration;
+    if(frame->nb_samples > 0)
+    {
+        AVRational sampleTB;
+        sampleTB.den = frame->sample_rate;
+        sampleTB.num = 1;
+        duration = av_rescale_q(frame->nb_samples, sampleTB, stream->time_base);
+    }
+    else if(duration <= 0 && fps > 0)
+        duration = (int64_t)(1.0 / (fps * av_q2d(stream->time_base)) + 0.5);
+
+    return pts + duration <= toStreamTime(target, stream);
+}
+
+// Discarded streams are skipped by the demuxer, their packets are neither queued nor decoded
+void FFDecoder::discardAudio(const bool discard)
+{
+    if(discard == audioDiscarded || avFormatContext == NULL)
+        return;
+
+    for(unsigned int i=0; i < avFormatContext->nb_streams; i++)
+    {
+        if(avFormatContext->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO)
+            avFormatContext->streams[i]->discard = discard ? AVDISCARD_ALL : AVDISCARD_DEFAULT;
+    }
+    audioDiscarded = discard;
+
+    LOG4CXX_DEBUG(Logger::getLogger("FFDecoder"), (discard ? "Audio streams discarded" : "Audio streams restored") << " at rate " << rate);
+}
+
+// Only touches the demuxer, the decode stages flush their own codecs
+void FFDecoder::seekStream(const int64_t pos, const int seek_flag)
+{
+    if(videoStream != NULL)
+        av_seek_frame(avFormatContext, videoStream->index, toStreamTime(pos, videoStream), seek_flag);
+
     avio_flush(avFormatContext->pb);
     avformat_flush(avFormatContext);
 }
 
 void FFDecoder::cleanup()
 {
+    DecoderScheduler::detach(this);
     cleanupFilters();
 
+    if(frameIndex != NULL)
+        delete frameIndex;
+    frameIndex = NULL;
+
 #ifdef PORTAUDIO
     if(swrContextPreview != NULL)
         swr_free(&swrContextPreview);
     swrContextPreview = NULL;
+    freeSamples(previewSamples, previewSamplesCapacity);
 #endif
 
     if(swrContext != NULL)
         swr_free(&swrContext);
     swrContext = NULL;
+    freeSamples(outputSamples, outputSamplesCapacity);
 
-#ifdef GUI
-    if(swsContextPreview != NULL)
-        sws_freeContext(swsContextPreview);
-    swsContextPreview = NULL;
 
-    if(framePreview != NULL)
-        av_frame_free(&framePreview);
-    framePreview = NULL;
-#endif
-
-    if(swsContext != NULL)
-        sws_freeContext(swsContext);
-    swsContext = NULL;
+    if(scaler != NULL)
+        delete scaler;
+    scaler = NULL;
 
     if(frameUYVY != NULL)
         av_frame_free(&frameUYVY);
@@ -1004,8 +1740,13 @@ void FFDecoder::cleanup()
         avformat_free_context(avFormatContext);
     }
     avFormatContext = NULL;
+
+    if(bufferPool != NULL)
+        delete bufferPool;
+    bufferPool = NULL;
     audioStream = NULL;
     videoStream = NULL;
+    audioDiscarded = false;
 }
 
 void FFDecoder::cleanupFilters()
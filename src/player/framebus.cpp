@@ -0,0 +1,110 @@
+#include "framebus.h"
+
+FrameBus::FrameBus()
+{
+    generation = 0;
+}
+
+FrameBus::~FrameBus()
+{
+}
+
+void FrameBus::attach(FrameQueue* queue)
+{
+    mutex.lock();
+    if(!queues.contains(queue))
+    {
+        queue->resume();
+        queues.append(queue);
+    }
+    mutex.unlock();
+}
+
+void FrameBus::detach(FrameQueue* queue)
+{
+    mutex.lock();
+    queues.removeAll(queue);
+    mutex.unlock();
+
+    // Wakes a publisher that may still be blocked on this queue, then waits until no publisher can reach it
+    queue->abort();
+    publishMutex.lock();
+    publishMutex.unlock();
+}
+
+const bool FrameBus::hasConsumers()
+{
+    mutex.lock();
+    bool empty = queues.isEmpty();
+    mutex.unlock();
+
+    return !empty;
+}
+
+// Takes over the caller's reference, NULL frames are forwarded to every consumer as end of stream
+const bool FrameBus::publish(AVDecodedFrame* frame, const int generation)
+{
+    // Held while pushing so a flush never misses a frame of an earlier generation and a detached queue is
+    // never pushed to once detach returned
+    publishMutex.lock();
+
+    mutex.lock();
+    QList<FrameQueue*> consumers = queues;
+    mutex.unlock();
+
+    if(generation < this->generation)
+    {
+        publishMutex.unlock();
+        AVDecodedFrame::releaseFrame(frame);
+        return true;
+    }
+
+    bool published = true;
+    for(int i=0; i<consumers.size(); i++)
+    {
+        if(frame != NULL)
+            frame->ref();
+
+        if(!consumers[i]->push(frame))
+        {
+            AVDecodedFrame::releaseFrame(frame);
+            published = false;
+        }
+    }
+
+    publishMutex.unlock();
+
+    AVDecodedFrame::releaseFrame(frame);
+
+    return published;
+}
+
+// Drops the queued frames when the decoder seeks, a publisher blocked on a full queue is released first
+void FrameBus::flush(const int generation)
+{
+    mutex.lock();
+    QList<FrameQueue*> consumers = queues;
+    mutex.unlock();
+
+    for(int i=0; i<consumers.size(); i++)
+        consumers[i]->abort();
+
+    publishMutex.lock();
+
+    this->generation = generation;
+    for(int i=0; i<consumers.size(); i++)
+    {
+        consumers[i]->clear(AVDecodedFrame::releaseFrame);
+        consumers[i]->resume();
+    }
+
+    publishMutex.unlock();
+}
+
+// Hands the bus over to another decoder, the frames already queued are kept
+void FrameBus::setGeneration(const int generation)
+{
+    publishMutex.lock();
+    this->generation = generation;
+    publishMutex.unlock();
+}
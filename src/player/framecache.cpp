@@ -0,0 +1,179 @@
+#include "framecache.h"
+
+FrameCache::FrameCache(const qint64 limit)
+{
+    this->limit = limit;
+    size = 0;
+    frameSize = 0;
+    playhead = 0;
+
+    hits = 0;
+    misses = 0;
+    evictions = 0;
+}
+
+FrameCache::~FrameCache()
+{
+    clear();
+}
+
+// Takes its own reference, a frame already cached at the same clock is replaced
+void FrameCache::insert(AVDecodedFrame* frame)
+{
+    if(frame == NULL || limit <= 0)
+        return;
+
+    frame->ref();
+
+    mutex.lock();
+
+    int64_t clock = frame->getClockPTS();
+    AVDecodedFrame* previous = frames.value(clock, NULL);
+    if(previous != NULL)
+    {
+        size -= previous->getSize();
+        previous->release();
+    }
+
+    frames.insert(clock, frame);
+    size += frame->getSize();
+    frameSize = frame->getSize();
+
+    evict();
+
+    mutex.unlock();
+}
+
+AVDecodedFrame* FrameCache::find(const int64_t pos, const int64_t tolerance)
+{
+    mutex.lock();
+
+    AVDecodedFrame* frame = NULL;
+    int64_t distance = tolerance + 1;
+
+    QMap<int64_t, AVDecodedFrame*>::const_iterator it = frames.lowerBound(pos);
+    if(it != frames.constEnd() && it.key() - pos < distance)
+    {
+        frame = it.value();
+        distance = it.key() - pos;
+    }
+    if(it != frames.constBegin())
+    {
+        --it;
+        if(pos - it.key() < distance)
+            frame = it.value();
+    }
+
+    if(frame != NULL)
+    {
+        frame->ref();
+        hits++;
+    }
+    else misses++;
+
+    mutex.unlock();
+
+    return frame;
+}
+
+void FrameCache::clear()
+{
+    mutex.lock();
+
+    for(QMap<int64_t, AVDecodedFrame*>::const_iterator it = frames.constBegin(); it != frames.constEnd(); ++it)
+        it.value()->release();
+    frames.clear();
+    size = 0;
+
+    mutex.unlock();
+}
+
+// A lower limit evicts right away
+void FrameCache::setLimit(const qint64 limit)
+{
+    mutex.lock();
+    this->limit = qMax(limit, (qint64)0);
+    evict();
+    mutex.unlock();
+}
+
+void FrameCache::setPlayhead(const int64_t pos)
+{
+    mutex.lock();
+    playhead = pos;
+    mutex.unlock();
+}
+
+// Frames cached strictly before pos
+const int FrameCache::countBefore(const int64_t pos)
+{
+    mutex.lock();
+
+    int count = 0;
+    QMap<int64_t, AVDecodedFrame*>::const_iterator it = frames.lowerBound(pos);
+    while(it != frames.constBegin())
+    {
+        --it;
+        count++;
+    }
+
+    mutex.unlock();
+
+    return count;
+}
+
+// Frames cached strictly after pos
+const int FrameCache::countAfter(const int64_t pos)
+{
+    mutex.lock();
+
+    int count = 0;
+    for(QMap<int64_t, AVDecodedFrame*>::const_iterator it = frames.upperBound(pos); it != frames.constEnd(); ++it)
+        count++;
+
+    mutex.unlock();
+
+    return count;
+}
+
+// Number of frames of the current size that fit in the limit, 0 until the first frame is cached
+const int FrameCache::getCapacity()
+{
+    mutex.lock();
+    int capacity = frameSize > 0 ? (int)(limit / frameSize) : 0;
+    mutex.unlock();
+
+    return capacity;
+}
+
+const QString FrameCache::getStatistics()
+{
+    mutex.lock();
+    QString statistics = QString::number(frames.size()) + " frames " + QString::number(size / (1024 * 1024)) + "/" + QString::number(limit / (1024 * 1024)) + " MB"
+                        + " hits: " + QString::number(hits)
+                        + " misses: " + QString::number(misses)
+                        + " evictions: " + QString::number(evictions);
+    mutex.unlock();
+
+    return statistics;
+}
+
+// Drops the frame farthest from the playhead until the cache fits in its limit again
+void FrameCache::evict()
+{
+    while(size > limit && !frames.isEmpty())
+    {
+        QMap<int64_t, AVDecodedFrame*>::iterator first = frames.begin();
+        QMap<int64_t, AVDecodedFrame*>::iterator last = frames.end();
+        --last;
+
+        QMap<int64_t, AVDecodedFrame*>::iterator farthest = first;
+        if(last.key() - playhead > playhead - first.key())
+            farthest = last;
+
+        size -= farthest.value()->getSize();
+        farthest.value()->release();
+        frames.erase(farthest);
+        evictions++;
+    }
+}
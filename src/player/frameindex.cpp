@@ -0,0 +1,258 @@
+#include "frameindex.h"
+
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+
+#include <climits>
+
+#include <log4cxx/logger.h>
+
+using namespace log4cxx;
+
+#define INDEX_MAGIC 0x50564958 // PVIX
+#define INDEX_VERSION 1
+
+FrameIndex::FrameIndex(const QString& path, const int streamIndex)
+{
+    this->path = path;
+    this->streamIndex = streamIndex;
+
+    QFileInfo info(path);
+    modified = info.lastModified().toMSecsSinceEpoch();
+    fileSize = info.size();
+}
+
+FrameIndex::~FrameIndex()
+{
+    abort();
+    wait();
+}
+
+void FrameIndex::open()
+{
+    if(load())
+    {
+        complete.fetchAndStoreOrdered(1);
+        LOG4CXX_DEBUG(Logger::getLogger("FrameIndex"), "Loaded index of " << path.toStdString() << ": " << entries.size() << " packets, " << keyframes.size() << " keyframes");
+    }
+    else start(QThread::LowestPriority);
+}
+
+void FrameIndex::abort()
+{
+    aborted.fetchAndStoreOrdered(1);
+}
+
+const bool FrameIndex::findKeyframe(const int64_t timestamp, FrameIndexEntry& entry) const
+{
+    mutex.lock();
+
+    // A later keyframe may still be found while the index is being built
+    if(keyframes.isEmpty() || (!complete && entries.last().pts < timestamp))
+    {
+        mutex.unlock();
+        return false;
+    }
+
+    int low = 0;
+    int high = keyframes.size();
+    while(low < high)
+    {
+        int middle = (low + high) / 2;
+        if(entries.at(keyframes.at(middle)).pts <= timestamp)
+            low = middle + 1;
+        else high = middle;
+    }
+
+    bool found = low > 0;
+    if(found)
+        entry = entries.at(keyframes.at(low - 1));
+
+    mutex.unlock();
+
+    return found;
+}
+
+const bool FrameIndex::isComplete() const
+{
+    return complete;
+}
+
+const int FrameIndex::getEntryCount() const
+{
+    mutex.lock();
+    int count = entries.size();
+    mutex.unlock();
+
+    return count;
+}
+
+const int FrameIndex::getKeyframeCount() const
+{
+    mutex.lock();
+    int count = keyframes.size();
+    mutex.unlock();
+
+    return count;
+}
+
+// Demuxes the whole file without decoding, the decoder keeps its own context
+void FrameIndex::run()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    AVFormatContext* formatContext = avformat_alloc_context();
+    formatContext->interrupt_callback.callback = interruptCallback;
+    formatContext->interrupt_callback.opaque = this;
+
+    AVDictionary* options = NULL;
+    av_dict_set(&options, "enable_drefs", "1", 0);
+    if(avformat_open_input(&formatContext, path.toStdString().c_str(), NULL, &options) != 0)
+    {
+        av_dict_free(&options);
+        LOG4CXX_WARN(Logger::getLogger("FrameIndex"), "Could not open " << path.toStdString() << " for indexing");
+        return;
+    }
+    av_dict_free(&options);
+
+    if(avformat_find_stream_info(formatContext, NULL) >= 0 && streamIndex < (int)formatContext->nb_streams)
+    {
+        AVPacket* packet = av_packet_alloc();
+        while(!aborted && av_read_frame(formatContext, packet) >= 0)
+        {
+            if(packet->stream_index == streamIndex)
+            {
+                FrameIndexEntry entry;
+                entry.pts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+                entry.dts = packet->dts;
+                entry.pos = packet->pos;
+                entry.flags = packet->flags;
+                entry.size = packet->size;
+                append(entry);
+            }
+            av_packet_unref(packet);
+        }
+        av_packet_free(&packet);
+
+        if(!aborted)
+        {
+            complete.fetchAndStoreOrdered(1);
+            save();
+
+            LOG4CXX_DEBUG(Logger::getLogger("FrameIndex"), "Indexed " << path.toStdString() << ": " << getEntryCount() << " packets, "
+                          << getKeyframeCount() << " keyframes in " << timer.elapsed() << " ms");
+        }
+    }
+
+    avformat_close_input(&formatContext);
+}
+
+void FrameIndex::append(const FrameIndexEntry& entry)
+{
+    mutex.lock();
+
+    entries.append(entry);
+
+    if(entry.flags & AV_PKT_FLAG_KEY && entry.pts != AV_NOPTS_VALUE)
+    {
+        // Keyframes normally come in presentation order, only search when one does not
+        int position = keyframes.size();
+        while(position > 0 && entries.at(keyframes.at(position - 1)).pts > entry.pts)
+            position--;
+        keyframes.insert(position, entries.size() - 1);
+    }
+
+    mutex.unlock();
+}
+
+// The cache is only used if it was written for the same path, modification time, size and stream
+const bool FrameIndex::load()
+{
+    QFile file(getCachePath());
+    if(!file.exists() || !file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_4_8);
+
+    quint32 magic = 0;
+    qint32 version = 0;
+    QString cachedPath;
+    qint64 cachedModified = 0;
+    qint64 cachedSize = 0;
+    qint32 cachedStream = -1;
+    qint32 count = 0;
+    stream >> magic >> version >> cachedPath >> cachedModified >> cachedSize >> cachedStream >> count;
+
+    if(stream.status() != QDataStream::Ok || magic != INDEX_MAGIC || version != INDEX_VERSION || cachedPath != path
+            || cachedModified != modified || cachedSize != fileSize || cachedStream != streamIndex || count < 0)
+    {
+        file.close();
+        return false;
+    }
+
+    // A truncated or stale cache must hold exactly the entries it announces, it is rebuilt otherwise
+    qint64 bytes = (qint64)count * sizeof(FrameIndexEntry);
+    if(bytes != file.size() - file.pos() || bytes > INT_MAX)
+    {
+        file.close();
+        return false;
+    }
+
+    QVector<FrameIndexEntry> cached(count);
+    bool valid = stream.readRawData((char*)cached.data(), (int)bytes) == bytes;
+    file.close();
+
+    if(!valid)
+        return false;
+
+    for(int i=0; i<cached.size(); i++)
+        append(cached.at(i));
+
+    return true;
+}
+
+const bool FrameIndex::save() const
+{
+    QString cachePath = getCachePath();
+    QDir().mkpath(QFileInfo(cachePath).absolutePath());
+
+    QFile file(cachePath);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        LOG4CXX_WARN(Logger::getLogger("FrameIndex"), "Could not write index cache " << cachePath.toStdString());
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_4_8);
+
+    mutex.lock();
+    stream << (quint32)INDEX_MAGIC << (qint32)INDEX_VERSION << path << modified << fileSize << (qint32)streamIndex << (qint32)entries.size();
+    stream.writeRawData((const char*)entries.constData(), entries.size() * (int)sizeof(FrameIndexEntry));
+    mutex.unlock();
+
+    file.close();
+
+    return stream.status() == QDataStream::Ok;
+}
+
+const QString FrameIndex::getCachePath() const
+{
+    QByteArray key = QCryptographicHash::hash(path.toUtf8(), QCryptographicHash::Md5).toHex();
+    return QCoreApplication::applicationDirPath() + "/cache/index/" + QString(key) + ".idx";
+}
+
+// Stops a blocking read when the index is dropped
+int FrameIndex::interruptCallback(void* opaque)
+{
+    FrameIndex* index = (FrameIndex*)opaque;
+    return index->aborted ? 1 : 0;
+}
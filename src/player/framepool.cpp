@@ -0,0 +1,244 @@
+#include "framepool.h"
+
+#include <malloc.h>
+
+#include <log4cxx/logger.h>
+
+using namespace log4cxx;
+
+// Buffers are grouped in 4KB size classes so audio chunks of slightly different sizes share a pool
+#define POOL_SIZE_CLASS 4096
+#define POOL_ALIGNMENT 64
+
+QMutex FramePool::poolsMutex;
+QMap<int, FramePool*> FramePool::pools;
+FramePool* FramePool::wrapperPool = NULL;
+QAtomicInt FramePool::totalAllocations;
+
+FramePool::FramePool(const int bufferSize)
+{
+    this->bufferSize = bufferSize;
+    destroyed = false;
+}
+
+FramePool::~FramePool()
+{
+    mutex.lock();
+    while(!freeFrames.isEmpty())
+        freeFrame(freeFrames.takeFirst());
+    mutex.unlock();
+}
+
+void FramePool::freeFrame(AVDecodedFrame* frame)
+{
+    if(frame->source != NULL)
+        av_frame_free(&frame->source);
+    else freeBuffer(frame->buffer);
+    delete frame;
+}
+
+FramePool* FramePool::getPool(const int size)
+{
+    int bufferSize = ((size + POOL_SIZE_CLASS - 1) / POOL_SIZE_CLASS) * POOL_SIZE_CLASS;
+    if(bufferSize == 0)
+        bufferSize = POOL_SIZE_CLASS;
+
+    poolsMutex.lock();
+
+    FramePool* pool = pools.value(bufferSize, NULL);
+    if(pool == NULL)
+    {
+        pool = new FramePool(bufferSize);
+        pools.insert(bufferSize, pool);
+    }
+
+    poolsMutex.unlock();
+
+    return pool;
+}
+
+FramePool* FramePool::getWrapperPool()
+{
+    poolsMutex.lock();
+
+    if(wrapperPool == NULL)
+        wrapperPool = new FramePool(0);
+    FramePool* pool = wrapperPool;
+
+    poolsMutex.unlock();
+
+    return pool;
+}
+
+void FramePool::destroy()
+{
+    poolsMutex.lock();
+    for(QMap<int, FramePool*>::const_iterator it = pools.constBegin(); it != pools.constEnd(); ++it)
+        release(it.value());
+    pools.clear();
+    if(wrapperPool != NULL)
+        release(wrapperPool);
+    wrapperPool = NULL;
+    poolsMutex.unlock();
+}
+
+// Frames still held by queues or outputs keep their pool alive, it is freed when the last one comes back
+void FramePool::release(FramePool* pool)
+{
+    pool->mutex.lock();
+    pool->destroyed = true;
+    int held = pool->outstanding;
+    pool->mutex.unlock();
+
+    if(held == 0)
+        delete pool;
+    else LOG4CXX_WARN(Logger::getLogger("FramePool"), "Pool of " << pool->getBufferSize() << " bytes destroyed with " << held << " frames outstanding");
+}
+
+const QString FramePool::getStatistics()
+{
+    QString statistics;
+
+    poolsMutex.lock();
+    for(QMap<int, FramePool*>::const_iterator it = pools.constBegin(); it != pools.constEnd(); ++it)
+    {
+        FramePool* pool = it.value();
+        statistics += "[" + QString::number(pool->getBufferSize()) + " bytes] allocations: " + QString::number(pool->getAllocationCount())
+                    + " reuses: " + QString::number(pool->getReuseCount())
+                    + " outstanding: " + QString::number(pool->getOutstandingCount()) + " ";
+    }
+    if(wrapperPool != NULL)
+        statistics += "[wrappers] allocations: " + QString::number(wrapperPool->getAllocationCount())
+                    + " reuses: " + QString::number(wrapperPool->getReuseCount())
+                    + " outstanding: " + QString::number(wrapperPool->getOutstandingCount());
+    poolsMutex.unlock();
+
+    return statistics.trimmed();
+}
+
+const int FramePool::getTotalAllocationCount()
+{
+    return totalAllocations;
+}
+
+AVDecodedFrame* FramePool::acquire(AVMediaType type, const int size, const int64_t pts, const int64_t clockPts)
+{
+    AVDecodedFrame* frame = NULL;
+
+    mutex.lock();
+    if(!freeFrames.isEmpty())
+        frame = freeFrames.takeLast();
+    mutex.unlock();
+
+    if(frame != NULL)
+        reuses.ref();
+    else frame = allocateFrame();
+
+    outstanding.ref();
+
+    frame->type = type;
+    frame->pts = pts * 1000;
+    frame->clockPts = clockPts;
+    frame->frameSize = size;
+    frame->refCount = 1;
+
+    return frame;
+}
+
+// Takes a reference on the planes of source, dropped again when the frame is recycled
+AVDecodedFrame* FramePool::acquireWrapper(AVMediaType type, AVFrame* source, const int size, const int64_t pts, const int64_t clockPts)
+{
+    AVDecodedFrame* frame = acquire(type, size, pts, clockPts);
+
+    av_frame_ref(frame->source, source);
+    frame->buffer = frame->source->data[0];
+    frame->bufferCapacity = size;
+
+    return frame;
+}
+
+void FramePool::recycle(AVDecodedFrame* frame)
+{
+    if(frame->source != NULL)
+    {
+        av_frame_unref(frame->source);
+        frame->buffer = NULL;
+    }
+
+    mutex.lock();
+    bool last = !outstanding.deref();
+    bool keep = !destroyed;
+    if(keep)
+        freeFrames.append(frame);
+    mutex.unlock();
+
+    if(keep)
+        return;
+
+    // The pool outlived destroy, its frames are freed as they come back
+    freeFrame(frame);
+    if(last)
+        delete this;
+}
+
+void FramePool::preallocate(const int count)
+{
+    mutex.lock();
+    int missing = count - freeFrames.size() - outstanding;
+    mutex.unlock();
+
+    for(int i=0; i<missing; i++)
+    {
+        AVDecodedFrame* frame = allocateFrame();
+
+        mutex.lock();
+        freeFrames.append(frame);
+        mutex.unlock();
+    }
+}
+
+AVDecodedFrame* FramePool::allocateFrame()
+{
+    allocations.ref();
+    totalAllocations.ref();
+
+    // The wrapper pool keeps one AVFrame per frame, referenced and unreferenced on every use
+    if(bufferSize == 0)
+    {
+        AVDecodedFrame* frame = new AVDecodedFrame(this, NULL, 0);
+        frame->source = av_frame_alloc();
+        return frame;
+    }
+
+    return new AVDecodedFrame(this, allocateBuffer(bufferSize), bufferSize);
+}
+
+uint8_t* FramePool::allocateBuffer(const int size)
+{
+    return (uint8_t*)_aligned_malloc(size, POOL_ALIGNMENT);
+}
+
+void FramePool::freeBuffer(uint8_t* buffer)
+{
+    _aligned_free(buffer);
+}
+
+const int FramePool::getBufferSize() const
+{
+    return bufferSize;
+}
+
+const int FramePool::getAllocationCount() const
+{
+    return allocations;
+}
+
+const int FramePool::getReuseCount() const
+{
+    return reuses;
+}
+
+const int FramePool::getOutstandingCount() const
+{
+    return outstanding;
+}
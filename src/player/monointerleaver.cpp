@@ -0,0 +1,239 @@
+#include "monointerleaver.h"
+
+#include <string.h>
+
+#include <emmintrin.h>
+
+extern "C"
+{
+    #include <libavutil/cpu.h>
+    #include <libavutil/mem.h>
+}
+
+// Interleaving kernels, 8 planes of count samples to count * 8 S16 samples.
+// The vector loops leave the remaining samples to the C version
+
+static void interleaveS16C(const uint8_t* const planes[], int16_t* dst, const int count)
+{
+    for(int i=0; i<count; i++)
+    {
+        for(int c=0; c<MONO_INTERLEAVER_CHANNELS; c++)
+            *dst++ = ((const int16_t*)planes[c])[i];
+    }
+}
+
+static void interleaveS32C(const uint8_t* const planes[], int16_t* dst, const int count)
+{
+    for(int i=0; i<count; i++)
+    {
+        for(int c=0; c<MONO_INTERLEAVER_CHANNELS; c++)
+            *dst++ = (int16_t)(((const int32_t*)planes[c])[i] >> 16);
+    }
+}
+
+// 8x8 transpose of 16 bit samples, one row per channel in, one row per sample out
+static inline void transposeStore(const __m128i p[8], int16_t* dst)
+{
+    __m128i t0 = _mm_unpacklo_epi16(p[0], p[1]);
+    __m128i t1 = _mm_unpackhi_epi16(p[0], p[1]);
+    __m128i t2 = _mm_unpacklo_epi16(p[2], p[3]);
+    __m128i t3 = _mm_unpackhi_epi16(p[2], p[3]);
+    __m128i t4 = _mm_unpacklo_epi16(p[4], p[5]);
+    __m128i t5 = _mm_unpackhi_epi16(p[4], p[5]);
+    __m128i t6 = _mm_unpacklo_epi16(p[6], p[7]);
+    __m128i t7 = _mm_unpackhi_epi16(p[6], p[7]);
+
+    __m128i u0 = _mm_unpacklo_epi32(t0, t2);
+    __m128i u1 = _mm_unpackhi_epi32(t0, t2);
+    __m128i u2 = _mm_unpacklo_epi32(t1, t3);
+    __m128i u3 = _mm_unpackhi_epi32(t1, t3);
+    __m128i u4 = _mm_unpacklo_epi32(t4, t6);
+    __m128i u5 = _mm_unpackhi_epi32(t4, t6);
+    __m128i u6 = _mm_unpacklo_epi32(t5, t7);
+    __m128i u7 = _mm_unpackhi_epi32(t5, t7);
+
+    __m128i* out = (__m128i*)dst;
+    _mm_storeu_si128(out, _mm_unpacklo_epi64(u0, u4));
+    _mm_storeu_si128(out + 1, _mm_unpackhi_epi64(u0, u4));
+    _mm_storeu_si128(out + 2, _mm_unpacklo_epi64(u1, u5));
+    _mm_storeu_si128(out + 3, _mm_unpackhi_epi64(u1, u5));
+    _mm_storeu_si128(out + 4, _mm_unpacklo_epi64(u2, u6));
+    _mm_storeu_si128(out + 5, _mm_unpackhi_epi64(u2, u6));
+    _mm_storeu_si128(out + 6, _mm_unpacklo_epi64(u3, u7));
+    _mm_storeu_si128(out + 7, _mm_unpackhi_epi64(u3, u7));
+}
+
+static void interleaveS16SSE2(const uint8_t* const planes[], int16_t* dst, const int count)
+{
+    __m128i p[MONO_INTERLEAVER_CHANNELS];
+
+    int i = 0;
+    for(; i + 8 <= count; i+=8)
+    {
+        for(int c=0; c<MONO_INTERLEAVER_CHANNELS; c++)
+            p[c] = _mm_loadu_si128((const __m128i*)((const int16_t*)planes[c] + i));
+
+        transposeStore(p, dst + i * MONO_INTERLEAVER_CHANNELS);
+    }
+
+    const uint8_t* rest[MONO_INTERLEAVER_CHANNELS];
+    for(int c=0; c<MONO_INTERLEAVER_CHANNELS; c++)
+        rest[c] = planes[c] + i * 2;
+    interleaveS16C(rest, dst + i * MONO_INTERLEAVER_CHANNELS, count - i);
+}
+
+// 24 bit PCM decodes to S32, the upper 16 bits are kept
+static void interleaveS32SSE2(const uint8_t* const planes[], int16_t* dst, const int count)
+{
+    __m128i p[MONO_INTERLEAVER_CHANNELS];
+
+    int i = 0;
+    for(; i + 8 <= count; i+=8)
+    {
+        for(int c=0; c<MONO_INTERLEAVER_CHANNELS; c++)
+        {
+            const __m128i* in = (const __m128i*)((const int32_t*)planes[c] + i);
+            p[c] = _mm_packs_epi32(_mm_srai_epi32(_mm_loadu_si128(in), 16), _mm_srai_epi32(_mm_loadu_si128(in + 1), 16));
+        }
+
+        transposeStore(p, dst + i * MONO_INTERLEAVER_CHANNELS);
+    }
+
+    const uint8_t* rest[MONO_INTERLEAVER_CHANNELS];
+    for(int c=0; c<MONO_INTERLEAVER_CHANNELS; c++)
+        rest[c] = planes[c] + i * 4;
+    interleaveS32C(rest, dst + i * MONO_INTERLEAVER_CHANNELS, count - i);
+}
+
+MonoInterleaver::MonoInterleaver(const int tracks, const AVSampleFormat sampleFormat, const int capacity)
+{
+    this->tracks = qBound(0, tracks, MONO_INTERLEAVER_CHANNELS);
+    this->capacity = capacity;
+    planeFormat = getPlaneFormat(sampleFormat);
+    bytesPerSample = av_get_bytes_per_sample(planeFormat);
+
+    // Unwritten samples are kept at zero, channels without a track read silence
+    for(int c=0; c<MONO_INTERLEAVER_CHANNELS; c++)
+    {
+        planes[c] = (uint8_t*)av_mallocz(capacity * bytesPerSample);
+        written[c] = 0;
+    }
+    output = (int16_t*)av_malloc(capacity * MONO_INTERLEAVER_CHANNELS * sizeof(int16_t));
+
+    bool sse2 = (av_get_cpu_flags() & AV_CPU_FLAG_SSE2) != 0;
+    if(planeFormat == AV_SAMPLE_FMT_S16P)
+        kernel = sse2 ? interleaveS16SSE2 : interleaveS16C;
+    else kernel = sse2 ? interleaveS32SSE2 : interleaveS32C;
+    instructionSet = sse2 ? "SSE2" : "C";
+}
+
+MonoInterleaver::~MonoInterleaver()
+{
+    for(int c=0; c<MONO_INTERLEAVER_CHANNELS; c++)
+        av_freep(&planes[c]);
+    av_freep(&output);
+}
+
+const AVSampleFormat MonoInterleaver::getPlaneFormat(const AVSampleFormat sampleFormat)
+{
+    switch(av_get_packed_sample_fmt(sampleFormat))
+    {
+        case AV_SAMPLE_FMT_U8:
+        case AV_SAMPLE_FMT_S16:
+            return AV_SAMPLE_FMT_S16P;
+        default:
+            return AV_SAMPLE_FMT_S32P;
+    }
+}
+
+void MonoInterleaver::append(const int track, const AVFrame* frame)
+{
+    if(track < 0 || track >= tracks)
+        return;
+
+    int count = qMin(frame->nb_samples, capacity - written[track]);
+    if(count <= 0)
+        return;
+
+    const uint8_t* src = frame->extended_data[0];
+    uint8_t* dst = planes[track] + written[track] * bytesPerSample;
+
+    switch(av_get_packed_sample_fmt((AVSampleFormat)frame->format))
+    {
+        case AV_SAMPLE_FMT_S16:
+        case AV_SAMPLE_FMT_S32:
+            memcpy(dst, src, count * bytesPerSample);
+            break;
+        case AV_SAMPLE_FMT_U8:
+            for(int i=0; i<count; i++)
+                ((int16_t*)dst)[i] = (int16_t)((src[i] - 128) << 8);
+            break;
+        case AV_SAMPLE_FMT_FLT:
+            for(int i=0; i<count; i++)
+                ((int32_t*)dst)[i] = (int32_t)(qBound(-1.0f, ((const float*)src)[i], 1.0f) * 2147483647.0);
+            break;
+        case AV_SAMPLE_FMT_DBL:
+            for(int i=0; i<count; i++)
+                ((int32_t*)dst)[i] = (int32_t)(qBound(-1.0, ((const double*)src)[i], 1.0) * 2147483647.0);
+            break;
+        default:
+            return;
+    }
+
+    written[track] += count;
+}
+
+const int MonoInterleaver::getAvailable() const
+{
+    if(tracks == 0)
+        return 0;
+
+    int available = written[0];
+    int fullest = written[0];
+    for(int t=1; t<tracks; t++)
+    {
+        available = qMin(available, written[t]);
+        fullest = qMax(fullest, written[t]);
+    }
+
+    // A track that stopped delivering must not hold the others back
+    return fullest == capacity ? fullest : available;
+}
+
+const uint8_t** MonoInterleaver::getPlanes() const
+{
+    return (const uint8_t**)planes;
+}
+
+uint8_t* MonoInterleaver::interleave(const int count)
+{
+    kernel(planes, output, qMin(count, capacity));
+
+    return (uint8_t*)output;
+}
+
+// Moves the samples left to the start of the planes and clears what they leave behind
+void MonoInterleaver::consume(const int count)
+{
+    for(int t=0; t<tracks; t++)
+    {
+        int left = qMax(written[t] - count, 0);
+        int consumed = written[t] - left;
+
+        if(left > 0)
+            memmove(planes[t], planes[t] + consumed * bytesPerSample, left * bytesPerSample);
+        memset(planes[t] + left * bytesPerSample, 0, consumed * bytesPerSample);
+
+        written[t] = left;
+    }
+}
+
+void MonoInterleaver::reset()
+{
+    consume(capacity);
+}
+
+const QString MonoInterleaver::getInstructionSet() const
+{
+    return instructionSet;
+}
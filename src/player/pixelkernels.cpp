@@ -0,0 +1,337 @@
+#include "pixelkernels.h"
+
+#include <QElapsedTimer>
+
+#include <emmintrin.h>
+
+// AVX2 intrinsics are only available from Visual Studio 2012 onwards
+#if !defined(PIXELKERNELS_AVX2) && defined(_MSC_VER) && _MSC_VER >= 1700
+    #define PIXELKERNELS_AVX2
+#endif
+
+#ifdef PIXELKERNELS_AVX2
+    #include <immintrin.h>
+#endif
+
+extern "C"
+{
+    #include <libavutil/cpu.h>
+    #include <libavutil/imgutils.h>
+    #include <libavutil/pixdesc.h>
+    #include <libswscale/swscale.h>
+}
+
+#include <log4cxx/logger.h>
+
+using namespace log4cxx;
+
+QMutex PixelKernels::initMutex;
+bool PixelKernels::initialized = false;
+QString PixelKernels::instructionSet;
+PixelKernels::PackRow PixelKernels::packRow = NULL;
+PixelKernels::UnpackRow PixelKernels::unpackRow = NULL;
+
+// Row kernels, width is in pixels and always even. The vector loops leave the remaining pixels to the C version
+
+static void packRowC(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* dst, const int width)
+{
+    for(int x=0; x<width; x+=2)
+    {
+        *dst++ = *u++;
+        *dst++ = y[x];
+        *dst++ = *v++;
+        *dst++ = y[x + 1];
+    }
+}
+
+static void unpackRowC(const uint8_t* src, uint8_t* y, uint8_t* u, uint8_t* v, const int width)
+{
+    for(int x=0; x<width; x+=2)
+    {
+        *u++ = *src++;
+        y[x] = *src++;
+        *v++ = *src++;
+        y[x + 1] = *src++;
+    }
+}
+
+static void packRowSSE2(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* dst, const int width)
+{
+    int x = 0;
+    for(; x + 32 <= width; x+=32)
+    {
+        __m128i y0 = _mm_loadu_si128((const __m128i*)(y + x));
+        __m128i y1 = _mm_loadu_si128((const __m128i*)(y + x + 16));
+        __m128i u0 = _mm_loadu_si128((const __m128i*)(u + x / 2));
+        __m128i v0 = _mm_loadu_si128((const __m128i*)(v + x / 2));
+
+        __m128i uvLow = _mm_unpacklo_epi8(u0, v0);
+        __m128i uvHigh = _mm_unpackhi_epi8(u0, v0);
+
+        __m128i* out = (__m128i*)(dst + x * 2);
+        _mm_storeu_si128(out, _mm_unpacklo_epi8(uvLow, y0));
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi8(uvLow, y0));
+        _mm_storeu_si128(out + 2, _mm_unpacklo_epi8(uvHigh, y1));
+        _mm_storeu_si128(out + 3, _mm_unpackhi_epi8(uvHigh, y1));
+    }
+
+    packRowC(y + x, u + x / 2, v + x / 2, dst + x * 2, width - x);
+}
+
+static void unpackRowSSE2(const uint8_t* src, uint8_t* y, uint8_t* u, uint8_t* v, const int width)
+{
+    const __m128i mask = _mm_set1_epi16(0x00FF);
+
+    int x = 0;
+    for(; x + 32 <= width; x+=32)
+    {
+        const __m128i* in = (const __m128i*)(src + x * 2);
+        __m128i a = _mm_loadu_si128(in);
+        __m128i b = _mm_loadu_si128(in + 1);
+        __m128i c = _mm_loadu_si128(in + 2);
+        __m128i d = _mm_loadu_si128(in + 3);
+
+        // Odd bytes are luma, even bytes alternate U and V
+        _mm_storeu_si128((__m128i*)(y + x), _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+        _mm_storeu_si128((__m128i*)(y + x + 16), _mm_packus_epi16(_mm_srli_epi16(c, 8), _mm_srli_epi16(d, 8)));
+
+        __m128i uv0 = _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask));
+        __m128i uv1 = _mm_packus_epi16(_mm_and_si128(c, mask), _mm_and_si128(d, mask));
+
+        _mm_storeu_si128((__m128i*)(u + x / 2), _mm_packus_epi16(_mm_and_si128(uv0, mask), _mm_and_si128(uv1, mask)));
+        _mm_storeu_si128((__m128i*)(v + x / 2), _mm_packus_epi16(_mm_srli_epi16(uv0, 8), _mm_srli_epi16(uv1, 8)));
+    }
+
+    unpackRowC(src + x * 2, y + x, u + x / 2, v + x / 2, width - x);
+}
+
+#ifdef PIXELKERNELS_AVX2
+// 256 bit unpack and pack work inside each 128 bit lane, the lanes are put back in order with permutes
+static void packRowAVX2(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* dst, const int width)
+{
+    int x = 0;
+    for(; x + 32 <= width; x+=32)
+    {
+        __m256i y0 = _mm256_loadu_si256((const __m256i*)(y + x));
+        __m128i u0 = _mm_loadu_si128((const __m128i*)(u + x / 2));
+        __m128i v0 = _mm_loadu_si128((const __m128i*)(v + x / 2));
+
+        // Chroma of pixels 0-15 in the low lane and 16-31 in the high lane, matching the luma lanes
+        __m256i uv = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi8(u0, v0)), _mm_unpackhi_epi8(u0, v0), 1);
+
+        __m256i low = _mm256_unpacklo_epi8(uv, y0);
+        __m256i high = _mm256_unpackhi_epi8(uv, y0);
+
+        __m256i* out = (__m256i*)(dst + x * 2);
+        _mm256_storeu_si256(out, _mm256_permute2x128_si256(low, high, 0x20));
+        _mm256_storeu_si256(out + 1, _mm256_permute2x128_si256(low, high, 0x31));
+    }
+
+    packRowSSE2(y + x, u + x / 2, v + x / 2, dst + x * 2, width - x);
+}
+
+static void unpackRowAVX2(const uint8_t* src, uint8_t* y, uint8_t* u, uint8_t* v, const int width)
+{
+    const __m256i mask = _mm256_set1_epi16(0x00FF);
+
+    int x = 0;
+    for(; x + 64 <= width; x+=64)
+    {
+        const __m256i* in = (const __m256i*)(src + x * 2);
+        __m256i a = _mm256_loadu_si256(in);
+        __m256i b = _mm256_loadu_si256(in + 1);
+        __m256i c = _mm256_loadu_si256(in + 2);
+        __m256i d = _mm256_loadu_si256(in + 3);
+
+        __m256i y0 = _mm256_permute4x64_epi64(_mm256_packus_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8)), 0xD8);
+        __m256i y1 = _mm256_permute4x64_epi64(_mm256_packus_epi16(_mm256_srli_epi16(c, 8), _mm256_srli_epi16(d, 8)), 0xD8);
+        _mm256_storeu_si256((__m256i*)(y + x), y0);
+        _mm256_storeu_si256((__m256i*)(y + x + 32), y1);
+
+        __m256i uv0 = _mm256_permute4x64_epi64(_mm256_packus_epi16(_mm256_and_si256(a, mask), _mm256_and_si256(b, mask)), 0xD8);
+        __m256i uv1 = _mm256_permute4x64_epi64(_mm256_packus_epi16(_mm256_and_si256(c, mask), _mm256_and_si256(d, mask)), 0xD8);
+
+        __m256i u0 = _mm256_packus_epi16(_mm256_and_si256(uv0, mask), _mm256_and_si256(uv1, mask));
+        __m256i v0 = _mm256_packus_epi16(_mm256_srli_epi16(uv0, 8), _mm256_srli_epi16(uv1, 8));
+        _mm256_storeu_si256((__m256i*)(u + x / 2), _mm256_permute4x64_epi64(u0, 0xD8));
+        _mm256_storeu_si256((__m256i*)(v + x / 2), _mm256_permute4x64_epi64(v0, 0xD8));
+    }
+
+    unpackRowSSE2(src + x * 2, y + x, u + x / 2, v + x / 2, width - x);
+}
+#endif
+
+void PixelKernels::init()
+{
+    initMutex.lock();
+
+    if(!initialized)
+    {
+        int flags = av_get_cpu_flags();
+
+        packRow = packRowC;
+        unpackRow = unpackRowC;
+        instructionSet = "C";
+
+        if(flags & AV_CPU_FLAG_SSE2)
+        {
+            packRow = packRowSSE2;
+            unpackRow = unpackRowSSE2;
+            instructionSet = "SSE2";
+        }
+
+#ifdef PIXELKERNELS_AVX2
+        if(flags & AV_CPU_FLAG_AVX2)
+        {
+            packRow = packRowAVX2;
+            unpackRow = unpackRowAVX2;
+            instructionSet = "AVX2";
+        }
+#endif
+
+        LOG4CXX_INFO(Logger::getLogger("PixelKernels"), "Using " << instructionSet.toStdString() << " pixel conversion kernels");
+
+        initialized = true;
+    }
+
+    initMutex.unlock();
+}
+
+PixelKernel PixelKernels::getKernel(const AVPixelFormat srcFormat, const AVPixelFormat dstFormat, const bool interlaced)
+{
+    init();
+
+    // Full range (yuvj) sources need their levels scaled, those stay with swscale
+    if(dstFormat == AV_PIX_FMT_UYVY422)
+    {
+        if(srcFormat == AV_PIX_FMT_YUV422P)
+            return yuv422pToUYVY;
+        if(srcFormat == AV_PIX_FMT_YUV420P)
+            return interlaced ? yuv420pToUYVYInterlaced : yuv420pToUYVY;
+    }
+    else if(srcFormat == AV_PIX_FMT_UYVY422 && dstFormat == AV_PIX_FMT_YUV422P)
+        return uyvyToYUV422p;
+
+    return NULL;
+}
+
+const QString PixelKernels::getInstructionSet()
+{
+    init();
+
+    return instructionSet;
+}
+
+void PixelKernels::yuv422pToUYVY(const uint8_t* const src[], const int srcStride[], uint8_t* const dst[], const int dstStride[],
+                                 const int width, const int height)
+{
+    for(int y=0; y<height; y++)
+        packRow(src[0] + y * srcStride[0], src[1] + y * srcStride[1], src[2] + y * srcStride[2], dst[0] + y * dstStride[0], width);
+}
+
+// Each chroma line is used for two output lines
+void PixelKernels::yuv420pToUYVY(const uint8_t* const src[], const int srcStride[], uint8_t* const dst[], const int dstStride[],
+                                 const int width, const int height)
+{
+    for(int y=0; y<height; y++)
+    {
+        int c = y >> 1;
+        packRow(src[0] + y * srcStride[0], src[1] + c * srcStride[1], src[2] + c * srcStride[2], dst[0] + y * dstStride[0], width);
+    }
+}
+
+// Chroma lines alternate between fields like the luma lines, so lines 0 and 2 share chroma line 0, lines 1 and 3 share chroma line 1
+void PixelKernels::yuv420pToUYVYInterlaced(const uint8_t* const src[], const int srcStride[], uint8_t* const dst[], const int dstStride[],
+                                           const int width, const int height)
+{
+    for(int y=0; y<height; y++)
+    {
+        int c = ((y >> 2) << 1) | (y & 1);
+        packRow(src[0] + y * srcStride[0], src[1] + c * srcStride[1], src[2] + c * srcStride[2], dst[0] + y * dstStride[0], width);
+    }
+}
+
+void PixelKernels::uyvyToYUV422p(const uint8_t* const src[], const int srcStride[], uint8_t* const dst[], const int dstStride[],
+                                 const int width, const int height)
+{
+    for(int y=0; y<height; y++)
+        unpackRow(src[0] + y * srcStride[0], dst[0] + y * dstStride[0], dst[1] + y * dstStride[1], dst[2] + y * dstStride[2], width);
+}
+
+const QString PixelKernels::benchmark(const int width, const int height, const int iterations)
+{
+    static const AVPixelFormat conversions[][2] = {
+        { AV_PIX_FMT_YUV422P, AV_PIX_FMT_UYVY422 },
+        { AV_PIX_FMT_YUV420P, AV_PIX_FMT_UYVY422 },
+        { AV_PIX_FMT_UYVY422, AV_PIX_FMT_YUV422P }
+    };
+
+    QString results = getInstructionSet() + " " + QString::number(width) + "x" + QString::number(height) + ":";
+
+    for(int i=0; i<3; i++)
+    {
+        double swscale = benchmarkConversion(conversions[i][0], conversions[i][1], width, height, iterations, false);
+        double kernel = benchmarkConversion(conversions[i][0], conversions[i][1], width, height, iterations, true);
+        if(swscale < 0 || kernel < 0)
+            continue;
+
+        results += QString(" %1 -> %2 swscale %3 ms, kernel %4 ms (x%5);")
+                .arg(av_get_pix_fmt_name(conversions[i][0])).arg(av_get_pix_fmt_name(conversions[i][1]))
+                .arg(swscale, 0, 'f', 3).arg(kernel, 0, 'f', 3).arg(kernel > 0 ? swscale / kernel : 0, 0, 'f', 1);
+    }
+
+    LOG4CXX_INFO(Logger::getLogger("PixelKernels"), "Benchmark " << results.toStdString());
+
+    return results;
+}
+
+// Average milliseconds per frame, -1 if the buffers or the conversion context could not be created
+const double PixelKernels::benchmarkConversion(const AVPixelFormat srcFormat, const AVPixelFormat dstFormat, const int width, const int height,
+                                               const int iterations, const bool useKernel)
+{
+    uint8_t* src[4];
+    int srcStride[4];
+    uint8_t* dst[4];
+    int dstStride[4];
+
+    if(av_image_alloc(src, srcStride, width, height, srcFormat, 32) < 0)
+        return -1;
+    if(av_image_alloc(dst, dstStride, width, height, dstFormat, 32) < 0)
+    {
+        av_freep(&src[0]);
+        return -1;
+    }
+
+    // Deterministic pattern so both paths convert the same data
+    int size = av_image_get_buffer_size(srcFormat, width, height, 32);
+    for(int i=0; i<size; i++)
+        src[0][i] = (uint8_t)(16 + (i * 7) % 220);
+
+    PixelKernel kernel = getKernel(srcFormat, dstFormat, false);
+    SwsContext* swsContext = NULL;
+    if(!useKernel)
+        swsContext = sws_getContext(width, height, srcFormat, width, height, dstFormat, SWS_BILINEAR, NULL, NULL, NULL);
+
+    double elapsed = -1;
+    if((useKernel && kernel != NULL) || swsContext != NULL)
+    {
+        QElapsedTimer timer;
+        timer.start();
+
+        for(int i=0; i<iterations; i++)
+        {
+            if(useKernel)
+                kernel(src, srcStride, dst, dstStride, width, height);
+            else sws_scale(swsContext, src, srcStride, 0, height, dst, dstStride);
+        }
+
+        elapsed = timer.nsecsElapsed() / 1000000.0 / qMax(iterations, 1);
+    }
+
+    if(swsContext != NULL)
+        sws_freeContext(swsContext);
+    av_freep(&src[0]);
+    av_freep(&dst[0]);
+
+    return elapsed;
+}
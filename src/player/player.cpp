@@ -4,53 +4,70 @@
 
 using namespace log4cxx;
 
-Player::Player(QObject* parent) : QObject(parent)
+// Frames left in the step direction before the cache is refilled
+#define FRAME_CACHE_MARGIN 5
+// Fastest shuttle, above 2x rates double at each step
+#define MAX_SHUTTLE_RATE 32.0
+
+Player::Player(QObject* parent) : QObject(parent), videoFrames(50), audioSamples(100), frameCache((qint64)DEFAULT_FRAME_CACHE_SIZE * 1024 * 1024)
 {
     decoder = NULL;
-    audioThread = new AudioThread(false, this);
+    nextDecoder = NULL;
+    retiredDecoder = NULL;
+    videoSwitched = false;
+    audioSwitched = false;
+    previewSwitched = false;
+    detachingDecoder = false;
+
+    audioThread = new AudioThread(false, &playoutClock, this);
+    audioBus.attach(audioThread->getQueue());
 #ifdef PORTAUDIO
-    audioThreadPreview = new AudioThread(true, this);
+    audioThreadPreview = new AudioThread(true, &playoutClock, this);
+    audioPreviewBus.attach(audioThreadPreview->getQueue());
 #endif
-    videoThread = new VideoThread(this);
+    videoThread = new VideoThread(&playoutClock, this);
+    videoBus.attach(videoThread->getQueue());
 
     startFrame = 0;
     startMillisecond = 0;
     videoRate = 1.0;
     currentMediaFormat = "PAL";
     currentCG = "";
+    name = "Player";
 
+    stepped = false;
     loop = false;
     loaded = false;
     playing = IDLE;
+    bufferDepth = DEFAULT_BUFFER_DEPTH;
 #ifdef GUI
     preview = NULL;
 #endif
-#ifdef DECKLINK
-    deckLinkOutput = NULL;
-#endif
+    outputDevice = NULL;
 }
 
 Player::~Player()
 {
     this->dropMedia(true);
-#ifdef DECKLINK
-    if(deckLinkOutput != NULL)
-        deckLinkOutput->disableCard();
-#endif
+    if(outputDevice != NULL)
+        outputDevice->disableCard();
 }
 
 const int64_t Player::initFFMpeg(const QString& path)
 {
-    decoder = new FFDecoder(this, loop);
+    FFDecoder* decoder = new FFDecoder(this, loop);
+    switchMutex.lock();
+    this->decoder = decoder;
+    switchMutex.unlock();
+
     int64_t duration_ms = -1;
-#ifdef DECKLINK
-    duration_ms = decoder->init(path, currentMediaFormat, deckLinkOutput);
-#else
-    duration_ms = decoder->init(path, currentMediaFormat);
-#endif
+    duration_ms = decoder->init(path, currentMediaFormat, outputDevice);
     if(duration_ms == -1)
         return duration_ms;
 
+    if(decoder->getStartMillisecond() != AV_NOPTS_VALUE)
+        setStartMillisecond(decoder->getStartMillisecond());
+
     activateFilter(currentCG);
 
     decoder->startDecoding();
@@ -61,13 +78,24 @@ const int64_t Player::initFFMpeg(const QString& path)
 
 void Player::cleanupFFMpeg()
 {
+    dropNextMedia();
+    stopDecoder(retiredDecoder);
+    retiredDecoder = NULL;
+
+    switchMutex.lock();
+    FFDecoder* decoder = this->decoder;
+    this->decoder = NULL;
+    switchMutex.unlock();
+
     if(decoder != NULL)
     {
         decoder->stopDecoding();
         decoder->setRate(videoRate);
         delete decoder;
     }
-    decoder = NULL;
+
+    LOG4CXX_DEBUG(Logger::getLogger("Player"), "Frame cache: " << frameCache.getStatistics().toStdString());
+    frameCache.clear();
 
     if(audioThread != NULL)
         audioThread->cleanup();
@@ -80,162 +108,108 @@ void Player::cleanupFFMpeg()
     if(videoThread != NULL)
         videoThread->cleanup(0);
 
-#ifdef DECKLINK
-    if(deckLinkOutput != NULL)
+    if(outputDevice != NULL)
     {
-        deckLinkOutput->setRate(videoRate);
-        deckLinkOutput->setStartFrame(startFrame);
+        outputDevice->setRate(videoRate);
+        outputDevice->setStartFrame(startFrame);
     }
-#endif
 }
 
-const bool Player::pushVideoFrame(AVDecodedFrame* v)
+// The frame is published once, every attached consumer holds its own reference
+const bool Player::pushVideoFrame(AVDecodedFrame* v, const int generation)
 {
-    if(!loaded)
-        return false;
-
-    if(playing == STOPPING)
+    if(!loaded || playing == STOPPING)
     {
-        if(v != NULL)
-            delete v;
-        return true;
+        AVDecodedFrame::releaseFrame(v);
+        return loaded;
     }
 
-    videoMutex.lock();
-#ifdef DECKLINK
-    if(deckLinkOutput != NULL)
+    if(!waitForSwitch(generation, videoSwitched))
     {
-        if(videoFramesList.size() > 50)
-        {
-            videoMutex.unlock();
-            return false;
-        }
-
-        videoFramesList.append(v);
-    }
-    else if(v != NULL)
-        delete v;
-#else
-    if(v != NULL)
-        delete v;
-#endif
-
-    videoMutex.unlock();
-    return true;
-}
-
-const bool Player::pushVideoFramePreview(AVDecodedFrame* vp)
-{
-    if(!loaded)
+        AVDecodedFrame::releaseFrame(v);
         return false;
+    }
 
-    if(playing == STOPPING)
+    // The end of the clip on air is not published when the next clip follows
+    FFDecoder* next = v == NULL ? switchStream(generation, videoSwitched, videoBus) : NULL;
+    if(next != NULL)
     {
-        if(vp != NULL)
-            delete vp;
+        // Cached frames of the previous clip would share clocks with the next one
+        frameCache.clear();
+        setStartMillisecond(next->getStartMillisecond() != AV_NOPTS_VALUE ? next->getStartMillisecond() : 0);
         return true;
     }
 
-    bool pushed = false;
-    if(videoThread != NULL)
-        pushed = videoThread->pushVideoFrame(vp);
-    else if(vp != NULL)
+    // Frames published while paused or stepping stay available for frame stepping, played frames are not kept
+    if(v != NULL && playing != PLAYING)
     {
-        delete vp;
-        pushed = true;
+        if(videoThread != NULL)
+            frameCache.setPlayhead(videoThread->getCurrentPlayTime());
+        frameCache.insert(v);
     }
 
-    return pushed;
+    // Blocks the decoder while one of the consumer queues is full
+    return videoBus.publish(v, generation);
 }
 
-const bool Player::pushAudioFrame(AVDecodedFrame* a)
+const bool Player::pushAudioFrame(AVDecodedFrame* a, const int generation)
 {
-    if(!loaded)
-        return false;
-
-    if(playing == STOPPING)
+    if(!loaded || playing == STOPPING)
     {
-        if(a != NULL)
-            delete a;
-        return true;
+        AVDecodedFrame::releaseFrame(a);
+        return loaded;
     }
 
-    audioMutex.lock();
-#ifdef DECKLINK
-    if(deckLinkOutput != NULL)
+    if(!waitForSwitch(generation, audioSwitched))
     {
-        if(audioSamplesList.size() > 100)
-        {
-            audioMutex.unlock();
-            return false;
-        }
-
-        audioSamplesList.append(a);
+        AVDecodedFrame::releaseFrame(a);
+        return false;
     }
-    else if(a != NULL)
-        delete a;
-#else
-    if(a != NULL)
-        delete a;
-#endif
 
-    audioMutex.unlock();
-    return true;
+    if(a == NULL && switchStream(generation, audioSwitched, audioBus) != NULL)
+        return true;
+
+    return audioBus.publish(a, generation);
 }
 
-const bool Player::pushAudioFrameVU(AVDecodedFrame* aVU)
+// Frames decoded before a seek target to refill the window behind the playhead
+void Player::cacheVideoFrame(AVDecodedFrame* v)
 {
-    if(!loaded)
-        return false;
-
-    if(playing == STOPPING)
-    {
-        if(aVU != NULL)
-            delete aVU;
-        return true;
-    }
-
-    bool pushed = false;
-    if(audioThread != NULL)
-        pushed = audioThread->pushAudioFrame(aVU);
-    else
-    {
-        if(aVU != NULL)
-            delete aVU;
-        pushed = true;
-    }
+    if(loaded && playing != STOPPING)
+        frameCache.insert(v);
 
-    return pushed;
+    AVDecodedFrame::releaseFrame(v);
 }
 
 #ifdef PORTAUDIO
-const bool Player::pushAudioFramePreview(AVDecodedFrame* ap)
+const bool Player::pushAudioFramePreview(AVDecodedFrame* ap, const int generation)
 {
-    if(!loaded)
-        return false;
-
-    if(playing == STOPPING)
+    if(!loaded || playing == STOPPING)
     {
-        if(ap != NULL)
-            delete ap;
-        return true;
+        AVDecodedFrame::releaseFrame(ap);
+        return loaded;
     }
 
-    bool pushed = false;
-    if(audioThreadPreview != NULL)
-        pushed = audioThreadPreview->pushAudioFrame(ap);
-    else
+    if(!waitForSwitch(generation, previewSwitched))
     {
-        if(ap != NULL)
-            delete ap;
-        pushed = true;
+        AVDecodedFrame::releaseFrame(ap);
+        return false;
     }
 
-    return pushed;
+    if(ap == NULL && switchStream(generation, previewSwitched, audioPreviewBus) != NULL)
+        return true;
+
+    return audioPreviewBus.publish(ap, generation);
+}
+
+const bool Player::hasAudioPreview()
+{
+    return audioPreviewBus.hasConsumers();
 }
 #endif
 
-AVDecodedFrame* Player::getNextVideoFrame()
+// NULL either when the queue ran empty or at the end of stream marker, which sets endOfStream
+AVDecodedFrame* Player::getNextVideoFrame(bool* endOfStream)
 {
     if(!loaded)
         return NULL;
@@ -243,18 +217,13 @@ AVDecodedFrame* Player::getNextVideoFrame()
     if(playing == STOPPING)
         return NULL;
 
-    videoMutex.lock();
+    AVDecodedFrame* buffer = NULL;
+    if(!videoFrames.pop(buffer))
+        LOG4CXX_DEBUG(Logger::getLogger("Player"), "Video frame list empty");
+    else if(buffer == NULL && endOfStream != NULL)
+        *endOfStream = true;
 
-    if(!videoFramesList.isEmpty())
-    {
-        AVDecodedFrame* buffer = videoFramesList.takeFirst();
-        videoMutex.unlock();
-        return buffer;
-    }
-    else LOG4CXX_DEBUG(Logger::getLogger("Player"), "Video frame list empty");
-
-    videoMutex.unlock();
-    return NULL;
+    return buffer;
 }
 
 AVDecodedFrame* Player::getNextAudioSample()
@@ -265,18 +234,63 @@ AVDecodedFrame* Player::getNextAudioSample()
     if(playing == STOPPING)
         return NULL;
 
-    audioMutex.lock();
+    AVDecodedFrame* buffer = NULL;
+    if(!audioSamples.pop(buffer))
+        LOG4CXX_DEBUG(Logger::getLogger("Player"), "Audio sample list empty");
 
-    if(!audioSamplesList.isEmpty())
-    {
-        AVDecodedFrame* buffer = audioSamplesList.takeFirst();
-        audioMutex.unlock();
-        return buffer;
-    }
-    else LOG4CXX_DEBUG(Logger::getLogger("Player"), "Audio sample list empty");
+    return buffer;
+}
+
+void Player::abortQueues()
+{
+    // The decoder on air keeps publishing while a cued or finished one is stopped
+    if(detachingDecoder)
+        return;
 
-    audioMutex.unlock();
-    return NULL;
+    videoFrames.abort();
+    audioSamples.abort();
+
+    if(videoThread != NULL)
+        videoThread->getQueue()->abort();
+    if(audioThread != NULL)
+        audioThread->getQueue()->abort();
+#ifdef PORTAUDIO
+    if(audioThreadPreview != NULL)
+        audioThreadPreview->getQueue()->abort();
+#endif
+}
+
+void Player::resumeQueues()
+{
+    videoFrames.resume();
+    audioSamples.resume();
+
+    if(videoThread != NULL)
+        videoThread->getQueue()->resume();
+    if(audioThread != NULL)
+        audioThread->getQueue()->resume();
+#ifdef PORTAUDIO
+    if(audioThreadPreview != NULL)
+        audioThreadPreview->getQueue()->resume();
+#endif
+}
+
+const QString Player::getQueueStatistics() const
+{
+    QString statistics = "video: " + videoFrames.getStatistics() + ", audio: " + audioSamples.getStatistics();
+
+    if(videoThread != NULL)
+        statistics += ", preview video: " + videoThread->getQueue()->getStatistics();
+    if(audioThread != NULL)
+        statistics += ", VU: " + audioThread->getQueue()->getStatistics();
+#ifdef PORTAUDIO
+    if(audioThreadPreview != NULL)
+        statistics += ", preview audio: " + audioThreadPreview->getQueue()->getStatistics();
+#endif
+    if(outputDevice != NULL)
+        statistics += ", output audio: " + outputDevice->getAudioStatistics();
+
+    return statistics;
 }
 
 // Player functions
@@ -293,6 +307,8 @@ void Player::togglePreviewVideo(PreviewerRGB* previewer)
     }
 
     this->preview = previewer;
+    if(videoThread != NULL)
+        videoThread->setPreview(previewer != NULL);
     if(this->preview != NULL)
     {
         if(videoThread != NULL)
@@ -310,7 +326,10 @@ void Player::togglePreviewAudio(bool enabled)
     {
 #ifdef PORTAUDIO
         if(audioThreadPreview == NULL)
-            audioThreadPreview = new AudioThread(true, this);
+        {
+            audioThreadPreview = new AudioThread(true, &playoutClock, this);
+            audioPreviewBus.attach(audioThreadPreview->getQueue());
+        }
 #endif
     }
     else
@@ -318,6 +337,7 @@ void Player::togglePreviewAudio(bool enabled)
 #ifdef PORTAUDIO
         if(audioThreadPreview != NULL)
         {
+            audioPreviewBus.detach(audioThreadPreview->getQueue());
             audioThreadPreview->cleanup();
             delete audioThreadPreview;
         }
@@ -327,42 +347,63 @@ void Player::togglePreviewAudio(bool enabled)
 }
 #endif
 
-#ifdef DECKLINK
-const QString Player::setDeckLinkOutput(QString inter)
+const QString Player::setOutputDevice(QString inter)
 {
-    if(deckLinkOutput != NULL)
-        deckLinkOutput->disableCard();
-    deckLinkOutput = NULL;
+    if(outputDevice != NULL)
+    {
+        videoBus.detach(&videoFrames);
+        audioBus.detach(&audioSamples);
+        outputDevice->disableCard();
+    }
+    outputDevice = NULL;
 
     if(inter.contains("Output"))
     {
         inter.remove(QRegExp(".*\\("));
         inter.remove(")");
 
-        deckLinkOutput = DeckLinkControl::getOutput(inter.toInt());
-        deckLinkOutput->enableCard();
+        outputDevice = DeviceControl::getOutput(inter.toInt());
+        outputDevice->setBufferDepth(bufferDepth);
+        outputDevice->enableCard();
+        videoBus.attach(&videoFrames);
+        audioBus.attach(&audioSamples);
         changeFormat(currentMediaFormat);
     }
+    playoutClock.setSource(outputDevice);
 
     return inter;
 }
 
-const DeckLinkOutput* Player::getDecklinkOutput() const
+const OutputDevice* Player::getOutputDevice() const
 {
-    return deckLinkOutput;
+    return outputDevice;
+}
+
+// Identifies the player in the statistics shared between ports
+void Player::setName(const QString& name)
+{
+    this->name = name;
+}
+
+const QString Player::getName() const
+{
+    return name;
 }
-#endif
 
 const int64_t Player::loadMedia(const QString& media_path)
 {
     LOG4CXX_INFO(Logger::getLogger("Player"), "Loading clip: " + media_path.toStdString());
 
+    // The decoder starts pushing frames as soon as it is initialized
+    loaded = true;
+    playing = IDLE;
+
     int64_t duration_ms = this->initFFMpeg(media_path);
     if(duration_ms == -1)
+    {
+        loaded = false;
         return duration_ms;
-
-    loaded = true;
-    playing = IDLE;
+    }
 
     // Guarantees that there are at least 25 frames decoded
     waitForDecoding();
@@ -372,56 +413,201 @@ const int64_t Player::loadMedia(const QString& media_path)
     return duration_ms;
 }
 
-void Player::waitForDecoding()
+// Opens the next clip while the current one is on air. Its decoder starts right away and prerolls, the frames
+// it publishes are held until the current clip ends on the same stream, so the output keeps scheduling frames
+// across the cut. The next clip is expected in the format of the current one, the output timing is not adjusted
+const int64_t Player::cueNextMedia(const QString& media_path)
 {
-#ifdef DECKLINK
-    if(deckLinkOutput != NULL)
+    if(getDecoder() == NULL)
+        return -1;
+
+    LOG4CXX_INFO(Logger::getLogger("Player"), "Cueing next clip: " + media_path.toStdString());
+
+    dropNextMedia();
+    stopDecoder(retiredDecoder);
+    retiredDecoder = NULL;
+
+    FFDecoder* next = new FFDecoder(this, false);
+    int64_t duration_ms = -1;
+    duration_ms = next->init(media_path, currentMediaFormat, NULL);
+    if(duration_ms == -1)
     {
-        int count = 0;
-        while(true)
-        {
-            videoMutex.lock();
+        delete next;
+        return duration_ms;
+    }
 
-            if(videoFramesList.size() < 5)
-            {
-                count++;
-                Sleep(1);
-            }
-            else
-            {
-                videoMutex.unlock();
-                break;
-            }
+    if(currentCG != "")
+        next->setFilter(currentCG, currentMediaFormat);
 
-            videoMutex.unlock();
+    // Without audio on air the audio of the cued clip is held until its pictures go on air
+    switchMutex.lock();
+    videoSwitched = false;
+    audioSwitched = false;
+#ifdef PORTAUDIO
+    previewSwitched = false;
+#else
+    previewSwitched = true;
+#endif
+    nextDecoder = next;
+    switchMutex.unlock();
 
-            // Ensures there is no deadlock if the file is too small
-            if(count > 100)
-                break;
-        }
+    next->startDecoding();
+    next->start();
+
+    LOG4CXX_INFO(Logger::getLogger("Player"), "Finished cueing next clip: " + media_path.toStdString());
+
+    return duration_ms;
+}
+
+// Frames of the cued clip wait for the cut, false if the cued clip was dropped meanwhile
+const bool Player::waitForSwitch(const int generation, const bool& switched)
+{
+    switchMutex.lock();
+
+    bool held = nextDecoder != NULL && generation == nextDecoder->getGeneration();
+    while(held && !switched && nextDecoder != NULL)
+        switchCondition.wait(&switchMutex);
+
+    bool publish = !held || switched;
+
+    switchMutex.unlock();
+
+    return publish;
+}
+
+// End of stream of the clip on air. With a clip cued the stream continues with its frames, once every
+// stream switched the cued decoder takes over. Returns the cued decoder if the end of stream was consumed
+FFDecoder* Player::switchStream(const int generation, bool& switched, FrameBus& bus)
+{
+    switchMutex.lock();
+
+    FFDecoder* next = nextDecoder;
+    if(next == NULL || generation == next->getGeneration())
+    {
+        switchMutex.unlock();
+        return NULL;
     }
+
+    // Seeks on the clip on air raised the bus generation above the one of the cued decoder
+    switched = true;
+    bus.setGeneration(next->getGeneration());
+
+    // A clip on air without audio ends no audio stream, the cued audio follows the pictures
+    if(videoSwitched && !decoder->hasAudio() && !audioSwitched)
+    {
+        audioSwitched = true;
+        audioBus.setGeneration(next->getGeneration());
+#ifdef PORTAUDIO
+        previewSwitched = true;
+        audioPreviewBus.setGeneration(next->getGeneration());
 #endif
+    }
+
+    if(videoSwitched && audioSwitched && previewSwitched)
+    {
+        // The finished decoder is stopped by the next command, this runs on one of its threads
+        retiredDecoder = decoder;
+        decoder = next;
+        nextDecoder = NULL;
+
+        LOG4CXX_INFO(Logger::getLogger("Player"), "Switched to the next clip");
+    }
+
+    switchCondition.wakeAll();
+    switchMutex.unlock();
+
+    return next;
+}
+
+// The decoder on air, the cut swaps it on one of the decoder threads. A copy stays valid on the player thread,
+// the retired decoder is only deleted from there
+FFDecoder* Player::getDecoder()
+{
+    switchMutex.lock();
+    FFDecoder* decoder = this->decoder;
+    switchMutex.unlock();
+
+    return decoder;
+}
+
+void Player::dropNextMedia()
+{
+    switchMutex.lock();
+    FFDecoder* next = nextDecoder;
+    bool onAir = videoSwitched;
+    nextDecoder = NULL;
+    switchCondition.wakeAll();
+    switchMutex.unlock();
+
+    // Frames of a clip already on air may be blocked on the output queues
+    if(onAir && next != NULL)
+    {
+        next->stopDecoding();
+        delete next;
+    }
+    else stopDecoder(next);
+}
+
+// Stops a decoder that is not on air without aborting the queues the decoder on air publishes to
+void Player::stopDecoder(FFDecoder* decoder)
+{
+    if(decoder == NULL)
+        return;
+
+    detachingDecoder = true;
+    decoder->stopDecoding();
+    detachingDecoder = false;
+
+    delete decoder;
+}
+
+void Player::waitForDecoding()
+{
+    // The timeout ensures there is no deadlock if the file is too small
+    if(outputDevice != NULL)
+        videoFrames.waitForCount(outputDevice->getBufferDepth(), 1000);
+}
+
+void Player::setBufferDepth(const int depth)
+{
+    bufferDepth = depth;
+
+    if(outputDevice != NULL)
+        outputDevice->setBufferDepth(bufferDepth);
+}
+
+// Memory kept for frame stepping in megabytes
+void Player::setCacheSize(const int megabytes)
+{
+    frameCache.setLimit((qint64)megabytes * 1024 * 1024);
 }
 
 void Player::changeFormat(const QString& format)
 {
     currentMediaFormat = format;
+    frameCache.clear();
 
-#ifdef DECKLINK
-    if(deckLinkOutput != NULL)
-        deckLinkOutput->changeFormat(format);
-#endif
+    FFDecoder* decoder = getDecoder();
+
+    if(outputDevice != NULL)
+        outputDevice->changeFormat(format);
 #ifdef GUI
     if(preview != NULL)
         preview->changeFormat(format);
 #endif
 
+    // A running decoder converts to the new format from the next generation on
     if(decoder != NULL)
+    {
         decoder->changeFormat(format);
+        if(loaded && decoder->isRunning())
+            seek(getCurrentPlayTime());
+    }
 }
 
 void Player::toggleLoop(const bool loop)
 {
+    FFDecoder* decoder = getDecoder();
     if(decoder != NULL)
         decoder->toggleLoop(loop, playing != IDLE);
     if(videoThread != NULL)
@@ -435,28 +621,28 @@ void Player::toggleLoop(const bool loop)
     this->loop = loop;
 }
 
-void Player::setRecueBuffers(AVDecodedFrame* v, AVDecodedFrame* vp)
+void Player::setRecueBuffers(AVDecodedFrame* v)
 {
-    if(playing != PLAYING)
+    if(playing != PLAYING && v != NULL)
     {
-#ifdef DECKLINK
-        if(deckLinkOutput != NULL && v != NULL)
+        if(outputDevice != NULL)
         {
-            int64_t timecode = startFrame + v->getClockPTS() * 25 * videoRate / 1000;
-            deckLinkOutput->outputVideo(v->getBuffer(), v->getSize(), true, timecode);
+            int64_t timecode = startFrame + v->getClockPTS() * 25 * qAbs(videoRate) / 1000;
+            outputDevice->outputVideo(v->getBuffer(), v->getSize(), true, timecode);
         }
-#else
-        Q_UNUSED(v);
-#endif
 #ifdef GUI
-        if(preview != NULL && vp != NULL)
-            preview->previewVideo(QByteArray((char*)vp->getBuffer(), vp->getSize()));
-#else
-     Q_UNUSED(vp);
+        if(preview != NULL && videoThread != NULL)
+            preview->previewVideo(videoThread->renderPreview(v));
 #endif
     }
 }
 
+void Player::setPreviewFormat(const QString& format, const int width, const int height)
+{
+    if(videoThread != NULL)
+        videoThread->changeFormat(format, width, height);
+}
+
 void Player::stop(const bool immediate)
 {
     if(immediate)
@@ -474,26 +660,20 @@ void Player::stop(const bool immediate)
     videoRate = 1.0;
     playing = STOPPING;
 
-#ifdef DECKLINK
-    if(deckLinkOutput != NULL)
+    LOG4CXX_DEBUG(Logger::getLogger("Player"), "Playout timing: " << playoutClock.getStatistics().toStdString());
+
+    if(outputDevice != NULL)
     {
-        deckLinkOutput->stopPlayback(immediate);
-        deckLinkOutput->setRate(videoRate);
+        outputDevice->stopPlayback(immediate);
+        outputDevice->setRate(videoRate);
 
         if(immediate)
         {
-            videoMutex.lock();
-            qDeleteAll(videoFramesList);
-            videoFramesList.clear();
-            videoMutex.unlock();
-
-            audioMutex.lock();
-            qDeleteAll(audioSamplesList);
-            audioSamplesList.clear();
-            audioMutex.unlock();
+            videoFrames.clear(AVDecodedFrame::releaseFrame);
+
+            audioSamples.clear(AVDecodedFrame::releaseFrame);
         }
     }
-#endif
 
     playing = IDLE;
 }
@@ -502,6 +682,7 @@ void Player::recue()
 {
     loaded = true;
 
+    FFDecoder* decoder = getDecoder();
     if(decoder != NULL)
     {
         decoder->stopDecoding();
@@ -517,6 +698,13 @@ void Player::take()
 {
     if(playing != PLAYING)
     {
+        // Steps served from the frame cache leave the output queues where the decoder was
+        if(stepped && videoThread != NULL)
+            seek(videoThread->getCurrentPlayTime());
+
+        // Preview and VU count their deadlines from here
+        playoutClock.start();
+
         playing = PLAYING;
         if(videoThread != NULL)
         {
@@ -535,10 +723,10 @@ void Player::take()
             audioThreadPreview->start();
         }
 #endif
-#ifdef DECKLINK
-        if(deckLinkOutput != NULL)
-            deckLinkOutput->startPlayback(this);
-#endif
+        // Seeks return before the decoder refilled the output queue
+        waitForDecoding();
+        if(outputDevice != NULL)
+            outputDevice->startPlayback(this);
     }
 }
 
@@ -560,15 +748,14 @@ void Player::pause(const bool resetRate)
         {
             videoRate = 1.0;
 
+            FFDecoder* decoder = getDecoder();
             if(decoder != NULL)
                 decoder->setRate(videoRate);
-#ifdef DECKLINK
-			if(deckLinkOutput != NULL)
+			if(outputDevice != NULL)
             {
-				deckLinkOutput->setRate(videoRate);
-                deckLinkOutput->stopPlayback(true);
+				outputDevice->setRate(videoRate);
+                outputDevice->stopPlayback(true);
             }
-#endif
         }
 
         if(videoThread != NULL && loaded)
@@ -589,82 +776,118 @@ void Player::dropMedia(const bool immediate)
 
 void Player::seek(const int64_t pos)
 {
+    seek(pos, AV_NOPTS_VALUE, true);
+}
+
+void Player::nextFrame()
+{
+    if(videoThread != NULL)
+        stepFrame(videoThread->getCurrentPlayTime() + 40, false);
+}
+
+void Player::previousFrame()
+{
+    if(videoThread != NULL)
+        stepFrame(videoThread->getCurrentPlayTime() - 40, true);
+}
+
+// The decoder keeps running, it applies the latest seek and frames of earlier seeks are dropped on the buses.
+// Frames from cacheFrom up to pos are only decoded into the frame cache
+void Player::seek(const int64_t pos, const int64_t cacheFrom, const bool cue)
+{
+    FFDecoder* decoder = getDecoder();
     if(decoder != NULL)
     {
-        decoder->stopDecoding();
-
-        if(audioThread != NULL)
-            audioThread->cleanup();
+        int seek_flag = 0;
+        if(videoThread != NULL && videoThread->getCurrentPlayTime() > pos)
+            seek_flag = AVSEEK_FLAG_BACKWARD;
 
+        // The buses drop the earlier generations before the decoder can publish the new one
+        int generation = FFDecoder::reserveGeneration();
+        videoBus.flush(generation);
+        audioBus.flush(generation);
 #ifdef PORTAUDIO
-        if(audioThreadPreview != NULL)
-            audioThreadPreview->cleanup();
+        audioPreviewBus.flush(generation);
 #endif
 
-        int seek_flag = 0;
-
         if(videoThread != NULL)
-        {
-            if(videoThread->getCurrentPlayTime() > pos)
-                seek_flag = AVSEEK_FLAG_BACKWARD;
             videoThread->cleanup(pos);
-        }
 
-#ifdef DECKLINK
-    if(deckLinkOutput != NULL)
-    {
-        videoMutex.lock();
-        qDeleteAll(videoFramesList);
-        videoFramesList.clear();
-        videoMutex.unlock();
+        decoder->seek(pos, seek_flag, cacheFrom, cue, generation);
+        frameCache.setPlayhead(pos);
+        stepped = false;
 
-        audioMutex.lock();
-        qDeleteAll(audioSamplesList);
-        audioSamplesList.clear();
-        audioMutex.unlock();
+        // Recue stops the decoder, the seek is applied as soon as it runs again
+        if(!decoder->isRunning())
+        {
+            decoder->startDecoding();
+            decoder->start();
+        }
     }
-#endif
+}
 
-        decoder->seek(pos, seek_flag);
-        decoder->startDecoding();
-        decoder->start();
+// Single frame steps are served from the frame cache, the decoder refills it in the step direction
+// before the window runs out. Backward refills decode half a window before pos into the cache only
+void Player::stepFrame(const int64_t pos, const bool backward)
+{
+    if(pos < 0)
+        return;
 
-        // Guarantees that there are at least 25 frames decoded
-        waitForDecoding();
+    int64_t window = qMax(frameCache.getCapacity() / 2, 25) * 40;
+    int64_t cacheFrom = backward ? pos - window : AV_NOPTS_VALUE;
+
+    frameCache.setPlayhead(pos);
+    AVDecodedFrame* v = playing != PLAYING ? frameCache.find(pos, 20) : NULL;
+    if(v == NULL)
+    {
+        seek(pos, cacheFrom, true);
+        return;
     }
-}
 
-void Player::nextFrame()
-{
-    if(videoThread != NULL)
-        seek(videoThread->getCurrentPlayTime() + 40);
-}
+    setRecueBuffers(v);
+    int64_t clock = v->getClockPTS();
+    v->release();
+
+    if(backward && frameCache.countBefore(pos) < FRAME_CACHE_MARGIN)
+        seek(pos, cacheFrom, false);
+    else if(!backward && frameCache.countAfter(pos) < FRAME_CACHE_MARGIN)
+        seek(pos, AV_NOPTS_VALUE, false);
+    else stepped = true;
 
-void Player::previousFrame()
-{
     if(videoThread != NULL)
-        seek(videoThread->getCurrentPlayTime() - 40);
+        videoThread->cleanup(clock);
 }
 
 double Player::forward()
 {
-    if(videoRate < 2.0)
+    if(videoRate < MAX_SHUTTLE_RATE)
     {
+        // Shuttles double from 2x, reverse rates halve back to -1x, from there forward play resumes at the slowest rate
         double rate = videoRate + 0.1;
-        if(rate > 2.1)
+        if(videoRate > 1.95)
+            rate = qRound(videoRate) * 2.0;
+        else if(videoRate < -1.5)
+            rate = qRound(videoRate) / 2.0;
+        else if(videoRate < 0)
+            rate = 0.1;
+        if(rate > MAX_SHUTTLE_RATE + 0.1)
             return videoRate;
         videoRate = rate;
 
+        FFDecoder* decoder = getDecoder();
         if(decoder != NULL)
             decoder->setRate(videoRate);
 
-#ifdef DECKLINK
-        if(deckLinkOutput != NULL)
-            deckLinkOutput->setRate(videoRate);
-#endif
+        // Trick play repeats frames, the output keeps the normal frame rate
+        if(outputDevice != NULL)
+            outputDevice->setRate(FFDecoder::isTrickPlay(videoRate) ? 1.0 : videoRate);
+        // Reverse play and trick play are set up when the decoder applies a seek, a paused port seeks in place
         if(videoThread != NULL)
         {
-            pause(false);
+            if(playing != PAUSED)
+                pause(false);
+            else if(loaded)
+                seek(videoThread->getCurrentPlayTime());
             take();
         }
 
@@ -689,23 +912,34 @@ double Player::forward()
 
 double Player::reverse()
 {
-    if(videoRate > 0.1)
+    if(videoRate > -MAX_SHUTTLE_RATE)
     {
+        // Shuttles halve back to 2x, below the slowest forward rate the clip plays backwards at -1x, then shuttles back doubling
         double rate = videoRate - 0.1;
-        if(rate < 0.1)
+        if(videoRate > 2.5)
+            rate = qRound(videoRate) / 2.0;
+        else if(videoRate < 0)
+            rate = qRound(videoRate) * 2.0;
+        else if(rate < 0.05)
+            rate = -1.0;
+        if(rate < -MAX_SHUTTLE_RATE - 0.1)
             return videoRate;
         videoRate = rate;
 
+        FFDecoder* decoder = getDecoder();
         if(decoder != NULL)
             decoder->setRate(videoRate);
 
-#ifdef DECKLINK
-        if(deckLinkOutput != NULL)
-            deckLinkOutput->setRate(videoRate);
-#endif
+        // Trick play repeats frames, the output keeps the normal frame rate
+        if(outputDevice != NULL)
+            outputDevice->setRate(FFDecoder::isTrickPlay(videoRate) ? 1.0 : videoRate);
+        // Reverse play and trick play are set up when the decoder applies a seek, a paused port seeks in place
         if(videoThread != NULL)
         {
-            pause(false);
+            if(playing != PAUSED)
+                pause(false);
+            else if(loaded)
+                seek(videoThread->getCurrentPlayTime());
             take();
         }
 
@@ -733,10 +967,8 @@ void Player::setStartMillisecond(const int64_t start_millisecond)
     startFrame = start_millisecond * 25 / 1000;
     startMillisecond = start_millisecond;
 
-#ifdef DECKLINK
-    if(deckLinkOutput != NULL)
-        deckLinkOutput->setStartFrame(startFrame);
-#endif
+    if(outputDevice != NULL)
+        outputDevice->setStartFrame(startFrame);
 }
 
 const int64_t Player::getStartMillisecond() const
@@ -797,13 +1029,15 @@ const bool Player::isEOF() const
 void Player::activateFilter(QString cg)
 {
     currentCG = cg;
+    FFDecoder* decoder = getDecoder();
     if(decoder != NULL && playing != PLAYING)
     {
-        decoder->cleanupFilters();
-        if(cg != "")
-        {
-            decoder->initFilters(cg, currentMediaFormat);
+        // Cached frames were rendered with the previous filter
+        frameCache.clear();
+
+        // A running decoder swaps the filter graph from the next generation on
+        decoder->setFilter(cg, currentMediaFormat);
+        if(decoder->isRunning())
             seek(getCurrentPlayTime());
-        }
     }
 }
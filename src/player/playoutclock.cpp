@@ -0,0 +1,148 @@
+#include "playoutclock.h"
+#include "outputdevice.h"
+
+extern "C"
+{
+    #include <libavutil/time.h>
+}
+
+// Longest single sleep, the reference clock is read again after each slice
+#define SLEEP_SLICE 4000
+
+const int64_t TimingHistogram::bucketLimits[TIMING_BUCKETS - 1] = { 500, 1000, 2000, 5000, 10000, 20000, 40000 };
+
+TimingHistogram::TimingHistogram()
+{
+    reset();
+}
+
+void TimingHistogram::add(const int64_t value)
+{
+    int bucket = 0;
+    while(bucket < TIMING_BUCKETS - 1 && value >= bucketLimits[bucket])
+        bucket++;
+
+    counts[bucket]++;
+    total++;
+    sum += value;
+    if(value > max)
+        max = value;
+}
+
+void TimingHistogram::reset()
+{
+    for(int i=0; i<TIMING_BUCKETS; i++)
+        counts[i] = 0;
+    total = 0;
+    sum = 0;
+    max = 0;
+}
+
+const QString TimingHistogram::getStatistics() const
+{
+    if(total == 0)
+        return "none";
+
+    QString statistics = QString::number(total) + " avg " + QString::number(sum / total / 1000.0, 'f', 2) + " ms max " +
+                         QString::number(max / 1000.0, 'f', 2) + " ms [";
+    for(int i=0; i<TIMING_BUCKETS; i++)
+    {
+        if(i < TIMING_BUCKETS - 1)
+            statistics += "<" + QString::number(bucketLimits[i] / 1000.0) + "ms: ";
+        else statistics += ">=" + QString::number(bucketLimits[i-1] / 1000.0) + "ms: ";
+        statistics += QString::number(counts[i]);
+        if(i < TIMING_BUCKETS - 1)
+            statistics += ", ";
+    }
+
+    return statistics + "]";
+}
+
+PlayoutClock::PlayoutClock()
+{
+    output = NULL;
+    epoch = av_gettime();
+
+    for(int i=0; i<2; i++)
+    {
+        lastLateness[i] = 0;
+        hasLateness[i] = false;
+    }
+}
+
+// Switching the source starts a new timeline, times of different clocks do not compare
+void PlayoutClock::setSource(OutputDevice* output)
+{
+    mutex.lock();
+    this->output = output;
+    mutex.unlock();
+
+    start();
+}
+
+const int64_t PlayoutClock::now()
+{
+    QMutexLocker locker(&mutex);
+
+    if(output != NULL)
+        return output->getReferenceTime();
+
+    return av_gettime();
+}
+
+void PlayoutClock::start()
+{
+    int64_t time = now();
+
+    mutex.lock();
+    epoch = time;
+    for(int i=0; i<2; i++)
+    {
+        lateness[i].reset();
+        jitter[i].reset();
+        hasLateness[i] = false;
+    }
+    mutex.unlock();
+}
+
+const int64_t PlayoutClock::getEpoch() const
+{
+    return epoch;
+}
+
+const int64_t PlayoutClock::sleepUntil(const int64_t deadline)
+{
+    int64_t remaining = deadline - now();
+    while(remaining > 0)
+    {
+        av_usleep(qMin(remaining, (int64_t)SLEEP_SLICE));
+        remaining = deadline - now();
+    }
+
+    return -remaining;
+}
+
+void PlayoutClock::recordLateness(const ClockStream stream, const int64_t late)
+{
+    mutex.lock();
+
+    lateness[stream].add(late);
+    if(hasLateness[stream])
+        jitter[stream].add(qAbs(late - lastLateness[stream]));
+    lastLateness[stream] = late;
+    hasLateness[stream] = true;
+
+    mutex.unlock();
+}
+
+const QString PlayoutClock::getStatistics()
+{
+    mutex.lock();
+    QString statistics = "video lateness: " + lateness[VIDEO_STREAM].getStatistics()
+                        + " jitter: " + jitter[VIDEO_STREAM].getStatistics()
+                        + ", audio lateness: " + lateness[AUDIO_STREAM].getStatistics()
+                        + " jitter: " + jitter[AUDIO_STREAM].getStatistics();
+    mutex.unlock();
+
+    return statistics;
+}
@@ -0,0 +1,292 @@
+#include "slicescaler.h"
+#include "pixelkernels.h"
+
+#include <QThread>
+
+extern "C"
+{
+    #include <libavutil/pixdesc.h>
+}
+
+#include <log4cxx/logger.h>
+
+using namespace log4cxx;
+
+// Converts one band of one field, source and destination rows are relative to the field.
+// Same size conversions with a hand-written kernel have no SwsContext
+class SliceJob : public QRunnable
+{
+    public:
+        SliceJob(SwsContext* swsContext, PixelKernel kernel, const int width,
+                 const int field, const int fieldCount, const int srcY, const int srcHeight, const int dstY)
+        {
+            this->swsContext = swsContext;
+            this->kernel = kernel;
+            this->width = width;
+            this->field = field;
+            this->fieldCount = fieldCount;
+            this->srcY = srcY;
+            this->srcHeight = srcHeight;
+            this->dstY = dstY;
+            done = NULL;
+            setAutoDelete(false);
+        }
+
+        ~SliceJob()
+        {
+            if(swsContext != NULL)
+                sws_freeContext(swsContext);
+        }
+
+        void prepare(const AVPixFmtDescriptor* srcDesc, const uint8_t* const src[], const int srcStride[],
+                     const AVPixFmtDescriptor* dstDesc, uint8_t* const dst[], const int dstStride[], QSemaphore* done)
+        {
+            for(int p=0; p<4; p++)
+            {
+                sliceSrc[p] = NULL;
+                sliceSrcStride[p] = 0;
+                sliceDst[p] = NULL;
+                sliceDstStride[p] = 0;
+
+                if(src[p] != NULL)
+                {
+                    int shift = (p == 1 || p == 2) ? srcDesc->log2_chroma_h : 0;
+                    sliceSrcStride[p] = srcStride[p] * fieldCount;
+                    sliceSrc[p] = src[p] + field * srcStride[p] + (srcY >> shift) * sliceSrcStride[p];
+                }
+
+                if(dst[p] != NULL)
+                {
+                    int shift = (p == 1 || p == 2) ? dstDesc->log2_chroma_h : 0;
+                    sliceDstStride[p] = dstStride[p] * fieldCount;
+                    sliceDst[p] = dst[p] + field * dstStride[p] + (dstY >> shift) * sliceDstStride[p];
+                }
+            }
+
+            this->done = done;
+        }
+
+        void run()
+        {
+            if(kernel != NULL)
+                kernel(sliceSrc, sliceSrcStride, sliceDst, sliceDstStride, width, srcHeight);
+            else sws_scale(swsContext, sliceSrc, sliceSrcStride, 0, srcHeight, sliceDst, sliceDstStride);
+
+            if(done != NULL)
+                done->release();
+        }
+
+    private:
+        SwsContext* swsContext;
+        PixelKernel kernel;
+        int width;
+        int field;
+        int fieldCount;
+        int srcY;
+        int srcHeight;
+        int dstY;
+
+        const uint8_t* sliceSrc[4];
+        int sliceSrcStride[4];
+        uint8_t* sliceDst[4];
+        int sliceDstStride[4];
+        QSemaphore* done;
+};
+
+QMutex SliceScaler::poolMutex;
+QThreadPool* SliceScaler::threadPool = NULL;
+
+SliceScaler::SliceScaler()
+{
+    srcWidth = 0;
+    srcHeight = 0;
+    srcFormat = AV_PIX_FMT_NONE;
+    dstWidth = 0;
+    dstHeight = 0;
+    dstFormat = AV_PIX_FMT_NONE;
+    flags = SWS_BILINEAR;
+    interlaced = false;
+    sliceCount = qMin(QThread::idealThreadCount(), 8);
+    if(sliceCount < 1)
+        sliceCount = 1;
+    changed = false;
+}
+
+SliceScaler::~SliceScaler()
+{
+    cleanup();
+}
+
+// Shared by the scalers of every port
+QThreadPool* SliceScaler::getThreadPool()
+{
+    poolMutex.lock();
+    if(threadPool == NULL)
+    {
+        threadPool = new QThreadPool();
+        threadPool->setMaxThreadCount(QThread::idealThreadCount());
+    }
+    poolMutex.unlock();
+
+    return threadPool;
+}
+
+void SliceScaler::destroy()
+{
+    poolMutex.lock();
+    if(threadPool != NULL)
+    {
+        threadPool->waitForDone();
+        delete threadPool;
+    }
+    threadPool = NULL;
+    poolMutex.unlock();
+}
+
+const bool SliceScaler::init(const int srcWidth, const int srcHeight, const AVPixelFormat srcFormat,
+                             const int dstWidth, const int dstHeight, const AVPixelFormat dstFormat,
+                             const int flags, const bool interlaced)
+{
+    mutex.lock();
+
+    this->srcWidth = srcWidth;
+    this->srcHeight = srcHeight;
+    this->srcFormat = srcFormat;
+    this->dstWidth = dstWidth;
+    this->dstHeight = dstHeight;
+    this->dstFormat = dstFormat;
+    this->flags = flags;
+    this->interlaced = interlaced;
+
+    bool created = createJobs();
+
+    mutex.unlock();
+
+    return created;
+}
+
+void SliceScaler::scale(const uint8_t* const src[], const int srcStride[], uint8_t* const dst[], const int dstStride[])
+{
+    mutex.lock();
+
+    if(changed)
+        createJobs();
+
+    if(!jobs.isEmpty())
+    {
+        const AVPixFmtDescriptor* srcDesc = av_pix_fmt_desc_get(srcFormat);
+        const AVPixFmtDescriptor* dstDesc = av_pix_fmt_desc_get(dstFormat);
+
+        // The calling thread converts the last band itself
+        QThreadPool* pool = getThreadPool();
+        int pending = jobs.size() - 1;
+        for(int i=0; i<pending; i++)
+        {
+            jobs[i]->prepare(srcDesc, src, srcStride, dstDesc, dst, dstStride, &done);
+            pool->start(jobs[i]);
+        }
+
+        SliceJob* last = jobs.last();
+        last->prepare(srcDesc, src, srcStride, dstDesc, dst, dstStride, NULL);
+        last->run();
+
+        done.acquire(pending);
+    }
+
+    mutex.unlock();
+}
+
+void SliceScaler::cleanup()
+{
+    mutex.lock();
+    deleteJobs();
+    mutex.unlock();
+}
+
+// Takes effect on the next converted frame
+void SliceScaler::setSliceCount(const int sliceCount)
+{
+    mutex.lock();
+    if(sliceCount > 0 && sliceCount != this->sliceCount)
+    {
+        this->sliceCount = sliceCount;
+        changed = true;
+    }
+    mutex.unlock();
+}
+
+const int SliceScaler::getSliceCount() const
+{
+    return sliceCount;
+}
+
+const int SliceScaler::getJobCount() const
+{
+    return jobs.size();
+}
+
+const bool SliceScaler::createJobs()
+{
+    deleteJobs();
+    changed = false;
+
+    const AVPixFmtDescriptor* srcDesc = av_pix_fmt_desc_get(srcFormat);
+    const AVPixFmtDescriptor* dstDesc = av_pix_fmt_desc_get(dstFormat);
+    if(srcDesc == NULL || dstDesc == NULL || srcWidth <= 0 || srcHeight <= 0 || dstWidth <= 0 || dstHeight <= 0)
+        return false;
+
+    // Band boundaries have to fall on chroma lines in both the source and the destination
+    int alignment = 1 << qMax(srcDesc->log2_chroma_h, dstDesc->log2_chroma_h);
+
+    int fieldCount = interlaced && srcHeight % (2 * alignment) == 0 && dstHeight % (2 * alignment) == 0 ? 2 : 1;
+    int fieldSrcHeight = srcHeight / fieldCount;
+    int fieldDstHeight = dstHeight / fieldCount;
+
+    // Bands only map one to one without vertical scaling, otherwise each field is converted as a whole
+    int bands = 1;
+    if(fieldSrcHeight == fieldDstHeight)
+        bands = qMax(1, sliceCount / fieldCount);
+
+    // Bands are already split by field, so 4:2:0 chroma lines are taken from the right field without the interlaced kernel
+    PixelKernel kernel = NULL;
+    if(srcWidth == dstWidth && srcHeight == dstHeight)
+        kernel = PixelKernels::getKernel(srcFormat, dstFormat, false);
+
+    int bandHeight = ((fieldSrcHeight / bands + alignment - 1) / alignment) * alignment;
+
+    for(int field=0; field<fieldCount; field++)
+    {
+        for(int y=0; y<fieldSrcHeight; y+=bandHeight)
+        {
+            int srcSliceHeight = bands == 1 ? fieldSrcHeight : qMin(bandHeight, fieldSrcHeight - y);
+            int dstSliceHeight = bands == 1 ? fieldDstHeight : srcSliceHeight;
+
+            SwsContext* swsContext = NULL;
+            if(kernel == NULL)
+            {
+                swsContext = sws_getContext(srcWidth, srcSliceHeight, srcFormat,
+                                            dstWidth, dstSliceHeight, dstFormat,
+                                            flags, NULL, NULL, NULL);
+                if(swsContext == NULL)
+                {
+                    LOG4CXX_ERROR(Logger::getLogger("SliceScaler"), "Error creating slice conversion context");
+                    deleteJobs();
+                    return false;
+                }
+            }
+
+            jobs.append(new SliceJob(swsContext, kernel, srcWidth, field, fieldCount, y, srcSliceHeight, y));
+
+            if(bands == 1)
+                break;
+        }
+    }
+
+    return true;
+}
+
+void SliceScaler::deleteJobs()
+{
+    qDeleteAll(jobs);
+    jobs.clear();
+}
@@ -1,20 +1,32 @@
 #include "videothread.h"
 
-extern "C"
-{
-    #include <libavutil/time.h>
-}
-
-VideoThread::VideoThread(QObject* parent) : QThread(parent)
+VideoThread::VideoThread(PlayoutClock* clock, QObject* parent) : QThread(parent), videoFrames(50)
 {
+    this->clock = clock;
     playing = false;
     loop = false;
+    preview = false;
     video_clock = 0;
+
+#ifdef GUI
+    swsContextPreview = NULL;
+    framePreview = NULL;
+    sourceWidth = 0;
+    sourceHeight = 0;
+    previewWidth = 0;
+    previewHeight = 0;
+    previewOffset = 0;
+    previewFrameSize = 0;
+    previewChanged = false;
+#endif
 }
 
 VideoThread::~VideoThread()
 {
     cleanup(0);
+#ifdef GUI
+    cleanupPreview();
+#endif
 }
 
 void VideoThread::toggleLoop(const bool loop, const bool active)
@@ -36,41 +48,46 @@ void VideoThread::startPlaying()
     playing = true;
 }
 
+// Frames are paced on the port clock, each one ends at an absolute deadline counted from the epoch shared with the audio
 void VideoThread::run()
 {
-    int64_t last_clock = av_gettime();
+    int64_t deadline = clock->getEpoch();
 
     while(playing)
     {
         int64_t diff = 0;
         int64_t clockPTS = 0;
 
-        videoMutex.lock();
-
-        if(!previewFramesList.empty())
+        // Sleeps until the decoder delivers a frame
+        AVDecodedFrame* v = NULL;
+        if(videoFrames.pop(v, 10))
         {
-            AVDecodedFrame* vp = previewFramesList.takeFirst();
-            if(vp != NULL)
+            if(v != NULL)
             {
-                diff = vp->getPTS();
-                clockPTS = vp->getClockPTS();
-                emit previewVideo(QByteArray((char*)vp->getBuffer(), vp->getSize()));
-                delete vp;
+                diff = v->getPTS();
+                clockPTS = v->getClockPTS();
+
+                if(preview)
+                {
+                    QByteArray rgba = renderPreview(v);
+                    if(!rgba.isEmpty())
+                        emit previewVideo(rgba);
+                }
+                v->release();
             }
             else if(!loop)
                 playing = false;
         }
 
-        videoMutex.unlock();
-
         if(diff > 0)
         {
             video_clock = clockPTS;
-            last_clock += diff;
-            int64_t msecs = last_clock - av_gettime();
+            deadline += diff;
 
-            if(msecs > 0.0)
-                this->usleep(msecs);
+            int64_t lateness = clock->sleepUntil(deadline);
+            clock->recordLateness(VIDEO_STREAM, lateness);
+            if(lateness > RESYNC_LATENESS)
+                deadline += lateness;
         }
     }
 }
@@ -81,20 +98,9 @@ void VideoThread::stopPlaying()
     this->wait();
 }
 
-const bool VideoThread::pushVideoFrame(AVDecodedFrame* vp)
+FrameQueue* VideoThread::getQueue()
 {
-    videoMutex.lock();
-
-    if(previewFramesList.size() > 50)
-    {
-        videoMutex.unlock();
-        return false;
-    }
-
-    previewFramesList.append(vp);
-    videoMutex.unlock();
-
-    return true;
+    return &videoFrames;
 }
 
 const int64_t VideoThread::getCurrentPlayTime() const
@@ -106,10 +112,96 @@ void VideoThread::cleanup(const int64_t pos)
 {
     video_clock = pos;
 
-    videoMutex.lock();
+    videoFrames.clear(AVDecodedFrame::releaseFrame);
+}
 
-    qDeleteAll(previewFramesList);
-    previewFramesList.clear();
+void VideoThread::setPreview(const bool preview)
+{
+    this->preview = preview;
+}
 
-    videoMutex.unlock();
+void VideoThread::changeFormat(const QString& format, const int width, const int height)
+{
+#ifdef GUI
+    previewMutex.lock();
+
+    sourceWidth = width;
+    sourceHeight = height;
+
+    if(format == "PAL")
+        previewWidth = 360;
+    else previewWidth = 512;
+    previewHeight = height == 608 ? 304 : 288;
+    previewOffset = 0;
+    if(previewHeight == 304)
+        previewOffset = 16 * previewWidth;
+    previewFrameSize = (previewWidth * previewHeight - previewOffset) * 4;
+
+    // The conversion context is rebuilt on the next rendered frame
+    previewChanged = true;
+
+    previewMutex.unlock();
+#else
+    Q_UNUSED(format);
+    Q_UNUSED(width);
+    Q_UNUSED(height);
+#endif
+}
+
+// Converts an output frame to the RGBA preview, returns an empty buffer when there is no preview
+const QByteArray VideoThread::renderPreview(AVDecodedFrame* v)
+{
+    QByteArray rgba;
+
+#ifdef GUI
+    if(v == NULL)
+        return rgba;
+
+    previewMutex.lock();
+
+    if(previewChanged)
+    {
+        cleanupPreview();
+
+        swsContextPreview = sws_getContext(sourceWidth, sourceHeight, AV_PIX_FMT_UYVY422,
+                                previewWidth, previewHeight, AV_PIX_FMT_RGBA,
+                                SWS_FAST_BILINEAR, NULL, NULL, NULL);
+
+        framePreview = av_frame_alloc();
+        framePreview->width  = previewWidth;
+        framePreview->height = previewHeight;
+        framePreview->format = AV_PIX_FMT_RGBA;
+        av_frame_get_buffer(framePreview, 32);
+
+        previewChanged = false;
+    }
+
+    if(swsContextPreview != NULL && v->getSize() >= sourceWidth * sourceHeight * 2)
+    {
+        const uint8_t* src[4] = { v->getBuffer(), NULL, NULL, NULL };
+        int srcStride[4] = { sourceWidth * 2, 0, 0, 0 };
+
+        sws_scale(swsContextPreview, src, srcStride, 0, sourceHeight, framePreview->data, framePreview->linesize);
+        rgba = QByteArray((char*)framePreview->data[0] + previewOffset, previewFrameSize);
+    }
+
+    previewMutex.unlock();
+#else
+    Q_UNUSED(v);
+#endif
+
+    return rgba;
+}
+
+#ifdef GUI
+void VideoThread::cleanupPreview()
+{
+    if(swsContextPreview != NULL)
+        sws_freeContext(swsContextPreview);
+    swsContextPreview = NULL;
+
+    if(framePreview != NULL)
+        av_frame_free(&framePreview);
+    framePreview = NULL;
 }
+#endif
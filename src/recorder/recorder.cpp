@@ -75,7 +75,7 @@ void Recorder::run()
                 if(audioBuffer != NULL)
                 {
                     audioPts = muxer.muxAudioFrame(audioBuffer);
-                    delete audioBuffer;
+                    audioBuffer->release();
                 }
             }
             else
@@ -84,7 +84,7 @@ void Recorder::run()
                 if(videoBuffer != NULL)
                 {
                     videoPts = muxer.muxVideoFrame(videoBuffer);
-                    delete videoBuffer;
+                    videoBuffer->release();
                 }
             }
         }
@@ -116,7 +116,7 @@ int64_t Recorder::stopRecording(bool recordRestart)
                     if(audioBuffer != NULL)
                     {
                         audioPts = muxer.muxAudioFrame(audioBuffer);
-                        delete audioBuffer;
+                        audioBuffer->release();
                     }
                     else break;
                 }
@@ -126,7 +126,7 @@ int64_t Recorder::stopRecording(bool recordRestart)
                     if(videoBuffer != NULL)
                     {
                         videoPts = muxer.muxVideoFrame(videoBuffer);
-                        delete videoBuffer;
+                        videoBuffer->release();
                     }
                     else break;
                 }
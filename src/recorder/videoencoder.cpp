@@ -49,6 +49,7 @@ VideoEncoder::VideoEncoder()
     frame = NULL;
     tmpFrame = NULL;
     swsContext = NULL;
+    kernel = NULL;
 
     frameSize = 0;
 }
@@ -145,9 +146,14 @@ double VideoEncoder::initialize(QString format, AVFormatContext* outputContext)
     tmpFrame->height = codecContext->height;
     av_frame_get_buffer(tmpFrame, 32);
 
-    swsContext = sws_getContext(tmpFrame->width, tmpFrame->height, (AVPixelFormat)tmpFrame->format,
-                            frame->width, frame->height, (AVPixelFormat)frame->format,
-                            SWS_BICUBIC, NULL, NULL, NULL);
+    // UYVY to yuv422p at the same size is a plain deinterleave, swscale is only needed for other codec formats
+    kernel = PixelKernels::getKernel((AVPixelFormat)tmpFrame->format, (AVPixelFormat)frame->format, true);
+    if(kernel == NULL)
+    {
+        swsContext = sws_getContext(tmpFrame->width, tmpFrame->height, (AVPixelFormat)tmpFrame->format,
+                                frame->width, frame->height, (AVPixelFormat)frame->format,
+                                SWS_BICUBIC, NULL, NULL, NULL);
+    }
 
     frameSize = av_image_get_buffer_size((AVPixelFormat)tmpFrame->format, tmpFrame->width, tmpFrame->height, 1);
 
@@ -416,8 +422,10 @@ double VideoEncoder::muxVideoFrame(AVDecodedFrame* videoBuffer)
         av_image_fill_arrays(tmpFrame->data, tmpFrame->linesize, videoBuffer->getBuffer(),
                        (AVPixelFormat)tmpFrame->format, tmpFrame->width, tmpFrame->height, 1);
 
-        sws_scale(swsContext, tmpFrame->data, tmpFrame->linesize,
-                  0, tmpFrame->height, frame->data, frame->linesize);
+        if(kernel != NULL)
+            kernel(tmpFrame->data, tmpFrame->linesize, frame->data, frame->linesize, tmpFrame->width, tmpFrame->height);
+        else sws_scale(swsContext, tmpFrame->data, tmpFrame->linesize,
+                       0, tmpFrame->height, frame->data, frame->linesize);
 
         ret = avcodec_send_frame(codecContext, frame);
         if (ret < 0 && ret != AVERROR_EOF)
@@ -458,6 +466,7 @@ void VideoEncoder::cleanup()
     if(swsContext != NULL)
         sws_freeContext(swsContext);
     swsContext = NULL;
+    kernel = NULL;
 
     if(tmpFrame != NULL)
         av_frame_free(&tmpFrame);
@@ -2,11 +2,15 @@
 
 #include <QDebug>
 
-VideoPort::VideoPort(const int num)
+VideoPort::VideoPort(const int num, const int output)
 {
     this->num = num;
+    this->output = output;
+    bufferDepth = DEFAULT_BUFFER_DEPTH;
+    cacheSize = DEFAULT_FRAME_CACHE_SIZE;
     debugName = QString("{VideoPort ") + QString::number(num) + QString("} ");
     state = NONE;
+    input = NULL;
     player = NULL;
 }
 
@@ -34,7 +38,10 @@ const int VideoPort::activatePlayout()
 
     state = PLAYOUT;
     player = new Player();
-    player->setDeckLinkOutput("Output (" + QString::number(num) + ")");
+    player->setName("VideoPort " + QString::number(num));
+    player->setBufferDepth(bufferDepth);
+    player->setCacheSize(cacheSize);
+    player->setOutputDevice("Output (" + QString::number(output) + ")");
 
     return 0;
 }
@@ -51,6 +58,39 @@ const int VideoPort::deactivatePlayout()
     return 0;
 }
 
+// Frames scheduled ahead on the output, kept across playout activations
+const int VideoPort::setBufferDepth(const int depth)
+{
+    if(depth < MIN_BUFFER_DEPTH || depth > MAX_BUFFER_DEPTH)
+        return -1;
+
+    qDebug() << debugName + "Output buffer depth changed to: " + QString::number(depth);
+    bufferDepth = depth;
+    if(player != NULL)
+        player->setBufferDepth(bufferDepth);
+
+    return 0;
+}
+
+const int VideoPort::setLowLatency(const bool enabled)
+{
+    return setBufferDepth(enabled ? LOW_LATENCY_BUFFER_DEPTH : DEFAULT_BUFFER_DEPTH);
+}
+
+// Frame cache for stepping in megabytes, kept across playout activations
+const int VideoPort::setCacheSize(const int megabytes)
+{
+    if(megabytes < 0 || megabytes > MAX_FRAME_CACHE_SIZE)
+        return -1;
+
+    qDebug() << debugName + "Frame cache size changed to: " + QString::number(megabytes) + " MB";
+    cacheSize = megabytes;
+    if(player != NULL)
+        player->setCacheSize(cacheSize);
+
+    return 0;
+}
+
 // TODO: set lock state, get state, port get mode (input/output), port set mode
 
 // Playout functions
@@ -60,6 +100,13 @@ const int64_t VideoPort::loadItem(const QString& path, const bool canTake) const
     if(state != PLAYOUT)
         return -1;
 
+    // Clips loaded while playing follow the current one back to back
+    if(canTake && player->isPlaying())
+    {
+        qDebug() << debugName + "Cued next clip location: " + path;
+        return player->cueNextMedia(path);
+    }
+
     qDebug() << debugName + "Loaded clip location: " + path;
     return player->loadMedia(path);
 }
@@ -97,6 +144,28 @@ const int64_t VideoPort::getCurrentTimeCode() const
     return player->getCurrentTimeCode();
 }
 
+const int VideoPort::getAudioBufferLevel() const
+{
+    if(state != PLAYOUT)
+        return -1;
+
+    if(player->getOutputDevice() == NULL)
+        return -1;
+
+    return player->getOutputDevice()->getAudioBufferLevel();
+}
+
+const int VideoPort::getAudioUnderruns() const
+{
+    if(state != PLAYOUT)
+        return -1;
+
+    if(player->getOutputDevice() == NULL)
+        return -1;
+
+    return player->getOutputDevice()->getAudioUnderruns();
+}
+
 const int VideoPort::recue(const bool loop) const
 {
     if(state != PLAYOUT)